@@ -215,6 +215,7 @@ namespace RENDER_MASTER
 	DEFINE_EVENT(IEvent)
 	DEFINE_EVENT1(IPositionEvent, OUT vec3 *pos)
 	DEFINE_EVENT1(IRotationEvent, OUT quat *rot)
+	DEFINE_EVENT1(IScaleEvent, OUT vec3 *scale)
 	DEFINE_EVENT1(IGameObjectEvent, OUT IGameObject *pGameObject)
 	DEFINE_EVENT1(IStringEvent, const char *pString)
 	DEFINE_EVENT2(ILogEvent, const char *pMessage, LOG_TYPE type)
@@ -230,7 +231,13 @@ namespace RENDER_MASTER
 		POSITION	= 1 << 0,
 		NORMAL		= 1 << 1,
 		TEX_COORD	= 1 << 2,
-		COLOR		= 1 << 3
+		COLOR		= 1 << 3,
+		TANGENT		= 1 << 4,
+
+		// Set together with NORMAL or TANGENT if attribute is stored as VERTEX_FORMAT::OCTAHEDRAL.
+		// Shader decodes it, other compact formats are expanded to float by hardware
+		NORMAL_OCTAHEDRAL	= 1 << 5,
+		TANGENT_OCTAHEDRAL	= 1 << 6
 	};
 	DEFINE_ENUM_OPERATORS(INPUT_ATTRUBUTE)
 
@@ -261,6 +268,26 @@ namespace RENDER_MASTER
 	// positionOffset = 0, positionStride = 12,
 	// texCoordOffset = vertexNumber * 12, texCoordStride = 8,
 	// normalOffset = vertexNumber * (12 + 8), normalStride = 12
+	//
+	// Offsets and strides must be multiple of 4
+	//
+	// Storage of each attribute is set by its VERTEX_FORMAT:
+	//
+	// Format		Position			Normal				TexCoord			Color			Tangent
+	// FLOAT		float4 (w = 1)		float4 (w unused)	float2				float4			float4 (w - handedness)
+	// HALF			half4 (w = 1)		-					-					half4			-
+	// OCTAHEDRAL	-					snorm16 x2			-					-				snorm16 x4 (x, y, handedness, unused)
+	// UNORM16		-					-					unorm16 x2 [0; 1]	-				-
+	//
+	// Octahedral: unit vector projected on octahedron |x| + |y| + |z| = 1 which is unfolded to square (see encodeOctahedral())
+
+	enum class VERTEX_FORMAT
+	{
+		FLOAT,
+		HALF,
+		OCTAHEDRAL,
+		UNORM16
+	};
 
 	struct MeshDataDesc
 	{
@@ -270,18 +297,27 @@ namespace RENDER_MASTER
 
 		uint positionOffset{0};
 		uint positionStride{0};
+		VERTEX_FORMAT positionFormat{VERTEX_FORMAT::FLOAT};
 
 		bool normalsPresented{false};
 		uint normalOffset{0};
 		uint normalStride{0};
+		VERTEX_FORMAT normalFormat{VERTEX_FORMAT::FLOAT};
 
 		bool texCoordPresented{false};
 		uint texCoordOffset{0};
 		uint texCoordStride{0};
+		VERTEX_FORMAT texCoordFormat{VERTEX_FORMAT::FLOAT};
 
 		bool colorPresented{false};
 		uint colorOffset{0};
 		uint colorStride{0};
+		VERTEX_FORMAT colorFormat{VERTEX_FORMAT::FLOAT};
+
+		bool tangentPresented{false};
+		uint tangentOffset{0};
+		uint tangentStride{0};
+		VERTEX_FORMAT tangentFormat{VERTEX_FORMAT::FLOAT};
 	};
 
 	enum class MESH_INDEX_FORMAT
@@ -308,6 +344,23 @@ namespace RENDER_MASTER
 		MESH_INDEX_FORMAT format{MESH_INDEX_FORMAT::NOTHING};
 	};
 
+	struct UniformBlockField
+	{
+		const char *name;
+		uint offset;
+		uint bytes;
+	};
+
+	// C++ struct mirroring shader block UNIFORM_BUFFER_BEGIN(name).
+	// Fields follow std140 rules (HLSL packing is the same for vec4, mat4 and scalars)
+	struct UniformBlockDesc
+	{
+		const char *name;
+		const UniformBlockField *fields;
+		uint fieldsNum;
+		uint bytes; // sizeof struct
+	};
+
 	enum class TEXTURE_TYPE
 	{
 		TYPE_2D					= 0x00000001,
@@ -403,6 +456,9 @@ namespace RENDER_MASTER
 		virtual API GetVertexTopology(OUT VERTEX_TOPOLOGY *topology) = 0;
 	};
 
+	// Returned by GetParameterHandle() for unknown parameter. Setting it does nothing
+	#define SHADER_PARAMETER_INVALID 0xFFFFFFFFu
+
 	class ICoreShader
 	{
 	public:
@@ -411,6 +467,13 @@ namespace RENDER_MASTER
 		virtual API SetVec4Parameter(const char* name, const vec4 *value) = 0;
 		virtual API SetMat4Parameter(const char* name, const mat4 *value) = 0;
 		virtual API SetUintParameter(const char* name, uint value) = 0;
+		virtual API GetParameterHandle(const char* name, OUT uint *handle) = 0;
+		virtual API SetFloatParameter(uint handle, float value) = 0;
+		virtual API SetVec4Parameter(uint handle, const vec4 *value) = 0;
+		virtual API SetMat4Parameter(uint handle, const mat4 *value) = 0;
+		virtual API SetUintParameter(uint handle, uint value) = 0;
+		virtual API GetUniformBlockHandle(const char* name, OUT uint *handle) = 0;
+		virtual API SetUniformBlock(uint handle, const void *data) = 0;
 		virtual API FlushParameters() = 0;
 	};
 
@@ -438,6 +501,41 @@ namespace RENDER_MASTER
 		ONE_MINUS_DEST_COLOR,
 	};
 
+	enum class CULL_MODE
+	{
+		NONE = 0,
+		FRONT,
+		BACK,
+	};
+
+	enum class FILL_MODE
+	{
+		SOLID = 0,
+		WIREFRAME,
+	};
+
+	// All render state needed for draw call except resources (mesh, textures, buffers)
+	struct PipelineStateDesc
+	{
+		IShader *shader{nullptr};
+		INPUT_ATTRUBUTE attributes{INPUT_ATTRUBUTE::CUSTOM}; // vertex layout of meshes drawn with state. CUSTOM - any
+		BLEND_FACTOR srcBlend{BLEND_FACTOR::NONE};
+		BLEND_FACTOR destBlend{BLEND_FACTOR::NONE};
+		bool depthTest{true};
+		bool depthWrite{true};
+		CULL_MODE cullMode{CULL_MODE::NONE};
+		FILL_MODE fillMode{FILL_MODE::SOLID};
+	};
+
+	// Immutable. Created by ICoreRender::CreatePipelineState(), free with delete.
+	// Keeps reference to shader
+	class ICorePipelineState
+	{
+	public:
+		virtual ~ICorePipelineState() = default;
+		virtual API GetDesc(OUT PipelineStateDesc *desc) = 0;
+	};
+
 	class ICoreRender : public ISubSystem
 	{
 	public:
@@ -450,9 +548,20 @@ namespace RENDER_MASTER
 
 		virtual API CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc, const MeshIndexDesc *indexDesc, VERTEX_TOPOLOGY mode) = 0;
 		virtual API CreateShader(OUT ICoreShader **pShader, const char *vert, const char *frag, const char *geom) = 0;
+		virtual API CreateShaderFromBinary(OUT ICoreShader **pShader, const uint8 *data, uint size) = 0;
+		virtual API GetShaderBinary(ICoreShader *pShader, OUT uint8 *data, OUT uint *size) = 0; // pass data = nullptr to get size
+		virtual API CompileShaderBinary(OUT uint8 **data, OUT uint *size, const char *vert, const char *frag, const char *geom) = 0; // thread-safe, free data with delete[]. E_NOTIMPL if backend can't compile without context
+		virtual API GetShaderCompilerVersion(OUT const char **pVersion) = 0; // compiler, its flags and driver. Shader binaries are compatible only within the same version
+		// Background compilation by driver threads. CreateShader() with the same texts finishes it,
+		// CancelShaderCompile() drops it. E_NOTIMPL if backend or driver doesn't support it
+		virtual API StartShaderCompile(const char *vert, const char *frag, const char *geom) = 0;
+		virtual API IsShaderCompiling(OUT int *compiling, const char *vert, const char *frag, const char *geom) = 0; // 0 if finished or not started
+		virtual API CancelShaderCompile(const char *vert, const char *frag, const char *geom) = 0;
 		virtual API CreateTexture(OUT ICoreTexture **pTexture, uint8 *pData, uint width, uint height, TEXTURE_TYPE type, TEXTURE_FORMAT format, TEXTURE_CREATE_FLAGS flags, int mipmapsPresented) = 0;
 		virtual API CreateRenderTarget(OUT ICoreRenderTarget **pRenderTarget) = 0;
 		virtual API CreateStructuredBuffer(OUT ICoreStructuredBuffer **pStructuredBuffer, uint size, uint elementSize) = 0;
+		virtual API RegisterUniformBlock(const UniformBlockDesc *desc) = 0; // before creation of shaders using block
+		virtual API CreatePipelineState(OUT ICorePipelineState **pState, const PipelineStateDesc *desc) = 0; // E_INVALIDARG if desc can't be used for drawing
 
 		virtual API PushStates() = 0;
 		virtual API PopStates() = 0;
@@ -460,6 +569,7 @@ namespace RENDER_MASTER
 		virtual API UnbindAllTextures() = 0;
 		virtual API SetCurrentRenderTarget(IRenderTarget *pRenderTarget) = 0;
 		virtual API RestoreDefaultRenderTarget() = 0;
+		virtual API SetPipelineState(ICorePipelineState *state) = 0; // applies only fields different from current state
 		virtual API SetShader(IShader *pShader) = 0;
 		virtual API SetMesh(IMesh* mesh) = 0;
 		virtual API SetStructuredBufer(uint slot, IStructuredBuffer* buffer) = 0;
@@ -512,7 +622,9 @@ namespace RENDER_MASTER
 		virtual API RenderPassGUI() = 0;
 		virtual API GetRenderTexture2D(OUT ITexture **texOut, uint width, uint height, TEXTURE_FORMAT format) = 0;
 		virtual API ReleaseRenderTexture2D(ITexture *texIn) = 0;
+		virtual API SetRenderTexturePoolBudget(uint megabytes) = 0;
 		virtual API ShadersReload() = 0;
+		virtual API ShadersWarmUp() = 0;
 	};
 
 	// Axis aligned bound box
@@ -527,6 +639,14 @@ namespace RENDER_MASTER
 		float minZ;
 	};
 
+	// Bounding sphere
+	// Specified in local mesh coordinates
+	struct BoundingSphere
+	{
+		vec3 center;
+		float radius;
+	};
+
 	//////////////////////
 	// Game Objects
 	//////////////////////
@@ -547,13 +667,16 @@ namespace RENDER_MASTER
 		virtual API GetScale(OUT vec3 *scale) = 0;
 		virtual API GetModelMatrix(OUT mat4 *mat) = 0;
 		virtual API GetInvModelMatrix(OUT mat4 *mat) = 0;
+		virtual API GetNormalMatrix(OUT mat4 *mat) = 0;
 		virtual API GetAABB(OUT AABB *aabb) = 0;
+		virtual API GetWorldAABB(OUT AABB *aabb) = 0;
 		virtual API Copy(IGameObject *copy) = 0;
 
 		// Events
 		virtual API GetNameEv(OUT IStringEvent **pEvent) = 0;
 		virtual API GetPositionEv(OUT IPositionEvent **pEvent) = 0;
 		virtual API GetRotationEv(OUT IRotationEvent **pEvent) = 0;
+		virtual API GetScaleEv(OUT IScaleEvent **pEvent) = 0;
 
 		RUNTIME_ONLY_RESOURCE_INTERFACE
 	};
@@ -584,6 +707,8 @@ namespace RENDER_MASTER
 		virtual API GetNumberOfVertex(OUT uint *number) = 0;
 		virtual API GetAttributes(OUT INPUT_ATTRUBUTE *attribs) = 0;
 		virtual API GetVertexTopology(OUT VERTEX_TOPOLOGY *topology) = 0;
+		virtual API GetAABB(OUT AABB *aabb) = 0;
+		virtual API GetBoundingSphere(OUT BoundingSphere *sphere) = 0;
 
 		BASE_RESOURCE_INTERFACE
 	};
@@ -635,6 +760,16 @@ namespace RENDER_MASTER
 		virtual API SetVec4Parameter(const char* name, const vec4 *value) = 0;
 		virtual API SetMat4Parameter(const char* name, const mat4 *value) = 0;
 		virtual API SetUintParameter(const char* name, uint value) = 0;
+		// Handle is resolved once and is valid only for this shader
+		virtual API GetParameterHandle(const char* name, OUT uint *handle) = 0;
+		virtual API SetFloatParameter(uint handle, float value) = 0;
+		virtual API SetVec4Parameter(uint handle, const vec4 *value) = 0;
+		virtual API SetMat4Parameter(uint handle, const mat4 *value) = 0;
+		virtual API SetUintParameter(uint handle, uint value) = 0;
+		// Only for blocks registered by ICoreRender::RegisterUniformBlock() and validated at shader creation.
+		// data is struct described by UniformBlockDesc
+		virtual API GetUniformBlockHandle(const char* name, OUT uint *handle) = 0;
+		virtual API SetUniformBlock(uint handle, const void *data) = 0;
 		virtual API FlushParameters() = 0;
 
 		RUNTIME_ONLY_RESOURCE_INTERFACE
@@ -679,6 +814,31 @@ namespace RENDER_MASTER
 	#define E_GEOM_SHADER_FAILED_COMPILE 0x80270008L
 	#define E_FRAGMENT_SHADER_FAILED_COMPILE 0x80270009L
 
+	enum class LOAD_STATUS
+	{
+		LOADING,
+		READY,
+		FAILED
+	};
+
+	// Completion handle of asynchronous load.
+	// Status is changed on main thread between frames, so handle can be polled once per frame.
+	// Handle is returned with reference of caller, Release() it when result is not needed.
+	// Handle holds reference of loaded resource, AddRef() resource to keep it after that
+	class ILoadHandle : public IUnknown
+	{
+	public:
+		virtual ~ILoadHandle() = default;
+		virtual API GetStatus(OUT LOAD_STATUS *status) = 0;
+		virtual API GetPath(OUT const char **path) = 0;
+		// E_FAIL if load is not finished or resource is of other type
+		virtual API GetModel(OUT IModel **pModel) = 0;
+		virtual API GetTexture(OUT ITexture **pTexture) = 0;
+		virtual API GetTextFile(OUT ITextFile **pTextFile) = 0;
+
+		RUNTIME_ONLY_RESOURCE_INTERFACE
+	};
+
 	class IResourceManager : public ISubSystem
 	{
 	public:
@@ -687,8 +847,16 @@ namespace RENDER_MASTER
 		virtual API LoadTexture(OUT ITexture **pTexture, const char *path, TEXTURE_CREATE_FLAGS flags) = 0;
 		virtual API LoadTextFile(OUT ITextFile **pShader, const char *path) = 0;
 
+		// Asynchronous variants. File is read and decoded on worker thread,
+		// GPU objects are created on main thread within per-frame time budget.
+		// Model is added to scene only when all its meshes are created
+		virtual API LoadModelAsync(OUT ILoadHandle **pHandle, const char *path) = 0;
+		virtual API LoadTextureAsync(OUT ILoadHandle **pHandle, const char *path, TEXTURE_CREATE_FLAGS flags) = 0;
+		virtual API LoadTextFileAsync(OUT ILoadHandle **pHandle, const char *path) = 0;
+
 		virtual API CreateTexture(OUT ITexture **pTextureOut, uint width, uint height, TEXTURE_TYPE type, TEXTURE_FORMAT format, TEXTURE_CREATE_FLAGS flags) = 0;
 		virtual API CreateShader(OUT IShader **pShderOut, const char *vert, const char *geom, const char *frag) = 0;
+		virtual API CreateShaderFromBinary(OUT IShader **pShderOut, const uint8 *data, uint size, const char *vert, const char *geom, const char *frag) = 0;
 		virtual API CreateRenderTarget(OUT IRenderTarget **pRenderTargetOut) = 0;
 		virtual API CreateStructuredBuffer(OUT IStructuredBuffer **pBufOut, uint size, uint elementSize) = 0;
 		virtual API CreateGameObject(OUT IGameObject **pGameObject) = 0;
@@ -1008,6 +1176,7 @@ namespace RENDER_MASTER
 	using StructuredBufferPtr = Microsoft::WRL::ComPtr<IStructuredBuffer>;
 
 	using ModelPtr = Microsoft::WRL::ComPtr<IModel>;
+	using LoadHandlePtr = Microsoft::WRL::ComPtr<ILoadHandle>;
 #endif
 
 }
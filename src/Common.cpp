@@ -144,6 +144,257 @@ mat4 perspectiveRH_ZO(float fov, float aspect, float zNear, float zFar)
 	return Result;
 }
 
+void extractFrustumPlanes(vec4 planesOut[6], const mat4& VP)
+{
+	const auto row = [&](int i) -> vec4 { return vec4(VP.el_2D[i][0], VP.el_2D[i][1], VP.el_2D[i][2], VP.el_2D[i][3]); };
+	const auto add = [](const vec4& a, const vec4& b) -> vec4 { return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); };
+	const auto sub = [](const vec4& a, const vec4& b) -> vec4 { return vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); };
+
+	vec4 r0 = row(0);
+	vec4 r1 = row(1);
+	vec4 r2 = row(2);
+	vec4 r3 = row(3);
+
+	planesOut[0] = add(r3, r0); // left
+	planesOut[1] = sub(r3, r0); // right
+	planesOut[2] = add(r3, r1); // bottom
+	planesOut[3] = sub(r3, r1); // top
+	planesOut[4] = r2;          // near (z >= 0)
+	planesOut[5] = sub(r3, r2); // far
+}
+
+AABB transformAABB(const AABB& aabb, const mat4& M)
+{
+	vec3 center((aabb.maxX + aabb.minX) * 0.5f, (aabb.maxY + aabb.minY) * 0.5f, (aabb.maxZ + aabb.minZ) * 0.5f);
+	vec3 extent((aabb.maxX - aabb.minX) * 0.5f, (aabb.maxY - aabb.minY) * 0.5f, (aabb.maxZ - aabb.minZ) * 0.5f);
+
+	vec3 c, e;
+	for (int i = 0; i < 3; i++)
+	{
+		c.xyz[i] = M.el_2D[i][0] * center.x + M.el_2D[i][1] * center.y + M.el_2D[i][2] * center.z + M.el_2D[i][3];
+		e.xyz[i] = std::abs(M.el_2D[i][0]) * extent.x + std::abs(M.el_2D[i][1]) * extent.y + std::abs(M.el_2D[i][2]) * extent.z;
+	}
+
+	return {c.x + e.x, c.x - e.x, c.y + e.y, c.y - e.y, c.z + e.z, c.z - e.z};
+}
+
+AABB mergeAABB(const AABB& l, const AABB& r)
+{
+	return {std::max(l.maxX, r.maxX), std::min(l.minX, r.minX),
+			std::max(l.maxY, r.maxY), std::min(l.minY, r.minY),
+			std::max(l.maxZ, r.maxZ), std::min(l.minZ, r.minZ)};
+}
+
+void calculateMeshBounds(AABB& aabbOut, BoundingSphere& sphereOut, const MeshDataDesc& desc)
+{
+	if (desc.numberOfVertex == 0 || !desc.pData)
+	{
+		aabbOut = {};
+		sphereOut = {};
+		return;
+	}
+
+	vector<float> halfPositions;
+
+	const auto position = [&](uint i) -> const float*
+	{
+		if (desc.positionFormat == VERTEX_FORMAT::HALF)
+			return &halfPositions[i * 3];
+		return reinterpret_cast<const float*>(desc.pData + desc.positionOffset + i * desc.positionStride);
+	};
+
+	if (desc.positionFormat == VERTEX_FORMAT::HALF)
+	{
+		halfPositions.resize(desc.numberOfVertex * 3);
+		for (uint i = 0; i < desc.numberOfVertex; i++)
+		{
+			const uint16_t *h = reinterpret_cast<const uint16_t*>(desc.pData + desc.positionOffset + i * desc.positionStride);
+			for (uint k = 0; k < 3; k++)
+				halfPositions[i * 3 + k] = halfToFloat(h[k]);
+		}
+	}
+
+	const float *p0 = position(0);
+	aabbOut = {p0[0], p0[0], p0[1], p0[1], p0[2], p0[2]};
+
+	for (uint i = 1; i < desc.numberOfVertex; i++)
+	{
+		const float *p = position(i);
+		aabbOut.maxX = std::max(aabbOut.maxX, p[0]); aabbOut.minX = std::min(aabbOut.minX, p[0]);
+		aabbOut.maxY = std::max(aabbOut.maxY, p[1]); aabbOut.minY = std::min(aabbOut.minY, p[1]);
+		aabbOut.maxZ = std::max(aabbOut.maxZ, p[2]); aabbOut.minZ = std::min(aabbOut.minZ, p[2]);
+	}
+
+	// Sphere centered in AABB center. Not minimal but good enough for culling
+	vec3 center((aabbOut.maxX + aabbOut.minX) * 0.5f, (aabbOut.maxY + aabbOut.minY) * 0.5f, (aabbOut.maxZ + aabbOut.minZ) * 0.5f);
+	float radiusSq = 0.0f;
+
+	for (uint i = 0; i < desc.numberOfVertex; i++)
+	{
+		const float *p = position(i);
+		vec3 d = vec3(p[0], p[1], p[2]) - center;
+		radiusSq = std::max(radiusSq, d.Dot(d));
+	}
+
+	sphereOut.center = center;
+	sphereOut.radius = sqrt(radiusSq);
+}
+
+uint vertexAttributeBytes(INPUT_ATTRUBUTE attribute, VERTEX_FORMAT format)
+{
+	switch (format)
+	{
+		case VERTEX_FORMAT::FLOAT: return attribute == INPUT_ATTRUBUTE::TEX_COORD ? 8 : 16;
+		case VERTEX_FORMAT::HALF: return (attribute == INPUT_ATTRUBUTE::POSITION || attribute == INPUT_ATTRUBUTE::COLOR) ? 8 : 0;
+		case VERTEX_FORMAT::OCTAHEDRAL:
+			if (attribute == INPUT_ATTRUBUTE::NORMAL) return 4;
+			if (attribute == INPUT_ATTRUBUTE::TANGENT) return 8;
+			return 0;
+		case VERTEX_FORMAT::UNORM16: return attribute == INPUT_ATTRUBUTE::TEX_COORD ? 4 : 0;
+	}
+	return 0;
+}
+
+uint meshVertexAttributes(OUT VertexAttributeDesc attributesOut[MAX_VERTEX_ATTRIBUTES], const MeshDataDesc& desc)
+{
+	uint num = 0;
+
+	const auto add = [&](bool presented, INPUT_ATTRUBUTE attribute, uint location, uint offset, uint stride, VERTEX_FORMAT format)
+	{
+		if (presented)
+			attributesOut[num++] = {attribute, location, offset, stride, format, vertexAttributeBytes(attribute, format)};
+	};
+
+	add(true, INPUT_ATTRUBUTE::POSITION, 0, desc.positionOffset, desc.positionStride, desc.positionFormat);
+	add(desc.normalsPresented, INPUT_ATTRUBUTE::NORMAL, 1, desc.normalOffset, desc.normalStride, desc.normalFormat);
+	add(desc.texCoordPresented, INPUT_ATTRUBUTE::TEX_COORD, 2, desc.texCoordOffset, desc.texCoordStride, desc.texCoordFormat);
+	add(desc.colorPresented, INPUT_ATTRUBUTE::COLOR, 3, desc.colorOffset, desc.colorStride, desc.colorFormat);
+	add(desc.tangentPresented, INPUT_ATTRUBUTE::TANGENT, 4, desc.tangentOffset, desc.tangentStride, desc.tangentFormat);
+
+	return num;
+}
+
+INPUT_ATTRUBUTE meshAttributes(const MeshDataDesc& desc)
+{
+	INPUT_ATTRUBUTE attribs = INPUT_ATTRUBUTE::POSITION;
+	if (desc.normalsPresented)
+	{
+		attribs = attribs | INPUT_ATTRUBUTE::NORMAL;
+		if (desc.normalFormat == VERTEX_FORMAT::OCTAHEDRAL)
+			attribs = attribs | INPUT_ATTRUBUTE::NORMAL_OCTAHEDRAL;
+	}
+	if (desc.texCoordPresented)
+		attribs = attribs | INPUT_ATTRUBUTE::TEX_COORD;
+	if (desc.colorPresented)
+		attribs = attribs | INPUT_ATTRUBUTE::COLOR;
+	if (desc.tangentPresented)
+	{
+		attribs = attribs | INPUT_ATTRUBUTE::TANGENT;
+		if (desc.tangentFormat == VERTEX_FORMAT::OCTAHEDRAL)
+			attribs = attribs | INPUT_ATTRUBUTE::TANGENT_OCTAHEDRAL;
+	}
+	return attribs;
+}
+
+size_t meshDataBytes(const MeshDataDesc& desc)
+{
+	if (desc.numberOfVertex == 0)
+		return 0;
+
+	VertexAttributeDesc attributes[MAX_VERTEX_ATTRIBUTES];
+	const uint num = meshVertexAttributes(attributes, desc);
+
+	size_t bytes = 0;
+	for (uint i = 0; i < num; i++)
+	{
+		const VertexAttributeDesc& a = attributes[i];
+		const uint stride = a.stride ? a.stride : a.bytes; // 0 - tightly packed
+		bytes = std::max(bytes, a.offset + size_t(desc.numberOfVertex - 1) * stride + a.bytes);
+	}
+	return bytes;
+}
+
+const char* meshDataDescError(const MeshDataDesc& desc)
+{
+	VertexAttributeDesc attributes[MAX_VERTEX_ATTRIBUTES];
+	const uint num = meshVertexAttributes(attributes, desc);
+
+	for (uint i = 0; i < num; i++)
+	{
+		const VertexAttributeDesc& a = attributes[i];
+
+		if (a.bytes == 0)
+			return "vertex format is not supported for attribute";
+
+		if (a.offset % 4 || a.stride % 4)
+			return "offset or stride is not multiple of 4";
+
+		if (a.stride && a.stride < a.bytes)
+			return "stride is less than size of attribute";
+	}
+
+	return nullptr;
+}
+
+uint16_t floatToHalf(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(float));
+
+	const uint32_t sign = (x >> 16) & 0x8000u;
+	const uint32_t absBits = x & 0x7FFFFFFFu;
+
+	// Rebias exponent 127 -> 15 and round mantissa 23 -> 10 bits
+	uint32_t h = (absBits - (112u << 23) + (1u << 12)) >> 13;
+
+	if (absBits < (113u << 23)) // less than 2^-14
+		h = 0u;
+	if (absBits >= (143u << 23)) // 2^16 and more, infinity
+		h = 0x7C00u;
+	if (absBits > (255u << 23)) // NaN
+		h = 0x7E00u;
+
+	return uint16_t(sign | h);
+}
+
+float halfToFloat(uint16_t h)
+{
+	const uint32_t sign = uint32_t(h & 0x8000u) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1Fu;
+	const uint32_t mantissa = h & 0x3FFu;
+
+	if (exponent == 0u) // zero or denormal
+	{
+		const float f = mantissa * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+
+	const uint32_t x = exponent == 31u ? (sign | 0x7F800000u | (mantissa << 13)) : (sign | ((exponent + 112u) << 23) | (mantissa << 13));
+
+	float f;
+	memcpy(&f, &x, sizeof(float));
+	return f;
+}
+
+void encodeOctahedral(OUT int16_t xy[2], float x, float y, float z)
+{
+	const float l1 = fabs(x) + fabs(y) + fabs(z);
+	float u = l1 > 0.0f ? x / l1 : 0.0f;
+	float v = l1 > 0.0f ? y / l1 : 0.0f;
+
+	// Lower hemisphere is folded over diagonals
+	if (z < 0.0f)
+	{
+		const float fu = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		const float fv = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+
+	xy[0] = int16_t(roundf(std::max(-1.0f, std::min(u, 1.0f)) * 32767.0f));
+	xy[1] = int16_t(roundf(std::max(-1.0f, std::min(v, 1.0f)) * 32767.0f));
+}
+
 int initialized = 0;
 int seed = 0;
 std::set<uint> instances_id;
@@ -284,6 +535,20 @@ string msaa_to_string(int samples)
 	return std::to_string(samples) + "x";
 }
 
+const char* pipelineStateDescError(const PipelineStateDesc& desc)
+{
+	if (!desc.shader)
+		return "shader is null";
+
+	if (desc.attributes != INPUT_ATTRUBUTE::CUSTOM && (desc.attributes & INPUT_ATTRUBUTE::POSITION) == INPUT_ATTRUBUTE::CUSTOM)
+		return "vertex layout without position";
+
+	if ((desc.srcBlend == BLEND_FACTOR::NONE) != (desc.destBlend == BLEND_FACTOR::NONE))
+		return "only one of blend factors is NONE";
+
+	return nullptr;
+}
+
 bool isColorFormat(TEXTURE_FORMAT format)
 {
 	if (format == TEXTURE_FORMAT::D24S8)
@@ -304,9 +569,9 @@ size_t bytesPerPixel(TEXTURE_FORMAT format)
 		case TEXTURE_FORMAT::R8:		return 1;
 		case TEXTURE_FORMAT::RG8:		return 2;
 		case TEXTURE_FORMAT::RGBA8:		return 4;
-		case TEXTURE_FORMAT::R16F:		return 1;
-		case TEXTURE_FORMAT::RG16F:		return 2;
-		case TEXTURE_FORMAT::RGBA16F:	return 4;
+		case TEXTURE_FORMAT::R16F:		return 2;
+		case TEXTURE_FORMAT::RG16F:		return 4;
+		case TEXTURE_FORMAT::RGBA16F:	return 8;
 		case TEXTURE_FORMAT::R32F:		return 4;
 		case TEXTURE_FORMAT::RG32F:		return 8;
 		case TEXTURE_FORMAT::RGBA32F:	return 16;
@@ -317,6 +582,28 @@ size_t bytesPerPixel(TEXTURE_FORMAT format)
 	return 1;
 }
 
+const char *formatName(TEXTURE_FORMAT format)
+{
+	switch (format)
+	{
+		case TEXTURE_FORMAT::R8:		return "R8";
+		case TEXTURE_FORMAT::RG8:		return "RG8";
+		case TEXTURE_FORMAT::RGBA8:		return "RGBA8";
+		case TEXTURE_FORMAT::R16F:		return "R16F";
+		case TEXTURE_FORMAT::RG16F:		return "RG16F";
+		case TEXTURE_FORMAT::RGBA16F:	return "RGBA16F";
+		case TEXTURE_FORMAT::R32F:		return "R32F";
+		case TEXTURE_FORMAT::RG32F:		return "RG32F";
+		case TEXTURE_FORMAT::RGBA32F:	return "RGBA32F";
+		case TEXTURE_FORMAT::R32UI:		return "R32UI";
+		case TEXTURE_FORMAT::DXT1:		return "DXT1";
+		case TEXTURE_FORMAT::DXT3:		return "DXT3";
+		case TEXTURE_FORMAT::DXT5:		return "DXT5";
+		case TEXTURE_FORMAT::D24S8:		return "D24S8";
+	}
+	return "UNKNOWN";
+}
+
 size_t blockSize(TEXTURE_FORMAT compressedFormat)
 {
 	assert(compressedFormat == TEXTURE_FORMAT::DXT1 || compressedFormat == TEXTURE_FORMAT::DXT3 || compressedFormat == TEXTURE_FORMAT::DXT5);
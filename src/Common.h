@@ -12,6 +12,7 @@ using std::vector;
 using std::string;
 
 #define SHADER_DIR "src\\shaders"
+#define SHADER_CACHE_DIR "shader_cache"
 #define MAX_TEXTURE_SLOTS 16
 #define MAX_RENDER_TARGETS 8
 
@@ -76,6 +77,7 @@ public:
 typedef EventTemplate<ILogEvent, ILogEventSubscriber, const char *, LOG_TYPE> LogEvent;
 typedef EventTemplate<IPositionEvent, IPositionEventSubscriber, OUT vec3*> PositionEvent;
 typedef EventTemplate<IRotationEvent, IRotationEventSubscriber, OUT quat*> RotationEvent;
+typedef EventTemplate<IScaleEvent, IScaleEventSubscriber, OUT vec3*> ScaleEvent;
 typedef EventTemplate<IStringEvent, IStringEventSubscriber, const char *> StringEvent;
 typedef EventTemplate<IGameObjectEvent, IGameObjectEventSubscriber, OUT IGameObject*> GameObjectEvent;
 
@@ -236,6 +238,30 @@ vector<string> split(const string &s, char delim);
 void look_at(Matrix4x4& Result, const Vector3 &eye, const Vector3 &center);
 
 
+// hash (FNV-1a)
+
+constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+inline uint64_t hashBytes(uint64_t h, const void *data, size_t size)
+{
+	const uint8 *p = static_cast<const uint8*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+inline uint64_t hashString(uint64_t h, const char *str)
+{
+	// Null terminator separates strings: ("ab", "c") != ("a", "bc")
+	if (str == nullptr)
+		return hashBytes(h, "", 1);
+	return hashBytes(h, str, strlen(str) + 1);
+}
+
+
 // math
 
 inline bool Approximately(float l, float r)
@@ -264,6 +290,54 @@ inline vec3 GetBackDirection(const mat4& ModelMat) { return -vec3(ModelMat.Colum
 //
 mat4 perspectiveRH_ZO(float fov, float aspect, float zNear, float zFar);
 
+//
+// Extracts six clip planes (left, right, bottom, top, near, far) from view-projection matrix
+// Plane is vec4(n, d): dot(n, p) + d >= 0 for points inside frustum
+// Depth is in range [0, 1] (see perspectiveRH_ZO)
+//
+void extractFrustumPlanes(vec4 planesOut[6], const mat4& ViewProj);
+
+//
+// Transforms AABB by matrix
+// Result encloses all 8 transformed corners
+//
+AABB transformAABB(const AABB& aabb, const mat4& M);
+
+// Returns AABB enclosing both boxes
+AABB mergeAABB(const AABB& l, const AABB& r);
+
+//
+// Calculates local AABB and bounding sphere of vertex positions
+// Position is first 3 components at positionOffset
+//
+void calculateMeshBounds(AABB& aabbOut, BoundingSphere& sphereOut, const MeshDataDesc& desc);
+
+//
+// Vertex formats (see MeshDataDesc)
+//
+constexpr uint MAX_VERTEX_ATTRIBUTES = 5;
+
+struct VertexAttributeDesc
+{
+	INPUT_ATTRUBUTE attribute; // POSITION, NORMAL, TEX_COORD, COLOR or TANGENT
+	uint location; // OpenGL layout location, DirectX semantic index (POSITION0, TEXCOORD1, ...)
+	uint offset;
+	uint stride;
+	VERTEX_FORMAT format;
+	uint bytes;
+};
+
+// Fills present attributes in order of location. Returns number of attributes
+uint meshVertexAttributes(OUT VertexAttributeDesc attributesOut[MAX_VERTEX_ATTRIBUTES], const MeshDataDesc& desc);
+INPUT_ATTRUBUTE meshAttributes(const MeshDataDesc& desc); // including encoding flags
+size_t meshDataBytes(const MeshDataDesc& desc); // bytes of pData read by all attributes
+uint vertexAttributeBytes(INPUT_ATTRUBUTE attribute, VERTEX_FORMAT format); // 0 if attribute can't be stored in format
+const char* meshDataDescError(const MeshDataDesc& desc); // nullptr if desc is valid
+
+uint16_t floatToHalf(float f); // round to nearest, values less than 2^-14 are flushed to zero
+float halfToFloat(uint16_t h);
+void encodeOctahedral(OUT int16_t xy[2], float x, float y, float z); // (x, y, z) - unit vector
+
 
 // random
 
@@ -295,6 +369,7 @@ inline ICoreRender *getCoreRender(ICore *core)
 // core render
 int get_msaa_samples(INIT_FLAGS flags);
 string msaa_to_string(int samples);
+const char* pipelineStateDescError(const PipelineStateDesc& desc); // nullptr if desc is valid
 
 // texture formats
 bool isColorFormat(TEXTURE_FORMAT format);
@@ -454,6 +529,179 @@ public: \
 		return S_OK;  \
 	}
 
+//
+// Uniform block registered by ICoreRender::RegisterUniformBlock()
+//
+struct UniformBlockLayout
+{
+	struct Field
+	{
+		string name;
+		size_t offset;
+		size_t bytes;
+	};
+
+	string name;
+	vector<Field> fields;
+	size_t bytes = 0u;
+	int poolIndex = -1; // UBOpool or ConstantBufferPool entry validated against layout
+
+	UniformBlockLayout() = default;
+	UniformBlockLayout(const UniformBlockDesc& desc) : name(desc.name), bytes(desc.bytes)
+	{
+		for (uint i = 0; i < desc.fieldsNum; i++)
+			fields.push_back({desc.fields[i].name, desc.fields[i].offset, desc.fields[i].bytes});
+	}
+
+	// Every reflected parameter must be described. Described fields not used by shader may be absent
+	template<typename Parameter>
+	bool matches(const vector<Parameter>& reflected, size_t reflectedBytes) const
+	{
+		if (reflectedBytes != bytes)
+			return false;
+
+		for (const Parameter& p : reflected)
+		{
+			auto it = std::find_if(fields.begin(), fields.end(), [&p](const Field& f) { return f.name == p.name; });
+			if (it == fields.end() || it->offset != p.offset || it->bytes != p.bytes)
+				return false;
+		}
+
+		return true;
+	}
+};
+
+//
+// Index of uniform buffers pool (UBOpool, ConstantBufferPool) by memory layout
+//
+// Shaders with the same block layout share one buffer.
+// Key is hash of block name, size and parameters (name, offset, size, elements) in pool order.
+// Different layouts may have the same key, so candidates are still compared fully
+//
+template<typename Buffer>
+class UniformBufferIndex
+{
+	using Parameter = typename Buffer::Parameter;
+
+	std::unordered_multimap<uint64_t, int> _buffers;
+	vector<uint> _users; // pool index -> number of shader blocks using buffer
+
+	static bool equal(const Buffer& b, const string& name, size_t bytes, const vector<Parameter>& parameters)
+	{
+		if (b.name != name || b.bytes != bytes || b.parameters.size() != parameters.size())
+			return false;
+
+		for (size_t k = 0; k < parameters.size(); k++)
+		{
+			if (b.parameters[k].name != parameters[k].name ||
+				b.parameters[k].bytes != parameters[k].bytes ||
+				b.parameters[k].offset != parameters[k].offset ||
+				b.parameters[k].elements != parameters[k].elements)
+				return false;
+		}
+
+		return true;
+	}
+
+public:
+	static uint64_t key(const string& name, size_t bytes, const vector<Parameter>& parameters)
+	{
+		uint64_t h = HASH_SEED;
+		h = hashString(h, name.c_str());
+		h = hashBytes(h, &bytes, sizeof(bytes));
+		for (const Parameter& p : parameters)
+		{
+			h = hashString(h, p.name.c_str());
+			h = hashBytes(h, &p.offset, sizeof(p.offset));
+			h = hashBytes(h, &p.bytes, sizeof(p.bytes));
+			h = hashBytes(h, &p.elements, sizeof(p.elements));
+		}
+		return h;
+	}
+
+	// Returns index of buffer in pool or -1
+	int find(const vector<Buffer>& pool, uint64_t key, const string& name, size_t bytes, const vector<Parameter>& parameters)
+	{
+		auto range = _buffers.equal_range(key);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (equal(pool[it->second], name, bytes, parameters))
+			{
+				_users[it->second]++;
+				return it->second;
+			}
+		}
+		return -1;
+	}
+
+	// Buffer is appended to pool
+	void add(uint64_t key, int index)
+	{
+		assert(index == (int)_users.size());
+		_buffers.emplace(key, index);
+		_users.push_back(1u);
+	}
+
+	// Shader block uses buffer without lookup (layout is known)
+	void addUser(int index) { _users[index]++; }
+
+	// Shader block is destroyed. Buffer without users stays in pool for next shaders
+	void removeUser(size_t index)
+	{
+		if (index < _users.size() && _users[index] > 0)
+			_users[index]--;
+	}
+
+	void clear()
+	{
+		_buffers.clear();
+		_users.clear();
+	}
+
+	// Buffers used by several shader blocks
+	uint shared() const { return (uint)std::count_if(_users.begin(), _users.end(), [](uint u) { return u > 1; }); }
+	// Buffers used by one shader block
+	uint unique() const { return (uint)std::count(_users.begin(), _users.end(), 1u); }
+	// Shader blocks that didn't create own buffer
+	uint reused() const
+	{
+		uint ret = 0;
+		for (uint u : _users)
+			if (u > 1)
+				ret += u - 1;
+		return ret;
+	}
+};
+
+//
+// Counters of state changes passed to graphics API and dropped by ICoreRender backend as redundant.
+// Values of last finished frame are shown in profiler
+//
+class StateFilterStats
+{
+	uint _issued = 0u;
+	uint _filtered = 0u;
+	uint _issuedLastFrame = 0u;
+	uint _filteredLastFrame = 0u;
+
+public:
+	void issued() { _issued++; }
+	void filtered() { _filtered++; }
+
+	void nextFrame()
+	{
+		_issuedLastFrame = _issued;
+		_filteredLastFrame = _filtered;
+		_issued = 0u;
+		_filtered = 0u;
+	}
+
+	string toString() const
+	{
+		return "State calls: " + std::to_string(_issuedLastFrame) + " issued, " + std::to_string(_filteredLastFrame) + " filtered";
+	}
+};
+
 //
 enum class SHADER_TYPE
 {
@@ -493,4 +741,5 @@ inline ICoreRenderTarget *getCoreRenderTarget(IRenderTarget *rt)
 size_t bytesPerPixel(TEXTURE_FORMAT format);
 size_t calculateImageSize(TEXTURE_FORMAT format, uint width, uint height);
 size_t blockSize(TEXTURE_FORMAT compressedFormat);
+const char *formatName(TEXTURE_FORMAT format);
 
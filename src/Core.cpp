@@ -10,6 +10,7 @@
 #include "Render.h"
 #include "SceneManager.h"
 #include "Input.h"
+#include "ThreadPool.h"
 
 using std::wstring;
 
@@ -71,6 +72,9 @@ API Core::Init(INIT_FLAGS flags, const mchar *pDataPath, const WindowHandle* ext
 
 	_pfSystem->Init(string(_pDataDir));
 
+	_pThreadPool = std::make_unique<ThreadPool>();
+	LogFormatted("Worker threads:       %u", LOG_TYPE::NORMAL, _pThreadPool->threads());
+
 	_pInput = std::make_unique<Input>();
 
 	if ((flags & INIT_FLAGS::GRAPHIC_LIBRARY_FLAG) == INIT_FLAGS::DIRECTX11)
@@ -361,6 +365,9 @@ API Core::ReleaseEngine()
 	_pResMan->Free();
 	_pCoreRender->Free();
 
+	// Subsystems waited for their jobs in Free()
+	_pThreadPool.reset();
+
 	_pSceneManager.reset();
 	_pRender.reset();
 	_pResMan.reset();
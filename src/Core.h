@@ -7,6 +7,7 @@ class ResourceManager;
 class Console;
 class Render;
 class SceneManager;
+class ThreadPool;
 
 DEFINE_GUID(CLSID_Core,
 	0xa889f560, 0x58e4, 0x11d0, 0xa6, 0x8a, 0x0, 0x0, 0x83, 0x7e, 0x31, 0x0);
@@ -26,6 +27,7 @@ class Core : public ICore
 	unique_ptr<Render> _pRender;
 	unique_ptr<SceneManager>_pSceneManager;
 	unique_ptr<IInput> _pInput;
+	unique_ptr<ThreadPool> _pThreadPool;
 
 	CRITICAL_SECTION _cs{};
 
@@ -62,6 +64,7 @@ public:
 
 	MainWindow* mainWindow() { return _pMainWindow.get(); }
 	Console *consoleWindow() { return _pConsoleWindow.get(); }
+	ThreadPool *threadPool() { return _pThreadPool.get(); }
 
 	template <typename... Arguments>
 	void LogFormatted(const char *pStr, LOG_TYPE type, Arguments ...args)
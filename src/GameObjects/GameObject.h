@@ -11,9 +11,23 @@ protected:
 	vec3 _pos;
 	quat _rot;
 	vec3 _scale{1.0f, 1.0f, 1.0f};
+
+	// Cached world space AABB. Recalculated only after transform changed
+	AABB _worldAABB{};
+	bool _worldAABBDirty{true};
+
+	// Cached matrices. Recalculated only after transform changed
+	mat4 _modelMat;
+	mat4 _invModelMat;
+	mat4 _normalMat;
+	bool _matricesDirty{true};
+
+	void invalidateTransform() { _worldAABBDirty = true; _matricesDirty = true; }
+	void updateMatrices();
 	
 	std::unique_ptr<PositionEvent> _positionEvent{new PositionEvent};
 	std::unique_ptr<RotationEvent> _rotationEvent{new RotationEvent};
+	std::unique_ptr<ScaleEvent> _scaleEvent{new ScaleEvent};
 	std::unique_ptr<StringEvent> _nameEvent{new StringEvent};
 
 public:
@@ -27,11 +41,12 @@ public:
 	API SetName(const char *pName) override;
 	API SetPosition(const vec3 *pos) override;
 	API SetRotation(const quat *rot) override;
-	API SetScale(const vec3 *scale) override		{ _scale = *scale; return S_OK; }
+	API SetScale(const vec3 *scale) override;
 	API GetPosition(OUT vec3 *pos) override			{ *pos = _pos; return S_OK; }
 	API GetRotation(OUT quat *rot) override			{ *rot = _rot; return S_OK; }
 	API GetScale(OUT vec3 *scale) override			{ *scale = _scale; return S_OK; }
 	API GetAABB(OUT AABB *aabb) override;
+	API GetWorldAABB(OUT AABB *aabb) override;
 	API Copy(IGameObject *copy) override;
 
 	//
@@ -54,9 +69,18 @@ public:
 	//
 	API GetInvModelMatrix(OUT mat4 *mat) override;
 
+	//
+	// Normal Matrix
+	//
+	// Transforms local -> world normals
+	// Transpose of inverse model matrix
+	//
+	API GetNormalMatrix(OUT mat4 *mat) override;
+
 	API GetNameEv(OUT IStringEvent **pEvent) override			{ *pEvent = _nameEvent.get(); return S_OK; }
 	API GetPositionEv(OUT IPositionEvent **pEvent) override		{ *pEvent = _positionEvent.get(); return S_OK; }
 	API GetRotationEv(OUT IRotationEvent **pEvent) override		{ *pEvent = _rotationEvent.get(); return S_OK; }
+	API GetScaleEv(OUT IScaleEvent **pEvent) override			{ *pEvent = _scaleEvent.get(); return S_OK; }
 };
 
 class GameObject : public GameObjectBase<IGameObject>
@@ -87,6 +111,7 @@ inline API GameObjectBase<T>::SetPosition(const vec3 * pos)
 	if (!_pos.Aproximately(*pos))
 	{
 		_pos = *pos;
+		invalidateTransform();
 		_positionEvent->Fire(&_pos);
 	}
 	return S_OK;
@@ -98,19 +123,50 @@ inline API GameObjectBase<T>::SetRotation(const quat *rot)
     if (!_rot.IsSameRotation(*rot))
 	{
 		_rot = *rot;
+		invalidateTransform();
 		_rotationEvent->Fire(&_rot);
 	}
 	return S_OK;
 }
 
+template<typename T>
+inline API GameObjectBase<T>::SetScale(const vec3 *scale)
+{
+	if (!_scale.Aproximately(*scale))
+	{
+		_scale = *scale;
+		invalidateTransform();
+		_scaleEvent->Fire(&_scale);
+	}
+	return S_OK;
+}
+
 template <typename T>
 inline API GameObjectBase<T>::GetAABB(OUT AABB* aabb)
 {
-	const static AABB _unitAABB = {-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f};
+	const static AABB _unitAABB = {1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f};
 	*aabb = _unitAABB;
 	return S_OK;
 }
 
+template <typename T>
+inline API GameObjectBase<T>::GetWorldAABB(OUT AABB* aabb)
+{
+	if (_worldAABBDirty)
+	{
+		AABB localAABB;
+		GetAABB(&localAABB);
+
+		mat4 M;
+		GetModelMatrix(&M);
+
+		_worldAABB = transformAABB(localAABB, M);
+		_worldAABBDirty = false;
+	}
+	*aabb = _worldAABB;
+	return S_OK;
+}
+
 template<typename T>
 inline API GameObjectBase<T>::Copy(IGameObject *copy)
 {
@@ -122,7 +178,7 @@ inline API GameObjectBase<T>::Copy(IGameObject *copy)
 }
 
 template<typename T>
-inline API GameObjectBase<T>::GetModelMatrix(OUT mat4 *mat)
+inline void GameObjectBase<T>::updateMatrices()
 {
 	mat4 R;
 	mat4 T;
@@ -138,7 +194,21 @@ inline API GameObjectBase<T>::GetModelMatrix(OUT mat4 *mat)
 	S.el_2D[1][1] = _scale.y;
 	S.el_2D[2][2] = _scale.z;
 
-	*mat = T * R * S;
+	_modelMat = T * R * S;
+	_invModelMat = _modelMat.Inverse();
+	_normalMat = _invModelMat;
+	_normalMat.Transpose();
+
+	_matricesDirty = false;
+}
+
+template<typename T>
+inline API GameObjectBase<T>::GetModelMatrix(OUT mat4 *mat)
+{
+	if (_matricesDirty)
+		updateMatrices();
+
+	*mat = _modelMat;
 
 	return S_OK;
 }
@@ -146,11 +216,21 @@ inline API GameObjectBase<T>::GetModelMatrix(OUT mat4 *mat)
 template<typename T>
 inline API GameObjectBase<T>::GetInvModelMatrix(OUT mat4 *mat)
 {
-	mat4 M;
+	if (_matricesDirty)
+		updateMatrices();
 
-	GetModelMatrix(&M);
+	*mat = _invModelMat;
+
+	return S_OK;
+}
+
+template<typename T>
+inline API GameObjectBase<T>::GetNormalMatrix(OUT mat4 *mat)
+{
+	if (_matricesDirty)
+		updateMatrices();
 
-	*mat = M.Inverse();
+	*mat = _normalMat;
 
 	return S_OK;
 }
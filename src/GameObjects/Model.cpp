@@ -12,6 +12,14 @@ Model::Model(const vector<IMesh*>& meshes)
 {
 	for (IMesh *m : meshes)
 		_meshes.push_back(MeshPtr(m));
+
+	// Model bounds = union of all mesh bounds
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		AABB meshAABB;
+		meshes[i]->GetAABB(&meshAABB);
+		_aabb = i == 0 ? meshAABB : mergeAABB(_aabb, meshAABB);
+	}
 	//_pCore->AddUpdateCallback(std::bind(&Model::_update, this));
 }
 
@@ -30,8 +38,7 @@ API Model::GetNumberOfMesh(OUT uint *number)
 
 API Model::GetAABB(OUT AABB *aabb)
 {
-	const static AABB _unitAABB = {-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f};
-	*aabb = _unitAABB;
+	*aabb = _aabb;
 	return S_OK;
 }
 
@@ -42,6 +49,7 @@ API Model::Copy(OUT IModel *copy)
 	Model *copyModel = static_cast<Model*>(copy);
 	copyModel->_meshes = _meshes;
 	copyModel->_aabb = _aabb;
+	copyModel->_worldAABBDirty = true;
 
 	return S_OK;
 }
@@ -7,7 +7,7 @@
 class Model : public GameObjectBase<IModel>
 {
 	vector<MeshPtr> _meshes;
-	AABB _aabb;
+	AABB _aabb{};
 
 	//friend YAML::Emitter& operator<<(YAML::Emitter& out, IResource* g);
 	//friend void loadResource(YAML::Node& n, IGameObject *go);
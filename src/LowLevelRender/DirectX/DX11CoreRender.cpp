@@ -17,6 +17,67 @@ const static float MAX_DEPTH = 1.0f;
 static D3D11_VIEWPORT dxViewport;
 
 vector<ConstantBuffer> ConstantBufferPool;
+UniformBufferIndex<ConstantBuffer> ConstantBufferPoolIndex;
+
+bool ConstantBufferRing::init(ID3D11Device *device, ID3D11DeviceContext *context, size_t bytes)
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options{};
+	if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+		return false;
+
+	if (!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+		return false;
+
+	if (FAILED(context->QueryInterface(IID_PPV_ARGS(_context.GetAddressOf()))))
+		return false;
+
+	D3D11_BUFFER_DESC desc{};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = (UINT)bytes;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	if (FAILED(device->CreateBuffer(&desc, nullptr, _buffer.GetAddressOf())))
+	{
+		free();
+		return false;
+	}
+
+	_bytes = bytes;
+	_offset = bytes; // first upload maps with DISCARD
+
+	return true;
+}
+
+void ConstantBufferRing::free()
+{
+	_buffer = nullptr;
+	_context = nullptr;
+	_bytes = _offset = 0u;
+}
+
+void ConstantBufferRing::upload(const void *data, size_t bytes, OUT UINT& firstConstant, OUT UINT& numConstants)
+{
+	// Offset and size are in constants (16 bytes) and must be multiple of 16 constants
+	const size_t aligned = (bytes + 255) & ~size_t(255);
+
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (_offset + aligned > _bytes)
+	{
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		_offset = 0u;
+		_generation++;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped{};
+	_context->Map(_buffer.Get(), 0, mapType, 0, &mapped);
+	memcpy(static_cast<uint8*>(mapped.pData) + _offset, data, bytes);
+	_context->Unmap(_buffer.Get(), 0);
+
+	firstConstant = (UINT)(_offset / 16);
+	numConstants = (UINT)(aligned / 16);
+	_offset += aligned;
+}
 
 // By default in DirectX (and OpenGL) CPU-GPU transfer implemented in column-major style.
 // We change this behaviour only here globally for all shaders by flag "D3DCOMPILE_PACK_MATRIX_ROW_MAJOR"
@@ -58,6 +119,67 @@ DX11RenderTarget *getDX11RenderTarget(IRenderTarget *rt)
 }
 
 
+D3D11_BLEND_DESC eng_to_d3d11_blend_desc(BLEND_FACTOR src, BLEND_FACTOR dest)
+{
+	D3D11_BLEND_DESC blend_desc{};
+	blend_desc.AlphaToCoverageEnable = FALSE;
+	blend_desc.IndependentBlendEnable = 0;
+	blend_desc.RenderTarget[0].BlendEnable = src != BLEND_FACTOR::NONE && dest != BLEND_FACTOR::NONE;
+	// BLEND_FACTOR values match D3D11_BLEND except NONE (invalid for D3D even if blending is disabled)
+	blend_desc.RenderTarget[0].SrcBlend = blend_desc.RenderTarget[0].BlendEnable ? static_cast<D3D11_BLEND>(src) : D3D11_BLEND_ONE;
+	blend_desc.RenderTarget[0].DestBlend = blend_desc.RenderTarget[0].BlendEnable ? static_cast<D3D11_BLEND>(dest) : D3D11_BLEND_ZERO;
+	blend_desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blend_desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+	blend_desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+	blend_desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blend_desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	return blend_desc;
+}
+
+D3D11_RASTERIZER_DESC eng_to_d3d11_raster_desc(CULL_MODE cull, FILL_MODE fill)
+{
+	D3D11_RASTERIZER_DESC rasterDesc{};
+	rasterDesc.AntialiasedLineEnable = false;
+	rasterDesc.CullMode = cull == CULL_MODE::FRONT ? D3D11_CULL_FRONT : (cull == CULL_MODE::BACK ? D3D11_CULL_BACK : D3D11_CULL_NONE);
+	rasterDesc.DepthBias = 0;
+	rasterDesc.DepthBiasClamp = 0.0f;
+	rasterDesc.DepthClipEnable = true;
+	rasterDesc.FillMode = fill == FILL_MODE::WIREFRAME ? D3D11_FILL_WIREFRAME : D3D11_FILL_SOLID;
+	rasterDesc.FrontCounterClockwise = false;
+	rasterDesc.MultisampleEnable = false;
+	rasterDesc.ScissorEnable = false;
+	rasterDesc.SlopeScaledDepthBias = 0.0f;
+	return rasterDesc;
+}
+
+D3D11_DEPTH_STENCIL_DESC eng_to_d3d11_depth_stencil_desc(bool depthTest, bool depthWrite)
+{
+	D3D11_DEPTH_STENCIL_DESC dsDesc{};
+	dsDesc.DepthEnable = depthTest;
+	dsDesc.DepthWriteMask = depthWrite ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
+	dsDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	dsDesc.StencilEnable = false;
+	dsDesc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+	dsDesc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+	dsDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	dsDesc.BackFace = dsDesc.FrontFace;
+	return dsDesc;
+}
+
+DXGI_FORMAT eng_to_d3d11_vertex_format(const VertexAttributeDesc& a)
+{
+	switch (a.format)
+	{
+		case VERTEX_FORMAT::HALF:		return DXGI_FORMAT_R16G16B16A16_FLOAT;
+		case VERTEX_FORMAT::OCTAHEDRAL:	return a.attribute == INPUT_ATTRUBUTE::TANGENT ? DXGI_FORMAT_R16G16B16A16_SNORM : DXGI_FORMAT_R16G16_SNORM;
+		case VERTEX_FORMAT::UNORM16:	return DXGI_FORMAT_R16G16_UNORM;
+		default:						return a.attribute == INPUT_ATTRUBUTE::TEX_COORD ? DXGI_FORMAT_R32G32_FLOAT : DXGI_FORMAT_R32G32B32A32_FLOAT;
+	}
+}
+
 DX11CoreRender::DX11CoreRender(){}
 DX11CoreRender::~DX11CoreRender(){}
 
@@ -226,14 +348,42 @@ API DX11CoreRender::Init(const WindowHandle* handle, int MSAASamples, int VSyncO
 	_context->OMSetBlendState(_state.blendState.Get(), nullptr, 0xffffffff);
 	_state.blendState->GetDesc(&_state.blendStateDesc);
 
+	if (!_constantBufferRing.init(_device.Get(), _context.Get(), CONSTANT_BUFFER_RING_BYTES))
+		LOG_WARNING("DX11CoreRender::Init(): constant buffer offsetting is not supported. Constant buffers will be updated with WRITE_DISCARD");
+
+	_pCore->AddProfilerCallback(this);
+
 	LOG("DX11CoreRender initalized");
 
 	return S_OK;
 }
 
+uint DX11CoreRender::getNumLines()
+{
+	return 3;
+}
+
+string DX11CoreRender::getString(uint i)
+{
+	switch (i)
+	{
+		case 0: return "==== DX11CoreRender ====";
+		case 1: return "Constant buffers: " + std::to_string(ConstantBufferPool.size()) + " (shared: " + std::to_string(ConstantBufferPoolIndex.shared()) + ", unique: " + std::to_string(ConstantBufferPoolIndex.unique()) + ", blocks reused: " + std::to_string(ConstantBufferPoolIndex.reused()) + ")";
+		case 2: return _stateStats.toString();
+	}
+	assert(false);
+	return "";
+}
+
 API DX11CoreRender::Free()
 {
+	_pCore->RemoveProfilerCallback(this);
+
 	ConstantBufferPool.clear();
+	ConstantBufferPoolIndex.clear();
+	_constantBufferRing.free();
+	_uniformBlocks.clear();
+	forgetStructuredBuffers(0, MAX_TEXTURE_SLOTS);
 
 	for (auto &callback : _onCleanBroadcast)
 		callback();
@@ -267,59 +417,79 @@ API DX11CoreRender::MakeCurrent(const WindowHandle* handle)
 API DX11CoreRender::SwapBuffers()
 {
 	_swapChain->Present(_VSyncOn, 0);
+	_stateStats.nextFrame();
 	return S_OK;
 }
 
+void DX11CoreRender::bindConstantBuffer(SHADER_TYPE type, UINT slot, UINT firstConstant, UINT numConstants)
+{
+	ConstantBufferBinding &b = _constantBufferBindings[(int)type][slot];
+	if (b.firstConstant == firstConstant && b.numConstants == numConstants)
+	{
+		_stateStats.filtered();
+		return;
+	}
+
+	b = {firstConstant, numConstants};
+	_stateStats.issued();
+
+	ID3D11DeviceContext1 *ctx = _constantBufferRing.context();
+	ID3D11Buffer *buffer = _constantBufferRing.buffer();
+
+	switch (type)
+	{
+		case SHADER_TYPE::SHADER_VERTEX: ctx->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+		case SHADER_TYPE::SHADER_GEOMETRY: ctx->GSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+		case SHADER_TYPE::SHADER_FRAGMENT: ctx->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	}
+}
+
 API DX11CoreRender::CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc, const MeshIndexDesc *indexDesc, VERTEX_TOPOLOGY mode)
 {
-	assert(dataDesc->colorOffset % 8 == 0 && "");
-	assert(dataDesc->colorStride % 8 == 0 && "");
-	assert(dataDesc->positionStride % 8 == 0 && "");
-	assert(dataDesc->positionOffset % 8 == 0 && "");
-	assert(dataDesc->normalOffset % 8 == 0 && "");
-	assert(dataDesc->normalStride % 8 == 0 && "");
+	if (const char *error = meshDataDescError(*dataDesc))
+	{
+		LOG_WARNING_FORMATTED("DX11CoreRender::CreateMesh(): %s", error);
+		*pMesh = nullptr;
+		return E_INVALIDARG;
+	}
 
 	const int indexes = indexDesc->format != MESH_INDEX_FORMAT::NOTHING;
-	const int normals = dataDesc->normalsPresented;
-	const int texCoords = dataDesc->texCoordPresented;
-	const int colors = dataDesc->colorPresented;
-	const int bytesWidth = 16 + 16 * normals + 8 * texCoords + 16 * colors;
-	const int bytes = bytesWidth * dataDesc->numberOfVertex;
-
-	INPUT_ATTRUBUTE attribs = INPUT_ATTRUBUTE::POSITION;
-	if (dataDesc->normalsPresented)
-		attribs = attribs | INPUT_ATTRUBUTE::NORMAL;
-	if (dataDesc->texCoordPresented)
-		attribs = attribs | INPUT_ATTRUBUTE::TEX_COORD;
-	if (dataDesc->colorPresented)
-		attribs = attribs | INPUT_ATTRUBUTE::COLOR;
+	const size_t bytes = meshDataBytes(*dataDesc);
+
+	INPUT_ATTRUBUTE attribs = meshAttributes(*dataDesc);
+
+	VertexAttributeDesc attributes[MAX_VERTEX_ATTRIBUTES];
+	const uint attributesNum = meshVertexAttributes(attributes, *dataDesc);
+
+	// Interleaved vertices are read through one input slot.
+	// Otherwise (planar arrays, stride 0 - tightly packed) vertex buffer is bound to slot per attribute
+	// with attribute's offset and stride
+	const uint stride = attributes[0].stride;
+	bool interleaved = stride != 0;
+	for (uint i = 0; i < attributesNum; i++)
+		interleaved = interleaved && attributes[i].stride == stride && attributes[i].offset < stride;
+
+	DX11Mesh::VertexSlots slots;
+	slots.num = interleaved ? 1 : attributesNum;
+	for (uint i = 0; i < slots.num; i++)
+	{
+		slots.strides[i] = attributes[i].stride ? attributes[i].stride : attributes[i].bytes;
+		slots.offsets[i] = interleaved ? 0 : attributes[i].offset;
+	}
 
 	ComPtr<ID3DBlob> blob;
 	
 	//
 	// input layout
 	ID3D11InputLayout *il = nullptr;
-	unsigned int offset = 0;
-
-	vector<D3D11_INPUT_ELEMENT_DESC> layout{{"POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}};
-	offset += 16;
-
-	if (normals)
-	{
-		layout.push_back({"TEXCOORD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0});
-		offset += 16;
-	}
 
-	if (texCoords)
-	{
-		layout.push_back({"TEXCOORD", 2, DXGI_FORMAT_R32G32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0});
-		offset += 8;
-	}
+	vector<D3D11_INPUT_ELEMENT_DESC> layout;
 
-	if (colors)
+	for (uint i = 0; i < attributesNum; i++)
 	{
-		layout.push_back({"TEXCOORD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0});
-		offset += 16;
+		const VertexAttributeDesc& a = attributes[i];
+		layout.push_back({a.attribute == INPUT_ATTRUBUTE::POSITION ? "POSITION" : "TEXCOORD", a.location, eng_to_d3d11_vertex_format(a),
+			interleaved ? 0 : i, interleaved ? a.offset : 0, D3D11_INPUT_PER_VERTEX_DATA, 0});
 	}
 	
 	//
@@ -349,7 +519,7 @@ API DX11CoreRender::CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDe
 
 	D3D11_BUFFER_DESC bd{};
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = bytes;
+	bd.ByteWidth = (UINT)bytes;
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	bd.CPUAccessFlags = 0;
 
@@ -388,7 +558,7 @@ API DX11CoreRender::CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDe
 		ThrowIfFailed(_device->CreateBuffer(&bufferDesc, &ibData, &ib));
 	}
 
-	*pMesh = new DX11Mesh(vb, ib, il, dataDesc->numberOfVertex, indexDesc->number, indexDesc->format, mode, attribs, bytesWidth);
+	*pMesh = new DX11Mesh(vb, ib, il, dataDesc->numberOfVertex, indexDesc->number, indexDesc->format, mode, attribs, slots);
 
 	return S_OK;
 }
@@ -437,6 +607,143 @@ API DX11CoreRender::CreateShader(OUT ICoreShader **pShader, const char *vertText
 	return S_OK;
 }
 
+// Binary layout: | vertex bytes | fragment bytes | geometry bytes | vertex bytecode | fragment bytecode | geometry bytecode |
+API DX11CoreRender::CreateShaderFromBinary(OUT ICoreShader **pShader, const uint8 *data, uint size)
+{
+	*pShader = nullptr;
+
+	uint sizes[3];
+	if (size < sizeof(sizes))
+		return E_FAIL;
+	memcpy(sizes, data, sizeof(sizes));
+
+	if (sizes[0] == 0 || sizes[1] == 0 || sizeof(sizes) + sizes[0] + sizes[1] + sizes[2] != size)
+		return E_FAIL;
+
+	unsigned char *vb = const_cast<uint8*>(data) + sizeof(sizes);
+	unsigned char *fb = vb + sizes[0];
+	unsigned char *gb = fb + sizes[1];
+
+	ID3D11VertexShader *vs = nullptr;
+	ID3D11PixelShader *fs = nullptr;
+	ID3D11GeometryShader *gs = nullptr;
+
+	if (FAILED(_device->CreateVertexShader(vb, sizes[0], NULL, &vs)))
+		return E_FAIL;
+
+	if (FAILED(_device->CreatePixelShader(fb, sizes[1], NULL, &fs)))
+	{
+		vs->Release();
+		return E_FAIL;
+	}
+
+	if (sizes[2] && FAILED(_device->CreateGeometryShader(gb, sizes[2], NULL, &gs)))
+	{
+		vs->Release();
+		fs->Release();
+		return E_FAIL;
+	}
+
+	ShaderInitData vi = {vs, vb, sizes[0]};
+	ShaderInitData fi = {fs, fb, sizes[1]};
+	ShaderInitData gi = {gs, (gs ? gb : nullptr), sizes[2]};
+
+	*pShader = new DX11Shader(vi, fi, gi);
+
+	return S_OK;
+}
+
+API DX11CoreRender::CompileShaderBinary(OUT uint8 **data, OUT uint *size, const char *vertText, const char *fragText, const char *geomText)
+{
+	// Called from worker threads: only D3DCompile, no device calls and no log.
+	// On error caller compiles shader with CreateShader() which reports errors
+	*data = nullptr;
+	*size = 0;
+
+	const char *texts[3] = {vertText, fragText, geomText};
+	const SHADER_TYPE types[3] = {SHADER_TYPE::SHADER_VERTEX, SHADER_TYPE::SHADER_FRAGMENT, SHADER_TYPE::SHADER_GEOMETRY};
+	ComPtr<ID3DBlob> blobs[3];
+	uint sizes[3]{};
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (!texts[i])
+			continue;
+
+		ComPtr<ID3DBlob> error_buffer;
+		if (FAILED(D3DCompile(texts[i], strlen(texts[i]), "", NULL, NULL, get_main_function(types[i]), get_shader_profile(types[i]), SHADER_COMPILE_FLAGS, 0, blobs[i].GetAddressOf(), error_buffer.GetAddressOf())))
+			return E_FAIL;
+
+		sizes[i] = (uint)blobs[i]->GetBufferSize();
+	}
+
+	// Same layout as GetShaderBinary()
+	*size = (uint)sizeof(sizes) + sizes[0] + sizes[1] + sizes[2];
+	*data = new uint8[*size];
+
+	uint8 *p = *data;
+	memcpy(p, sizes, sizeof(sizes));
+	p += sizeof(sizes);
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (!blobs[i])
+			continue;
+		memcpy(p, blobs[i]->GetBufferPointer(), sizes[i]);
+		p += sizes[i];
+	}
+
+	return S_OK;
+}
+
+API DX11CoreRender::GetShaderCompilerVersion(OUT const char **pVersion)
+{
+	// Bytecode doesn't depend on driver, only on compiler and its options
+	static const string version = string(D3DCOMPILER_DLL_A) + ' ' + get_shader_profile(SHADER_TYPE::SHADER_VERTEX) + " flags=" + std::to_string(SHADER_COMPILE_FLAGS);
+	*pVersion = version.c_str();
+	return S_OK;
+}
+
+// Shaders are compiled on worker threads by CompileShaderBinary()
+API DX11CoreRender::StartShaderCompile(const char *vertText, const char *fragText, const char *geomText)
+{
+	return E_NOTIMPL;
+}
+
+API DX11CoreRender::IsShaderCompiling(OUT int *compiling, const char *vertText, const char *fragText, const char *geomText)
+{
+	*compiling = 0;
+	return S_OK;
+}
+
+API DX11CoreRender::CancelShaderCompile(const char *vertText, const char *fragText, const char *geomText)
+{
+	return S_OK;
+}
+
+API DX11CoreRender::GetShaderBinary(ICoreShader *pShader, OUT uint8 *data, OUT uint *size)
+{
+	DX11Shader *dxShader = static_cast<DX11Shader*>(pShader);
+
+	const vector<uint8>& vb = dxShader->bytecode(SHADER_TYPE::SHADER_VERTEX);
+	const vector<uint8>& fb = dxShader->bytecode(SHADER_TYPE::SHADER_FRAGMENT);
+	const vector<uint8>& gb = dxShader->bytecode(SHADER_TYPE::SHADER_GEOMETRY);
+
+	uint sizes[3] = {(uint)vb.size(), (uint)fb.size(), (uint)gb.size()};
+	*size = (uint)(sizeof(sizes) + vb.size() + fb.size() + gb.size());
+
+	if (data == nullptr)
+		return S_OK;
+
+	memcpy(data, sizes, sizeof(sizes));
+	data += sizeof(sizes);
+	if (!vb.empty()) { memcpy(data, vb.data(), vb.size()); data += vb.size(); }
+	if (!fb.empty()) { memcpy(data, fb.data(), fb.size()); data += fb.size(); }
+	if (!gb.empty()) { memcpy(data, gb.data(), gb.size()); }
+
+	return S_OK;
+}
+
 DXGI_FORMAT EngToDX11Format(TEXTURE_FORMAT format)
 {
 	switch (format)
@@ -667,6 +974,51 @@ API DX11CoreRender::CreateStructuredBuffer(OUT ICoreStructuredBuffer **pStructur
 	return S_OK;
 }
 
+API DX11CoreRender::RegisterUniformBlock(const UniformBlockDesc *desc)
+{
+	_uniformBlocks[string("const_buffer_") + desc->name] = UniformBlockLayout(*desc);
+	return S_OK;
+}
+
+UniformBlockLayout* DX11CoreRender::uniformBlock(const char *bufferName)
+{
+	auto it = _uniformBlocks.find(bufferName);
+	return it == _uniformBlocks.end() ? nullptr : &it->second;
+}
+
+API DX11CoreRender::CreatePipelineState(OUT ICorePipelineState **pState, const PipelineStateDesc *desc)
+{
+	*pState = nullptr;
+
+	if (const char *error = pipelineStateDescError(*desc))
+	{
+		LOG_WARNING_FORMATTED("DX11CoreRender::CreatePipelineState(): %s", error);
+		return E_INVALIDARG;
+	}
+
+	DX11PipelineState *pso = new DX11PipelineState(*desc, ++_pipelineStatesCreated);
+
+	pso->blendStateDesc = eng_to_d3d11_blend_desc(desc->srcBlend, desc->destBlend);
+	pso->blendState = _blendStatePool.FetchState(pso->blendStateDesc);
+
+	pso->rasterStateDesc = eng_to_d3d11_raster_desc(desc->cullMode, desc->fillMode);
+	pso->rasterState = _rasterizerStatePool.FetchState(pso->rasterStateDesc);
+
+	pso->depthStencilDesc = eng_to_d3d11_depth_stencil_desc(desc->depthTest, desc->depthWrite);
+	pso->depthStencilState = _depthStencilStatePool.FetchState(pso->depthStencilDesc);
+
+	if (!pso->blendState || !pso->rasterState || !pso->depthStencilState)
+	{
+		LOG_WARNING("DX11CoreRender::CreatePipelineState(): can't create state objects");
+		delete pso;
+		return E_INVALIDARG;
+	}
+
+	*pState = pso;
+
+	return S_OK;
+}
+
 API DX11CoreRender::PushStates()
 {
 	_statesStack.push(_state);
@@ -722,8 +1074,8 @@ API DX11CoreRender::PopStates()
 				if (state.texShaderBindings[i].Get())
 				{
 					DX11Texture *dxTex = getDX11Texture(state.texShaderBindings[i].Get());
-					srv[i] = dxTex->srView();
-					ss[i] = dxTex->sampler();
+					srv[i - from] = dxTex->srView();
+					ss[i - from] = dxTex->sampler();
 				}
 			}
 
@@ -731,6 +1083,7 @@ API DX11CoreRender::PopStates()
 
 			_context->PSSetShaderResources(from, num, srv);
 			_context->PSSetSamplers(from, num, ss);
+			forgetStructuredBuffers(from, num);
 		}
 	}
 
@@ -771,12 +1124,63 @@ API DX11CoreRender::RestoreDefaultRenderTarget()
 	return S_OK;
 }
 
+API DX11CoreRender::SetPipelineState(ICorePipelineState *state)
+{
+	if (!state)
+		return E_INVALIDARG;
+
+	DX11PipelineState *pso = static_cast<DX11PipelineState*>(state);
+
+	if (_state.pipelineState == pso->id())
+	{
+		_stateStats.filtered();
+		return S_OK;
+	}
+
+	SetShader(pso->desc().shader);
+
+	// Descriptions are compared because the same state object can be set without PSO
+	if (memcmp(&_state.blendStateDesc, &pso->blendStateDesc, sizeof(D3D11_BLEND_DESC)))
+	{
+		_state.blendStateDesc = pso->blendStateDesc;
+		_state.blendState = pso->blendState;
+		_context->OMSetBlendState(_state.blendState.Get(), zero, ~0u);
+		_stateStats.issued();
+	}
+
+	if (memcmp(&_state.rasterStateDesc, &pso->rasterStateDesc, sizeof(D3D11_RASTERIZER_DESC)))
+	{
+		_state.rasterStateDesc = pso->rasterStateDesc;
+		_state.rasterState = pso->rasterState;
+		_context->RSSetState(_state.rasterState.Get());
+		_stateStats.issued();
+	}
+
+	if (memcmp(&_state.depthStencilDesc, &pso->depthStencilDesc, sizeof(D3D11_DEPTH_STENCIL_DESC)))
+	{
+		_state.depthStencilDesc = pso->depthStencilDesc;
+		_state.depthStencilState = pso->depthStencilState;
+		_context->OMSetDepthStencilState(_state.depthStencilState.Get(), 0);
+		_stateStats.issued();
+	}
+
+	_state.pipelineState = pso->id();
+	_state.pipelineAttributes = pso->desc().attributes;
+
+	return S_OK;
+}
+
 API DX11CoreRender::SetShader(IShader* pShader)
 {
 	if (_state.shader.Get() == pShader)
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
 
 	_state.shader = ComPtr<IShader>(pShader);
+	_state.pipelineState = 0u;
+	_stateStats.issued();
 
 	if (pShader)
 	{
@@ -795,7 +1199,12 @@ API DX11CoreRender::SetShader(IShader* pShader)
 API DX11CoreRender::SetMesh(IMesh* mesh)
 {
 	if (_state.mesh.Get() == mesh)
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
+
+	_stateStats.issued();
 
 	if (mesh)
 	{
@@ -805,11 +1214,13 @@ API DX11CoreRender::SetMesh(IMesh* mesh)
 
 		_context->IASetInputLayout(dxMesh->inputLayout());
 
-		ID3D11Buffer *vb = dxMesh->vertexBuffer();
-		UINT offset = 0;
-		UINT stride = dxMesh->stride();
+		const DX11Mesh::VertexSlots& slots = dxMesh->vertexSlots();
 
-		_context->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+		ID3D11Buffer *vb[MAX_VERTEX_ATTRIBUTES];
+		for (uint i = 0; i < slots.num; i++)
+			vb[i] = dxMesh->vertexBuffer();
+
+		_context->IASetVertexBuffers(0, slots.num, vb, slots.strides, slots.offsets);
 
 		if (dxMesh->indexBuffer())
 			_context->IASetIndexBuffer(dxMesh->indexBuffer(), (dxMesh->indexFormat() == MESH_INDEX_FORMAT::INT16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT), 0);
@@ -832,8 +1243,35 @@ API DX11CoreRender::SetMesh(IMesh* mesh)
 	return S_OK;
 }
 
+void DX11CoreRender::forgetStructuredBuffers(int from, int num)
+{
+	for (int i = from; i < from + num; i++)
+	{
+		_structuredBufferBindings[i].buffer = nullptr;
+		_structuredBufferBindings[i].known = false;
+	}
+}
+
 API DX11CoreRender::SetStructuredBufer(uint slot, IStructuredBuffer *buffer)
 {
+	if (slot < MAX_TEXTURE_SLOTS)
+	{
+		StructuredBufferBinding &b = _structuredBufferBindings[slot];
+		if (b.known && b.buffer.Get() == buffer)
+		{
+			_stateStats.filtered();
+			return S_OK;
+		}
+
+		b.buffer = buffer;
+		b.known = true;
+
+		// PS slot doesn't contain texture anymore
+		_state.texShaderBindings[slot] = nullptr;
+	}
+
+	_stateStats.issued();
+
 	if (buffer)
 	{
 		ICoreStructuredBuffer *coreBuffer;
@@ -857,10 +1295,15 @@ API DX11CoreRender::BindTexture(uint slot, ITexture *texture)
 {
 	assert(slot < MAX_TEXTURE_SLOTS && "DX11CoreRender::BindTexture(): slot must be 0...15");
 
-	if (_state.texShaderBindings[slot].Get() == texture)
+	if (_state.texShaderBindings[slot].Get() == texture && _structuredBufferBindings[slot].buffer.Get() == nullptr)
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
 
 	_state.texShaderBindings[slot] = texture;
+	_stateStats.issued();
+	forgetStructuredBuffers(slot, 1);
 
 	if (texture)
 	{
@@ -906,6 +1349,7 @@ API DX11CoreRender::UnbindAllTextures()
 
 		_context->PSSetShaderResources(from, num, srv);
 		_context->PSSetSamplers(from, num, ss);
+		forgetStructuredBuffers(from, num);
 
 		for (int i = from; i <= to; i++)
 		{
@@ -923,6 +1367,15 @@ API DX11CoreRender::Draw(IMesh* mesh, uint instances)
 	if (_state.mesh.Get() != mesh)
 		SetMesh(mesh);
 
+#ifdef _DEBUG
+	if (_state.pipelineState && _state.pipelineAttributes != INPUT_ATTRUBUTE::CUSTOM)
+	{
+		INPUT_ATTRUBUTE attribs;
+		mesh->GetAttributes(&attribs);
+		assert(attribs == _state.pipelineAttributes && "DX11CoreRender::Draw(): mesh doesn't match vertex layout of pipeline state");
+	}
+#endif
+
 	DX11Mesh *dxMesh = getDX11Mesh(mesh);
 
 	if (instances > 1)
@@ -950,31 +1403,27 @@ API DX11CoreRender::SetDepthTest(int enabled)
 		_state.depthStencilDesc.DepthEnable = enabled;
 		_state.depthStencilState = _depthStencilStatePool.FetchState(_state.depthStencilDesc);
 		_context->OMSetDepthStencilState(_state.depthStencilState.Get(), 0);
-	}
+		_state.pipelineState = 0u;
+		_stateStats.issued();
+	} else
+		_stateStats.filtered();
 
 	return S_OK;
 }
 
 API DX11CoreRender::SetBlendState(BLEND_FACTOR src, BLEND_FACTOR dest)
 {
-	D3D11_BLEND_DESC blend_desc{};
-	blend_desc.AlphaToCoverageEnable = FALSE;
-	blend_desc.IndependentBlendEnable = 0;
-	blend_desc.RenderTarget[0].BlendEnable = src != BLEND_FACTOR::NONE && dest != BLEND_FACTOR::NONE;
-	blend_desc.RenderTarget[0].SrcBlend = static_cast<D3D11_BLEND>(src);
-	blend_desc.RenderTarget[0].DestBlend = static_cast<D3D11_BLEND>(dest);
-	blend_desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
-	blend_desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
-	blend_desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
-	blend_desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-	blend_desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	D3D11_BLEND_DESC blend_desc = eng_to_d3d11_blend_desc(src, dest);
 
 	if (memcmp(&_state.blendStateDesc, &blend_desc, sizeof(D3D11_BLEND_DESC)))
 	{
 		_state.blendStateDesc = blend_desc;
 		_state.blendState = _blendStatePool.FetchState(_state.blendStateDesc);
 		_context->OMSetBlendState(_state.blendState.Get(), zero, ~0u);
-	}
+		_state.pipelineState = 0u;
+		_stateStats.issued();
+	} else
+		_stateStats.filtered();
 
 	return S_OK;
 }
@@ -996,7 +1445,9 @@ API DX11CoreRender::SetViewport(uint newWidth, uint newHeight)
 		createDefaultBuffers(newWidth, newHeight);
 
 		_context->RSSetViewports(1, &dxViewport);
-	}
+		_stateStats.issued();
+	} else
+		_stateStats.filtered();
 
 	return S_OK;
 }
@@ -1222,7 +1673,12 @@ const char* dgxgi_to_hlsl_type(DXGI_FORMAT f)
 	case DXGI_FORMAT_R32G32B32_FLOAT:
 		return "float3";
 	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
 		return "float4";
+	case DXGI_FORMAT_R16G16_SNORM:
+	case DXGI_FORMAT_R16G16_UNORM:
+		return "float2";
 	default:
 		LOG_FATAL("DX11CoreRender: dgxgi_to_hlsl_type(DXGI_FORMAT f) unknown type f\n");
 		assert(false);
@@ -1260,6 +1716,12 @@ void DX11RenderTarget::_getDepth(ID3D11DepthStencilView **depthOut)
 	*depthOut = dxdct->dsView();
 }
 
+API DX11PipelineState::GetDesc(OUT PipelineStateDesc *desc)
+{
+	*desc = _desc;
+	return S_OK;
+}
+
 DX11RenderTarget::~DX11RenderTarget()
 {
 }
@@ -3,6 +3,9 @@
 
 namespace WRL = Microsoft::WRL;
 
+// Size of dynamic buffer all constant buffers are sub-allocated from
+constexpr size_t CONSTANT_BUFFER_RING_BYTES = 4 * 1024 * 1024;
+
 struct ConstantBuffer
 {
 	string name;
@@ -11,6 +14,11 @@ struct ConstantBuffer
 	WRL::ComPtr<ID3D11Buffer> buffer;
 	unique_ptr<uint8[]> data;
 
+	// Location of data in ConstantBufferRing. Valid only while ring generation is the same
+	UINT ringFirstConstant = 0u;
+	UINT ringNumConstants = 0u;
+	uint64_t ringGeneration = 0u;
+
 	struct Parameter
 	{
 		string name;
@@ -37,6 +45,9 @@ public:
 		r.buffer = nullptr;
 		data = std::move(r.data);
 		needFlush = r.needFlush;
+		ringFirstConstant = r.ringFirstConstant;
+		ringNumConstants = r.ringNumConstants;
+		ringGeneration = r.ringGeneration;
 	}
 	ConstantBuffer& operator=(ConstantBuffer&& r)
 	{
@@ -47,10 +58,40 @@ public:
 		r.buffer = nullptr;
 		data = std::move(r.data);
 		needFlush = r.needFlush;
+		ringFirstConstant = r.ringFirstConstant;
+		ringNumConstants = r.ringNumConstants;
+		ringGeneration = r.ringGeneration;
 	}
 	ConstantBuffer& operator=(const ConstantBuffer& r) = delete;
 };
 
+//
+// One big dynamic buffer for constant buffers uploads (requires D3D 11.1)
+//
+// Each upload is mapped with NO_OVERWRITE at next free offset and bound with *SetConstantBuffers1,
+// so driver doesn't rename buffer per draw. When buffer is full it is mapped with DISCARD
+// and writing starts from beginning: all previous uploads are lost, generation is increased
+//
+class ConstantBufferRing final
+{
+	WRL::ComPtr<ID3D11Buffer> _buffer;
+	WRL::ComPtr<ID3D11DeviceContext1> _context;
+	size_t _bytes = 0u;
+	size_t _offset = 0u;
+	uint64_t _generation = 1u;
+
+public:
+	bool init(ID3D11Device *device, ID3D11DeviceContext *context, size_t bytes);
+	void free();
+
+	void upload(const void *data, size_t bytes, OUT UINT& firstConstant, OUT UINT& numConstants);
+
+	bool isInitialized() const { return _buffer != nullptr; }
+	ID3D11Buffer* buffer() const { return _buffer.Get(); }
+	ID3D11DeviceContext1* context() const { return _context.Get(); }
+	uint64_t generation() const { return _generation; }
+};
+
 class DX11RenderTarget : public ICoreRenderTarget
 {
 	TexturePtr _colors[8];
@@ -75,7 +116,30 @@ public:
 	API UnbindAll() override;
 };
 
-class DX11CoreRender final : public ICoreRender
+// State objects are fetched from pools of DX11CoreRender at creation
+class DX11PipelineState final : public ICorePipelineState
+{
+	PipelineStateDesc _desc;
+	ShaderPtr _shader;
+	uint64_t _id = 0u;
+
+public:
+	D3D11_BLEND_DESC blendStateDesc;
+	WRL::ComPtr<ID3D11BlendState> blendState;
+	D3D11_RASTERIZER_DESC rasterStateDesc;
+	WRL::ComPtr<ID3D11RasterizerState> rasterState;
+	D3D11_DEPTH_STENCIL_DESC depthStencilDesc;
+	WRL::ComPtr<ID3D11DepthStencilState> depthStencilState;
+
+	DX11PipelineState(const PipelineStateDesc& desc, uint64_t id) : _desc(desc), _shader(desc.shader), _id(id) {}
+
+	const PipelineStateDesc& desc() const { return _desc; }
+	uint64_t id() const { return _id; }
+
+	API GetDesc(OUT PipelineStateDesc *desc) override;
+};
+
+class DX11CoreRender final : public ICoreRender, IProfilerCallback
 {
 	WRL::ComPtr<ID3D11Device> _device;
 	WRL::ComPtr<ID3D11DeviceContext> _context;
@@ -136,11 +200,42 @@ class DX11CoreRender final : public ICoreRender
 		FLOAT clearColor[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 		FLOAT depthClearColor = 1.0f;
 		UINT8 stencilClearColor = 0;
+
+		// Pipeline state blend, rasterizer, depth/stencil and shader were set from. 0 if some of them was changed after it
+		//
+		uint64_t pipelineState = 0u;
+		INPUT_ATTRUBUTE pipelineAttributes = INPUT_ATTRUBUTE::CUSTOM; // checked in Draw()
 	};
 
 	State _state;
 	std::stack<State> _statesStack;
 
+	ConstantBufferRing _constantBufferRing;
+
+	// Constant buffer name in shader ("const_buffer_" + name) -> layout of C++ struct
+	std::unordered_map<string, UniformBlockLayout> _uniformBlocks;
+
+	// Ring ranges bound to stages. Rebound only if range changed
+	struct ConstantBufferBinding
+	{
+		UINT firstConstant;
+		UINT numConstants;
+	};
+	ConstantBufferBinding _constantBufferBindings[3][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT]{};
+
+	// Structured buffers bound to VS and PS shader resource slots. Not part of State.
+	// Textures use the same PS slots, so binding texture makes slot unknown
+	struct StructuredBufferBinding
+	{
+		StructuredBufferPtr buffer;
+		bool known = false;
+	};
+	StructuredBufferBinding _structuredBufferBindings[MAX_TEXTURE_SLOTS];
+
+	StateFilterStats _stateStats;
+
+	uint64_t _pipelineStatesCreated = 0u; // also id of last created state
+
 	IResourceManager *_pResMan = nullptr;
 
 	int _MSAASamples = 1;
@@ -148,6 +243,7 @@ class DX11CoreRender final : public ICoreRender
 
 	bool createDefaultBuffers(uint w, uint h);
 	void destroyDefaultBuffers();
+	void forgetStructuredBuffers(int from, int num);
 
 	WRL::ComPtr<ID3DBlob> createShader(ID3D11DeviceChild *&poiterOut, SHADER_TYPE type, const char *src, HRESULT& err);
 	UINT MSAAquality(DXGI_FORMAT format, int MSAASamples);
@@ -156,6 +252,12 @@ public:
 
 	ID3D11Device* getDevice() { return _device.Get(); }
 	ID3D11DeviceContext* getContext() { return _context.Get(); }
+	ConstantBufferRing& constantBufferRing() { return _constantBufferRing; }
+	UniformBlockLayout* uniformBlock(const char *bufferName);
+	void bindConstantBuffer(SHADER_TYPE type, UINT slot, UINT firstConstant, UINT numConstants);
+
+	uint getNumLines() override;
+	string getString(uint i) override;
 
 	DX11CoreRender();
 	virtual ~DX11CoreRender();
@@ -167,9 +269,18 @@ public:
 
 	API CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc, const MeshIndexDesc *indexDesc, VERTEX_TOPOLOGY mode) override;
 	API CreateShader(OUT ICoreShader **pShader, const char *vertText, const char *fragText, const char *geomText) override;
+	API CreateShaderFromBinary(OUT ICoreShader **pShader, const uint8 *data, uint size) override;
+	API GetShaderBinary(ICoreShader *pShader, OUT uint8 *data, OUT uint *size) override;
+	API CompileShaderBinary(OUT uint8 **data, OUT uint *size, const char *vertText, const char *fragText, const char *geomText) override;
+	API GetShaderCompilerVersion(OUT const char **pVersion) override;
+	API StartShaderCompile(const char *vertText, const char *fragText, const char *geomText) override;
+	API IsShaderCompiling(OUT int *compiling, const char *vertText, const char *fragText, const char *geomText) override;
+	API CancelShaderCompile(const char *vertText, const char *fragText, const char *geomText) override;
 	API CreateTexture(OUT ICoreTexture **pTexture, uint8 *pData, uint width, uint height, TEXTURE_TYPE type, TEXTURE_FORMAT format, TEXTURE_CREATE_FLAGS flags, int mipmapsPresented) override;
 	API CreateRenderTarget(OUT ICoreRenderTarget **pRenderTarget) override;
 	API CreateStructuredBuffer(OUT ICoreStructuredBuffer **pStructuredBuffer, uint size, uint elementSize) override;
+	API RegisterUniformBlock(const UniformBlockDesc *desc) override;
+	API CreatePipelineState(OUT ICorePipelineState **pState, const PipelineStateDesc *desc) override;
 
 	API PushStates() override;
 	API PopStates() override;
@@ -177,6 +288,7 @@ public:
 	API UnbindAllTextures() override;
 	API SetCurrentRenderTarget(IRenderTarget *pRenderTarget) override;
 	API RestoreDefaultRenderTarget() override;
+	API SetPipelineState(ICorePipelineState *state) override;
 	API SetShader(IShader *pShader) override;
 	API SetMesh(IMesh* mesh) override;
 	API SetStructuredBufer(uint slot, IStructuredBuffer* buffer) override;
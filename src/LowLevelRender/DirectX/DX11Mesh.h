@@ -3,6 +3,16 @@
 
 class DX11Mesh : public ICoreMesh
 {
+public:
+	// Input slots vertex buffer is bound to. One slot for interleaved vertices
+	struct VertexSlots
+	{
+		uint num = 1;
+		UINT strides[MAX_VERTEX_ATTRIBUTES]{};
+		UINT offsets[MAX_VERTEX_ATTRIBUTES]{};
+	};
+
+private:
 	ID3D11Buffer* _pVertexBuffer = nullptr;
 	ID3D11Buffer *_pIndexBuffer = nullptr;
 	ID3D11InputLayout* _pInputLayoyt = nullptr;
@@ -12,17 +22,17 @@ class DX11Mesh : public ICoreMesh
 	MESH_INDEX_FORMAT _index_format = MESH_INDEX_FORMAT::NOTHING;
 	VERTEX_TOPOLOGY _topology = VERTEX_TOPOLOGY::TRIANGLES;
 	INPUT_ATTRUBUTE _attributes = INPUT_ATTRUBUTE::CUSTOM;
-	int _bytesWidth = 0;
+	VertexSlots _slots;
 
 public:
 
-	DX11Mesh(ID3D11Buffer* vb, ID3D11Buffer *ib, ID3D11InputLayout* il, uint vertexNumber, uint indexNumber, MESH_INDEX_FORMAT indexFormat, VERTEX_TOPOLOGY mode, INPUT_ATTRUBUTE a, int bytesWidth);
+	DX11Mesh(ID3D11Buffer* vb, ID3D11Buffer *ib, ID3D11InputLayout* il, uint vertexNumber, uint indexNumber, MESH_INDEX_FORMAT indexFormat, VERTEX_TOPOLOGY mode, INPUT_ATTRUBUTE a, const VertexSlots& slots);
 	virtual ~DX11Mesh();
 
 	ID3D11Buffer *		indexBuffer() const { return _pIndexBuffer; }
 	ID3D11Buffer*		vertexBuffer() const { return _pVertexBuffer; }
 	ID3D11InputLayout*	inputLayout() const { return _pInputLayoyt; }
-	int					stride() const { return _bytesWidth; }
+	const VertexSlots&	vertexSlots() const { return _slots; }
 	UINT				vertexNumber() const { return _number_of_vertices; }
 	MESH_INDEX_FORMAT	indexFormat() const { return _index_format; }
 	UINT				indexNumber() const { return _number_of_indicies; }
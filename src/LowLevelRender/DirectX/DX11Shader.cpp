@@ -7,14 +7,19 @@ extern Core *_pCore;
 DEFINE_DEBUG_LOG_HELPERS(_pCore)
 DEFINE_LOG_HELPERS(_pCore)
 
-static ID3D11DeviceContext* getContext(Core *core)
+static DX11CoreRender* getDX11CoreRender()
 {
 	ICoreRender *coreRender = getCoreRender(_pCore);
-	DX11CoreRender *dxRender = static_cast<DX11CoreRender*>(coreRender);
-	return dxRender->getContext();
+	return static_cast<DX11CoreRender*>(coreRender);
+}
+
+static ID3D11DeviceContext* getContext(Core *core)
+{
+	return getDX11CoreRender()->getContext();
 }
 
 extern vector<ConstantBuffer> ConstantBufferPool;
+extern UniformBufferIndex<ConstantBuffer> ConstantBufferPoolIndex;
 
 void DX11Shader::initSubShader(ShaderInitData& data, SHADER_TYPE type)
 {
@@ -25,6 +30,9 @@ void DX11Shader::initSubShader(ShaderInitData& data, SHADER_TYPE type)
 		case SHADER_TYPE::SHADER_FRAGMENT:  f.pointer.pFragment = (ID3D11PixelShader *)data.pointer; break;
 	}
 
+	SubShader &sub = type == SHADER_TYPE::SHADER_VERTEX ? v : (type == SHADER_TYPE::SHADER_GEOMETRY ? g : f);
+	sub.bytecode.assign(data.bytecode, data.bytecode + data.size);
+
 	ID3D11ShaderReflection* reflection = nullptr;
 	D3DReflect(data.bytecode, data.size, IID_ID3D11ShaderReflection, (void**)&reflection);
 
@@ -69,37 +77,14 @@ void DX11Shader::initSubShader(ShaderInitData& data, SHADER_TYPE type)
 			cbParameters.push_back(p);
 		}
 
+		// make byte width multiplied by 16
+		uint size = bufferDesc.Size;
+		if (size % 16 != 0)
+			size = 16 * ((size / 16) + 1);
+
 		// find existing buffer with same memory layout
-		int indexFound = -1;
-		{
-			for (int j = 0; indexFound == -1 && j < ConstantBufferPool.size(); j++)
-			{
-				bool isEqual = true;
-
-				if (ConstantBufferPool[j].name != bufferDesc.Name)
-					isEqual = false;
-
-				if (ConstantBufferPool[j].bytes != bufferDesc.Size)
-					isEqual = false;
-
-				if (ConstantBufferPool[j].parameters.size() != cbParameters.size())
-					isEqual = false;
-
-				for (int k = 0; isEqual && k < cbParameters.size(); k++)
-				{
-					if (ConstantBufferPool[j].parameters[k].name != cbParameters[k].name ||
-						ConstantBufferPool[j].parameters[k].bytes != cbParameters[k].bytes ||
-						ConstantBufferPool[j].parameters[k].offset != cbParameters[k].offset ||
-						ConstantBufferPool[j].parameters[k].elements != cbParameters[k].elements)
-					{
-						isEqual = 0;
-					}
-				}
-
-				if (isEqual)
-					indexFound = j;
-			}
-		}
+		const uint64_t layoutKey = UniformBufferIndex<ConstantBuffer>::key(bufferDesc.Name, size, cbParameters);
+		int indexFound = ConstantBufferPoolIndex.find(ConstantBufferPool, layoutKey, bufferDesc.Name, size, cbParameters);
 
 		vector<size_t> *buf;
 
@@ -110,23 +95,34 @@ void DX11Shader::initSubShader(ShaderInitData& data, SHADER_TYPE type)
 			case SHADER_TYPE::SHADER_FRAGMENT:	buf = &f._bufferIndicies; break;
 		};
 
+		// Validate layout of typed block in every shader. Block of other layout gets no handle
+		UniformBlockLayout *typed = getDX11CoreRender()->uniformBlock(bufferDesc.Name);
+		const int poolIndex = indexFound != -1 ? indexFound : (int)ConstantBufferPool.size();
+
+		if (typed)
+		{
+			if (typed->matches(cbParameters, size))
+			{
+				if (typed->poolIndex < 0)
+					typed->poolIndex = poolIndex;
+				if (_blockHandles.find(typed->name) == _blockHandles.end())
+					addBlock(typed->name, poolIndex);
+			} else
+				LOG_WARNING_FORMATTED("DX11Shader::initSubShader(): constant buffer \"%s\" doesn't match registered C++ struct. SetUniformBlock() is ignored for it", bufferDesc.Name);
+		}
+
 		if (indexFound != -1) // buffer found
 		{
 			buf->push_back(indexFound);
 
 			for (int i = 0; i < cbParameters.size(); i++)
 			{
-				_parameters[cbParameters[i].name] = {(int)indexFound, (int)i};
+				addParameter(cbParameters[i].name, {(int)indexFound, (int)i});
 			}
 		} else // not found => create new
 		{
 			WRL::ComPtr<ID3D11Buffer> dxBuffer;
 		
-			// make byte width multiplied by 16
-			uint size = bufferDesc.Size;
-			if (size % 16 != 0)
-				size = 16 * ((size / 16) + 1);
-		
 			D3D11_BUFFER_DESC desc{};
 			desc.Usage = D3D11_USAGE_DYNAMIC;
 			desc.ByteWidth = size;
@@ -142,9 +138,10 @@ void DX11Shader::initSubShader(ShaderInitData& data, SHADER_TYPE type)
 
 			for (int k = 0; k < cbParameters.size(); k++)
 			{
-				_parameters[cbParameters[k].name] = {(int)ConstantBufferPool.size(), (int)k};
+				addParameter(cbParameters[k].name, {(int)ConstantBufferPool.size(), (int)k});
 			}
 
+			ConstantBufferPoolIndex.add(layoutKey, (int)ConstantBufferPool.size());
 			ConstantBufferPool.emplace_back(std::move(ConstantBuffer(dxBuffer, size, bufferDesc.Name, cbParameters)));
 		}
 	}
@@ -164,6 +161,20 @@ DX11Shader::~DX11Shader()
 	if (v.pointer.pVertex)		{ v.pointer.pVertex->Release();		v.pointer.pVertex = nullptr; }
 	if (f.pointer.pFragment)	{ f.pointer.pFragment->Release();	f.pointer.pFragment = nullptr; }
 	if (g.pointer.pGeometry)	{ g.pointer.pGeometry->Release();	g.pointer.pGeometry = nullptr; }
+
+	for (const vector<size_t> *buf : {&v._bufferIndicies, &f._bufferIndicies, &g._bufferIndicies})
+		for (size_t index : *buf)
+			ConstantBufferPoolIndex.removeUser(index);
+}
+
+const vector<uint8>& DX11Shader::bytecode(SHADER_TYPE type) const
+{
+	switch (type)
+	{
+		case SHADER_TYPE::SHADER_VERTEX: return v.bytecode;
+		case SHADER_TYPE::SHADER_GEOMETRY: return g.bytecode;
+	}
+	return f.bytecode;
 }
 
 void DX11Shader::bind()
@@ -176,6 +187,12 @@ void DX11Shader::bind()
 	if (gs())
 		ctx->GSSetShader(gs(), nullptr, 0);
 
+	if (getDX11CoreRender()->constantBufferRing().isInitialized())
+	{
+		uploadBuffers();
+		return;
+	}
+
 	ID3D11Buffer *pointers[128];
 
 	#define BUND_CONSTANT_BUFFERS(PREFIX, IDX_VEC) \
@@ -195,16 +212,37 @@ void DX11Shader::bind()
 	BUND_CONSTANT_BUFFERS(GS, g._bufferIndicies)
 }
 
+void DX11Shader::addParameter(const string& name, const Parameter& p)
+{
+	_parameterHandles[name] = (uint)_parameters.size();
+	_parameters.push_back(p);
+}
+
+void DX11Shader::addBlock(const string& name, size_t bufferIndex)
+{
+	_blockHandles[name] = (uint)_blocks.size();
+	_blocks.push_back(bufferIndex);
+}
+
 void DX11Shader::setParameter(const char *name, const void *data)
 {
-	auto it = _parameters.find(name);
-	if (it == _parameters.end())
+	auto it = _parameterHandles.find(name);
+	if (it == _parameterHandles.end())
 	{
-		auto &p = _parameters[name];
+		// Remember unknown parameter to warn once
+		it = _parameterHandles.emplace(name, SHADER_PARAMETER_INVALID).first;
 		LOG_WARNING_FORMATTED("DX11Shader::setParameter() unable find parameter \"%s\"", name);
 	}
 
-	Parameter &p = _parameters[name];
+	setParameter(it->second, data);
+}
+
+void DX11Shader::setParameter(uint handle, const void *data)
+{
+	if (handle >= _parameters.size())
+		return;
+
+	Parameter &p = _parameters[handle];
 
 	if (p.bufferIndex < 0 || p.parameterIndex < 0)
 		return;
@@ -243,8 +281,114 @@ API DX11Shader::SetUintParameter(const char *name, uint value)
 	return S_OK;
 }
 
+API DX11Shader::GetParameterHandle(const char *name, OUT uint *handle)
+{
+	auto it = _parameterHandles.find(name);
+	*handle = it == _parameterHandles.end() ? SHADER_PARAMETER_INVALID : it->second;
+	return *handle == SHADER_PARAMETER_INVALID ? E_FAIL : S_OK;
+}
+
+API DX11Shader::SetFloatParameter(uint handle, float value)
+{
+	setParameter(handle, &value);
+	return S_OK;
+}
+
+API DX11Shader::SetVec4Parameter(uint handle, const vec4 *value)
+{
+	setParameter(handle, value);
+	return S_OK;
+}
+
+API DX11Shader::SetMat4Parameter(uint handle, const mat4 *value)
+{
+	setParameter(handle, value);
+	return S_OK;
+}
+
+API DX11Shader::SetUintParameter(uint handle, uint value)
+{
+	setParameter(handle, &value);
+	return S_OK;
+}
+
+void DX11Shader::uploadBuffers()
+{
+	DX11CoreRender *dxRender = getDX11CoreRender();
+	ConstantBufferRing &ring = dxRender->constantBufferRing();
+
+	auto uploadStage = [&ring](vector<size_t>& indicies)
+	{
+		for (size_t idx : indicies)
+		{
+			ConstantBuffer& cb = ConstantBufferPool[idx];
+			if (cb.needFlush || cb.ringGeneration != ring.generation())
+			{
+				ring.upload(cb.data.get(), cb.bytes, cb.ringFirstConstant, cb.ringNumConstants);
+				cb.ringGeneration = ring.generation();
+				cb.needFlush = false;
+			}
+		}
+	};
+
+	// Wrap of ring discards buffers uploaded before it, even ones uploaded in this loop
+	uint64_t generation;
+	do
+	{
+		generation = ring.generation();
+
+		uploadStage(v._bufferIndicies);
+		uploadStage(f._bufferIndicies);
+		if (gs())
+			uploadStage(g._bufferIndicies);
+
+	} while (generation != ring.generation());
+
+	auto bindStage = [dxRender](SHADER_TYPE type, vector<size_t>& indicies)
+	{
+		for (size_t i = 0; i < indicies.size(); i++)
+		{
+			ConstantBuffer& cb = ConstantBufferPool[indicies[i]];
+			dxRender->bindConstantBuffer(type, (UINT)i, cb.ringFirstConstant, cb.ringNumConstants);
+		}
+	};
+
+	bindStage(SHADER_TYPE::SHADER_VERTEX, v._bufferIndicies);
+	bindStage(SHADER_TYPE::SHADER_FRAGMENT, f._bufferIndicies);
+	if (gs())
+		bindStage(SHADER_TYPE::SHADER_GEOMETRY, g._bufferIndicies);
+}
+
+API DX11Shader::GetUniformBlockHandle(const char *name, OUT uint *handle)
+{
+	auto it = _blockHandles.find(name);
+	*handle = it == _blockHandles.end() ? SHADER_PARAMETER_INVALID : it->second;
+	return *handle == SHADER_PARAMETER_INVALID ? E_FAIL : S_OK;
+}
+
+API DX11Shader::SetUniformBlock(uint handle, const void *data)
+{
+	if (handle >= _blocks.size())
+		return S_OK;
+
+	ConstantBuffer &cb = ConstantBufferPool[_blocks[handle]];
+	if (memcmp(cb.data.get(), data, cb.bytes))
+	{
+		memcpy(cb.data.get(), data, cb.bytes);
+		cb.needFlush = true;
+	}
+
+	return S_OK;
+}
+
 API DX11Shader::FlushParameters()
 {
+	if (getDX11CoreRender()->constantBufferRing().isInitialized())
+	{
+		uploadBuffers();
+		return S_OK;
+	}
+
 	ID3D11DeviceContext *ctx = getContext(_pCore);
 
 	auto updateBuffers = [ctx](vector<size_t>& indicies)
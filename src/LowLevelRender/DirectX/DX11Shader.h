@@ -22,6 +22,9 @@ class DX11Shader : public ICoreShader
 		// all buffers need to bind for work with shader
 		// slot -> index of Constant Buffer in ConstantBufferPool
 		vector<size_t> _bufferIndicies;
+
+		// kept for shader binary cache
+		vector<uint8> bytecode;
 	};
 
 	struct Parameter
@@ -29,14 +32,23 @@ class DX11Shader : public ICoreShader
 		int bufferIndex = -1; // index of ConstantBuffer in ConstantBufferPool
 		int parameterIndex = -1; // index in ConstantBuffer::parameters
 	};
-	std::unordered_map<string, Parameter> _parameters; // all shader parameters
+	vector<Parameter> _parameters; // all shader parameters, index is parameter handle
+	std::unordered_map<string, uint> _parameterHandles;
+
+	// Typed blocks: handle -> index of ConstantBuffer in ConstantBufferPool
+	vector<size_t> _blocks;
+	std::unordered_map<string, uint> _blockHandles;
 
 	SubShader v{};
 	SubShader f{};
 	SubShader g{};
 
 	void initSubShader(ShaderInitData& data, SHADER_TYPE type);
+	void addParameter(const string& name, const Parameter& p);
+	void addBlock(const string& name, size_t bufferIndex);
 	void setParameter(const char *name, const void *data);
+	void setParameter(uint handle, const void *data);
+	void uploadBuffers();
 
 public:
 
@@ -47,12 +59,21 @@ public:
 	ID3D11GeometryShader*	gs() const { return g.pointer.pGeometry; }
 	ID3D11PixelShader*		fs() const { return f.pointer.pFragment; }
 
+	const vector<uint8>& bytecode(SHADER_TYPE type) const;
+
 	void bind();
 
 	API SetFloatParameter(const char* name, float value) override;
 	API SetVec4Parameter(const char* name, const vec4 *value) override;
 	API SetMat4Parameter(const char* name, const mat4 *value) override;
 	API SetUintParameter(const char* name, uint value) override;
+	API GetParameterHandle(const char* name, OUT uint *handle) override;
+	API SetFloatParameter(uint handle, float value) override;
+	API SetVec4Parameter(uint handle, const vec4 *value) override;
+	API SetMat4Parameter(uint handle, const mat4 *value) override;
+	API SetUintParameter(uint handle, uint value) override;
+	API GetUniformBlockHandle(const char* name, OUT uint *handle) override;
+	API SetUniformBlock(uint handle, const void *data) override;
 	API FlushParameters() override;
 };
 
@@ -11,10 +11,75 @@ extern Core *_pCore;
 DEFINE_DEBUG_LOG_HELPERS(_pCore)
 DEFINE_LOG_HELPERS(_pCore)
 
-#define TEXTURE_NAME "_texture_"
 #define DONT_CHECK_GL_ERRORS 1
 
 vector<UBO> UBOpool;
+UniformBufferIndex<UBO> UBOpoolIndex;
+
+bool UBORingBuffer::init(size_t frameBytes)
+{
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	_alignment = std::max(alignment, 1);
+	_frameBytes = (frameBytes + _alignment - 1) / _alignment * _alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &_ID);
+	glNamedBufferStorage(_ID, _frameBytes * UBO_RING_FRAMES, nullptr, flags);
+	_mapped = static_cast<uint8*>(glMapNamedBufferRange(_ID, 0, _frameBytes * UBO_RING_FRAMES, flags));
+
+	if (!_mapped)
+	{
+		free();
+		return false;
+	}
+
+	return true;
+}
+
+void UBORingBuffer::free()
+{
+	for (GLsync &fence : _fences)
+		if (fence) { glDeleteSync(fence); fence = nullptr; }
+
+	if (_mapped) { glUnmapNamedBuffer(_ID); _mapped = nullptr; }
+	if (_ID) { glDeleteBuffers(1, &_ID); _ID = 0u; }
+}
+
+void UBORingBuffer::nextFrame()
+{
+	if (!_mapped)
+		return;
+
+	_fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	_region = (_region + 1) % UBO_RING_FRAMES;
+	_offset = 0u;
+	_frame++;
+
+	// Usually signaled long ago. Waits only if GPU is more than UBO_RING_FRAMES - 1 frames behind
+	GLsync &fence = _fences[_region];
+	if (fence)
+	{
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, ~0ull);
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+bool UBORingBuffer::allocate(size_t bytes, OUT GLintptr& offset, OUT uint8 *&pointer)
+{
+	const size_t aligned = (bytes + _alignment - 1) / _alignment * _alignment;
+	if (_offset + aligned > _frameBytes)
+		return false;
+
+	offset = (GLintptr)(_region * _frameBytes + _offset);
+	pointer = _mapped + offset;
+	_offset += aligned;
+
+	return true;
+}
 
 
 GLMesh *getGLMesh(IMesh *mesh)
@@ -41,6 +106,44 @@ GLRenderTarget *getGLRenderTarget(IRenderTarget *rt)
 	return static_cast<GLRenderTarget*>(crt);
 }
 
+GLenum eng_to_gl_blend(BLEND_FACTOR f)
+{
+	switch(f)
+	{
+		case BLEND_FACTOR::NONE:
+		case BLEND_FACTOR::ZERO:				return GL_ZERO;
+		case BLEND_FACTOR::ONE:					return GL_ONE;
+		case BLEND_FACTOR::SRC_COLOR:			return GL_SRC_COLOR;
+		case BLEND_FACTOR::ONE_MINUS_SRC_COLOR:	return GL_ONE_MINUS_SRC_COLOR;
+		case BLEND_FACTOR::SRC_ALPHA:			return GL_SRC_ALPHA;
+		case BLEND_FACTOR::ONE_MINUS_SRC_ALPHA:	return GL_ONE_MINUS_SRC_ALPHA;
+		case BLEND_FACTOR::DEST_ALPHA:			return GL_DST_ALPHA;
+		case BLEND_FACTOR::ONE_MINUS_DEST_ALPHA:return GL_ONE_MINUS_DST_ALPHA;
+		case BLEND_FACTOR::DEST_COLOR:			return GL_DST_COLOR;
+		case BLEND_FACTOR::ONE_MINUS_DEST_COLOR:return GL_ONE_MINUS_DST_COLOR;
+	}
+	return GL_ZERO;
+}
+
+// Arguments of glVertexAttribPointer()
+struct GLVertexFormat
+{
+	GLint components;
+	GLenum type;
+	GLboolean normalized;
+};
+
+GLVertexFormat eng_to_gl_vertex_format(const VertexAttributeDesc& a)
+{
+	switch (a.format)
+	{
+		case VERTEX_FORMAT::HALF:		return {4, GL_HALF_FLOAT, GL_FALSE};
+		case VERTEX_FORMAT::OCTAHEDRAL:	return {a.attribute == INPUT_ATTRUBUTE::TANGENT ? 4 : 2, GL_SHORT, GL_TRUE};
+		case VERTEX_FORMAT::UNORM16:	return {2, GL_UNSIGNED_SHORT, GL_TRUE};
+		default:						return {a.attribute == INPUT_ATTRUBUTE::TEX_COORD ? 2 : 4, GL_FLOAT, GL_FALSE};
+	}
+}
+
 PIXELFORMATDESCRIPTOR pfd{};
 
 void CHECK_GL_ERRORS()
@@ -343,6 +446,10 @@ API GLCoreRender::Init(const WindowHandle* handle, int MSAASamples, int VSyncOn)
 	glGetBooleanv(GL_DEPTH_TEST, &depthTest);
 	assert(_state.depthTest == (bool)depthTest && "Incorrect default state");
 
+	GLboolean depthMask;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	assert(_state.depthWrite == (bool)depthMask && "Incorrect default state");
+
 	GLint vp[4];
 	glGetIntegerv(GL_VIEWPORT, vp);
 	_state.x = vp[0];
@@ -359,16 +466,60 @@ API GLCoreRender::Init(const WindowHandle* handle, int MSAASamples, int VSyncOn)
 	glClearDepth(1.0f);
 	glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE); // to DirectX conformity
 
+	if (!_uboRing.init(UBO_RING_FRAME_BYTES))
+		LOG_WARNING("GLCoreRender::Init(): can't create persistently mapped uniform buffer. Uniform blocks will be updated in place");
+
+	// Let driver choose number of threads for StartShaderCompile()
+	if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	// Program binaries are valid only for the same driver
+	_shaderCompilerVersion = string((const char*)glGetString(GL_VENDOR)) + ' ' + (const char*)glGetString(GL_RENDERER) + ' ' + (const char*)glGetString(GL_VERSION);
+
 	CHECK_GL_ERRORS();
 
+	_pCore->AddProfilerCallback(this);
+
 	LOG("GLCoreRender initalized");
 
 	return S_OK;
 }
 
+uint GLCoreRender::getNumLines()
+{
+	return 3;
+}
+
+string GLCoreRender::getString(uint i)
+{
+	switch (i)
+	{
+		case 0: return "==== GLCoreRender ====";
+		case 1: return "Uniform buffers: " + std::to_string(UBOpool.size()) + " (shared: " + std::to_string(UBOpoolIndex.shared()) + ", unique: " + std::to_string(UBOpoolIndex.unique()) + ", blocks reused: " + std::to_string(UBOpoolIndex.reused()) + ")";
+		case 2: return _stateStats.toString();
+	}
+	assert(false);
+	return "";
+}
+
 API GLCoreRender::Free()
 {
+	_pCore->RemoveProfilerCallback(this);
+
 	UBOpool.clear();
+	UBOpoolIndex.clear();
+	_uboRing.free();
+	_uniformBlocks.clear();
+
+	for (StructuredBufferPtr& b : _structuredBufferBindings)
+		b = nullptr;
+
+	_savedStates.clear();
+	_savedStatesNum = 0u;
+
+	for (auto& it : _pendingPrograms)
+		deletePendingProgram(it.second);
+	_pendingPrograms.clear();
 
 	wglMakeCurrent(nullptr, nullptr);
 	wglDeleteContext(_hRC);
@@ -422,28 +573,49 @@ API GLCoreRender::MakeCurrent(const WindowHandle* handle)
 API GLCoreRender::SwapBuffers()
 {
 	CHECK_GL_ERRORS();
+	_uboRing.nextFrame();
+	_stateStats.nextFrame();
 	::SwapBuffers(_hdc);
 	CHECK_GL_ERRORS();
 	return S_OK;
 }
 
+void GLCoreRender::bindUniformBuffer(GLuint slot, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (slot < MAX_UNIFORM_BINDINGS)
+	{
+		UniformBinding &b = _uniformBindings[slot];
+		if (b.buffer == buffer && b.offset == offset && b.size == size)
+		{
+			_stateStats.filtered();
+			return;
+		}
+
+		b = {buffer, offset, size};
+	}
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, slot, buffer, offset, size);
+	_stateStats.issued();
+}
+
 API GLCoreRender::CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc, const MeshIndexDesc *indexDesc, VERTEX_TOPOLOGY mode)
 {
+	if (const char *error = meshDataDescError(*dataDesc))
+	{
+		LOG_WARNING_FORMATTED("GLCoreRender::CreateMesh(): %s", error);
+		*pMesh = nullptr;
+		return E_INVALIDARG;
+	}
+
 	const int indexes = indexDesc->format != MESH_INDEX_FORMAT::NOTHING;
-	const int normals = dataDesc->normalsPresented;
-	const int texCoords = dataDesc->texCoordPresented;
-	const int colors = dataDesc->colorPresented;
-	const int bytes = (16 + 16 * normals + 8 * texCoords + 16 * colors) * dataDesc->numberOfVertex;
+	const size_t bytes = meshDataBytes(*dataDesc);
+
+	VertexAttributeDesc attributes[MAX_VERTEX_ATTRIBUTES];
+	const uint attributesNum = meshVertexAttributes(attributes, *dataDesc);
 
 	GLuint vao = 0u, vbo = 0u, ibo = 0u;
 
-	INPUT_ATTRUBUTE attribs = INPUT_ATTRUBUTE::POSITION;
-	if (dataDesc->normalsPresented)
-		attribs = attribs | INPUT_ATTRUBUTE::NORMAL;
-	if (dataDesc->texCoordPresented)
-		attribs = attribs | INPUT_ATTRUBUTE::TEX_COORD;
-	if (dataDesc->colorPresented)
-		attribs = attribs | INPUT_ATTRUBUTE::COLOR;
+	INPUT_ATTRUBUTE attribs = meshAttributes(*dataDesc);
 
 	CHECK_GL_ERRORS();
 
@@ -456,25 +628,13 @@ API GLCoreRender::CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc
 	const GLenum glBufferType = GL_STATIC_DRAW; // TODO: GL_DYNAMIC_DRAW;
 	glBufferData(GL_ARRAY_BUFFER, bytes, reinterpret_cast<const void*>(dataDesc->pData), glBufferType); // send data to VRAM
 
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, dataDesc->positionStride, reinterpret_cast<const void*>((long long)dataDesc->positionOffset));
-	glEnableVertexAttribArray(0);
-	
-	if (normals)
+	for (uint i = 0; i < attributesNum; i++)
 	{
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, dataDesc->normalStride, reinterpret_cast<const void*>((long long)dataDesc->normalOffset));
-		glEnableVertexAttribArray(1);
-	}
-	
-	if (texCoords)
-	{
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, dataDesc->texCoordStride, reinterpret_cast<const void*>((long long)dataDesc->texCoordOffset));
-		glEnableVertexAttribArray(2);
-	}
+		const VertexAttributeDesc& a = attributes[i];
+		const GLVertexFormat f = eng_to_gl_vertex_format(a);
 
-	if (colors)
-	{
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, dataDesc->colorStride, reinterpret_cast<const void*>((long long)dataDesc->colorOffset));
-		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(a.location, f.components, f.type, f.normalized, a.stride, reinterpret_cast<const void*>((long long)a.offset));
+		glEnableVertexAttribArray(a.location);
 	}
 	
 	if (indexes)
@@ -504,6 +664,15 @@ API GLCoreRender::CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc
 
 API GLCoreRender::CreateShader(OUT ICoreShader **pShader, const char *vertText, const char *fragText, const char *geomText)
 {
+	// Compilation started by StartShaderCompile()
+	auto pending = _pendingPrograms.find(programKey(vertText, fragText, geomText));
+	if (pending != _pendingPrograms.end())
+	{
+		const PendingProgram p = pending->second;
+		_pendingPrograms.erase(pending);
+		return finishPendingProgram(pShader, p);
+	}
+
 	GLuint vertID = 0u;
 	GLuint geomID = 0u;
 	GLuint fragID = 0u;
@@ -511,6 +680,7 @@ API GLCoreRender::CreateShader(OUT ICoreShader **pShader, const char *vertText,
 	CHECK_GL_ERRORS();
 
 	GLuint programID = glCreateProgram();
+	glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	
 	if (!createShader(vertID, GL_VERTEX_SHADER, vertText, programID))
 	{
@@ -545,6 +715,186 @@ API GLCoreRender::CreateShader(OUT ICoreShader **pShader, const char *vertText,
 	return S_OK;
 }
 
+// Binary layout: | GLenum binary format | program binary |
+API GLCoreRender::CreateShaderFromBinary(OUT ICoreShader **pShader, const uint8 *data, uint size)
+{
+	*pShader = nullptr;
+
+	if (size <= sizeof(GLenum))
+		return E_FAIL;
+
+	GLenum format;
+	memcpy(&format, data, sizeof(GLenum));
+
+	CHECK_GL_ERRORS();
+
+	GLuint programID = glCreateProgram();
+	glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glProgramBinary(programID, format, data + sizeof(GLenum), (GLsizei)(size - sizeof(GLenum)));
+
+	// Driver rejects binaries from other driver versions or GPUs. It's not an error
+	GLint linked = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	glGetError();
+
+	if (linked != GL_TRUE)
+	{
+		glDeleteProgram(programID);
+		return E_FAIL;
+	}
+
+	*pShader = new GLShader(programID, 0u, 0u, 0u);
+
+	return S_OK;
+}
+
+API GLCoreRender::CompileShaderBinary(OUT uint8 **data, OUT uint *size, const char *vertText, const char *fragText, const char *geomText)
+{
+	// Program can be compiled only in thread with current context
+	*data = nullptr;
+	*size = 0;
+	return E_NOTIMPL;
+}
+
+API GLCoreRender::GetShaderCompilerVersion(OUT const char **pVersion)
+{
+	*pVersion = _shaderCompilerVersion.c_str();
+	return S_OK;
+}
+
+uint64_t GLCoreRender::programKey(const char *vertText, const char *fragText, const char *geomText)
+{
+	uint64_t h = HASH_SEED;
+	h = hashString(h, vertText);
+	h = hashString(h, fragText);
+	h = hashString(h, geomText);
+	return h;
+}
+
+void GLCoreRender::deletePendingProgram(const PendingProgram& p)
+{
+	glDeleteProgram(p.programID);
+	glDeleteShader(p.vertID);
+	if (p.geomID)
+		glDeleteShader(p.geomID);
+	glDeleteShader(p.fragID);
+}
+
+API GLCoreRender::StartShaderCompile(const char *vertText, const char *fragText, const char *geomText)
+{
+	if (!GLEW_ARB_parallel_shader_compile)
+		return E_NOTIMPL;
+
+	const uint64_t key = programKey(vertText, fragText, geomText);
+	if (_pendingPrograms.find(key) != _pendingPrograms.end())
+		return S_OK;
+
+	CHECK_GL_ERRORS();
+
+	// Nothing is queried here: any status query waits for driver
+	const auto compile = [](GLenum type, const char *text, GLuint programID) -> GLuint
+	{
+		GLuint id = glCreateShader(type);
+		glShaderSource(id, 1, (const GLchar **)&text, nullptr);
+		glCompileShader(id);
+		glAttachShader(programID, id);
+		return id;
+	};
+
+	PendingProgram p{};
+	p.programID = glCreateProgram();
+	glProgramParameteri(p.programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	p.vertID = compile(GL_VERTEX_SHADER, vertText, p.programID);
+	if (geomText != nullptr)
+		p.geomID = compile(GL_GEOMETRY_SHADER, geomText, p.programID);
+	p.fragID = compile(GL_FRAGMENT_SHADER, fragText, p.programID);
+	glLinkProgram(p.programID);
+
+	CHECK_GL_ERRORS();
+
+	_pendingPrograms.emplace(key, p);
+
+	return S_OK;
+}
+
+API GLCoreRender::IsShaderCompiling(OUT int *compiling, const char *vertText, const char *fragText, const char *geomText)
+{
+	*compiling = 0;
+
+	auto it = _pendingPrograms.find(programKey(vertText, fragText, geomText));
+	if (it == _pendingPrograms.end())
+		return S_OK;
+
+	GLint completed = GL_TRUE;
+	glGetProgramiv(it->second.programID, GL_COMPLETION_STATUS_ARB, &completed);
+	*compiling = completed == GL_FALSE;
+
+	return S_OK;
+}
+
+API GLCoreRender::CancelShaderCompile(const char *vertText, const char *fragText, const char *geomText)
+{
+	auto it = _pendingPrograms.find(programKey(vertText, fragText, geomText));
+	if (it != _pendingPrograms.end())
+	{
+		deletePendingProgram(it->second);
+		_pendingPrograms.erase(it);
+	}
+	return S_OK;
+}
+
+// Waits for driver if compilation is not finished yet
+HRESULT GLCoreRender::finishPendingProgram(OUT ICoreShader **pShader, const PendingProgram& p)
+{
+	HRESULT err = S_OK;
+
+	if (!checkShaderErrors(p.vertID, GL_COMPILE_STATUS))
+		err = E_VERTEX_SHADER_FAILED_COMPILE;
+	else if (p.geomID && !checkShaderErrors(p.geomID, GL_COMPILE_STATUS))
+		err = E_GEOM_SHADER_FAILED_COMPILE;
+	else if (!checkShaderErrors(p.fragID, GL_COMPILE_STATUS))
+		err = E_FRAGMENT_SHADER_FAILED_COMPILE;
+	else if (!checkShaderErrors(p.programID, GL_LINK_STATUS))
+		err = E_FAIL;
+
+	if (FAILED(err))
+	{
+		deletePendingProgram(p);
+		return err;
+	}
+
+	CHECK_GL_ERRORS();
+
+	*pShader = new GLShader(p.programID, p.vertID, p.geomID, p.fragID);
+
+	return S_OK;
+}
+
+API GLCoreRender::GetShaderBinary(ICoreShader *pShader, OUT uint8 *data, OUT uint *size)
+{
+	GLShader *glShader = static_cast<GLShader*>(pShader);
+
+	CHECK_GL_ERRORS();
+
+	GLint length = 0;
+	glGetProgramiv(glShader->programID(), GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return E_FAIL;
+
+	*size = (uint)(sizeof(GLenum) + length);
+
+	if (data == nullptr)
+		return S_OK;
+
+	GLenum format;
+	glGetProgramBinary(glShader->programID(), length, nullptr, &format, data + sizeof(GLenum));
+	memcpy(data, &format, sizeof(GLenum));
+
+	CHECK_GL_ERRORS();
+
+	return S_OK;
+}
+
 void getGLFormats(TEXTURE_FORMAT format, GLint& VRAMFormat, GLenum& sourceFormat, GLenum& sourceType)
 {
 	switch (format)
@@ -651,114 +1001,220 @@ API GLCoreRender::CreateStructuredBuffer(OUT ICoreStructuredBuffer **pStructured
 	return S_OK;
 }
 
-API GLCoreRender::PushStates()
+API GLCoreRender::RegisterUniformBlock(const UniformBlockDesc *desc)
 {
-	_statesStack.push(_state);
+	_uniformBlocks[string("ubo_") + desc->name] = UniformBlockLayout(*desc);
 	return S_OK;
 }
 
-API GLCoreRender::PopStates()
+UniformBlockLayout* GLCoreRender::uniformBlock(const char *blockName)
 {
-	State& state = _statesStack.top();
+	auto it = _uniformBlocks.find(blockName);
+	return it == _uniformBlocks.end() ? nullptr : &it->second;
+}
 
-	// Blending
-	//
-	if (_state.blending != state.blending)
+API GLCoreRender::CreatePipelineState(OUT ICorePipelineState **pState, const PipelineStateDesc *desc)
+{
+	if (const char *error = pipelineStateDescError(*desc))
 	{
-		if (state.blending)
-			glEnable(GL_BLEND);
-		else
-			glDisable(GL_BLEND);
+		LOG_WARNING_FORMATTED("GLCoreRender::CreatePipelineState(): %s", error);
+		*pState = nullptr;
+		return E_INVALIDARG;
 	}
-	if (_state.srcBlend != state.srcBlend || _state.dstBlend != state.dstBlend)
-		glBlendFunc(state.srcBlend, state.dstBlend);
 
-	// Rasterizer
-	//
-	if (state.culling != _state.culling)
+	*pState = new GLPipelineState(*desc, ++_pipelineStatesCreated);
+
+	return S_OK;
+}
+
+void GLCoreRender::saveStateSlow(uint32_t field)
+{
+	SavedState &saved = _savedStates[_savedStatesNum - 1];
+	const uint32_t fresh = field & ~saved.changed;
+	saved.changed |= field;
+
+	State &v = saved.values;
+
+	switch (field)
 	{
-		if (state.culling)
+		case STATE_BLEND:
+			v.blending = _state.blending;
+			v.srcBlend = _state.srcBlend;
+			v.dstBlend = _state.dstBlend;
+			break;
+		case STATE_RASTER:
+			v.culling = _state.culling;
+			v.cullingMode = _state.cullingMode;
+			v.polygonMode = _state.polygonMode;
+			break;
+		case STATE_DEPTH:
+			v.depthTest = _state.depthTest;
+			v.depthWrite = _state.depthWrite;
+			break;
+		case STATE_VIEWPORT:
+			v.x = _state.x;
+			v.y = _state.y;
+			v.width = _state.width;
+			v.heigth = _state.heigth;
+			break;
+		case STATE_SHADER: v.shader = _state.shader; break;
+		case STATE_MESH: v.mesh = _state.mesh; break;
+		case STATE_RENDER_TARGET: v.renderTarget = _state.renderTarget; break;
+		default:
 		{
-			glEnable(GL_CULL_FACE);
-			if (state.cullingMode != _state.cullingMode)
-				glCullFace(state.cullingMode);
-		}
-		else
-			glDisable(GL_CULL_FACE);
+			for (int i = 0; i < MAX_TEXTURE_SLOTS; i++)
+				if (fresh & (STATE_TEXTURE_0 << i))
+					v.texShaderBindings[i] = _state.texShaderBindings[i];
+		} break;
 	}
-	if (state.polygonMode != _state.polygonMode)
-		glPolygonMode(GL_FRONT_AND_BACK, _state.polygonMode);
+}
+
+API GLCoreRender::PushStates()
+{
+	if (_savedStatesNum == _savedStates.size())
+		_savedStates.emplace_back();
 
+	SavedState &saved = _savedStates[_savedStatesNum++];
+	saved.changed = 0u;
+	saved.pipelineState = _state.pipelineState;
+	saved.pipelineAttributes = _state.pipelineAttributes;
 
-	// Depth/Stencil
-	//
-	if (state.depthTest != _state.depthTest)
+	return S_OK;
+}
+
+API GLCoreRender::PopStates()
+{
+	assert(_savedStatesNum > 0 && "GLCoreRender::PopStates(): no states pushed");
+
+	SavedState &saved = _savedStates[--_savedStatesNum];
+	State &state = saved.values;
+	const uint32_t changed = saved.changed;
+
+	// Fields are compared because they can be changed and then set back
+
+	if (changed & STATE_BLEND)
 	{
-		if (state.depthTest)
-			glEnable(GL_DEPTH_TEST);
-		else
-			glDisable(GL_DEPTH_TEST);
+		if (_state.blending != state.blending)
+		{
+			if (state.blending)
+				glEnable(GL_BLEND);
+			else
+				glDisable(GL_BLEND);
+		}
+		if (_state.srcBlend != state.srcBlend || _state.dstBlend != state.dstBlend)
+			glBlendFunc(state.srcBlend, state.dstBlend);
+
+		_state.blending = state.blending;
+		_state.srcBlend = state.srcBlend;
+		_state.dstBlend = state.dstBlend;
 	}
 
-	// Viewport
-	//
-	if (state.x != _state.x || state.y != _state.y ||
-		state.width != _state.width || state.heigth != _state.heigth)
-		glViewport(state.x, state.y, state.width, state.heigth);
+	if (changed & STATE_RASTER)
+	{
+		if (state.culling != _state.culling)
+		{
+			if (state.culling)
+				glEnable(GL_CULL_FACE);
+			else
+				glDisable(GL_CULL_FACE);
+		}
+		if (state.cullingMode != _state.cullingMode)
+			glCullFace(state.cullingMode);
+		if (state.polygonMode != _state.polygonMode)
+			glPolygonMode(GL_FRONT_AND_BACK, state.polygonMode);
+
+		_state.culling = state.culling;
+		_state.cullingMode = state.cullingMode;
+		_state.polygonMode = state.polygonMode;
+	}
 
-	// Shader
-	//
-	if (state.shader.Get() != _state.shader.Get())
-	{		
-		if (state.shader.Get())
+	if (changed & STATE_DEPTH)
+	{
+		if (state.depthTest != _state.depthTest)
 		{
-			GLShader *glShader = getGLShader(state.shader.Get());
-			glUseProgram(glShader->programID());
-		} else
-			glUseProgram(0);
+			if (state.depthTest)
+				glEnable(GL_DEPTH_TEST);
+			else
+				glDisable(GL_DEPTH_TEST);
+		}
+		if (state.depthWrite != _state.depthWrite)
+			glDepthMask(state.depthWrite);
+
+		_state.depthTest = state.depthTest;
+		_state.depthWrite = state.depthWrite;
 	}
 
-	// Textures
-	//
+	if (changed & STATE_VIEWPORT)
 	{
-		GLShader *glShader = getGLShader(_state.shader.Get());
+		if (state.x != _state.x || state.y != _state.y ||
+			state.width != _state.width || state.heigth != _state.heigth)
+			glViewport(state.x, state.y, state.width, state.heigth);
+
+		_state.x = state.x;
+		_state.y = state.y;
+		_state.width = state.width;
+		_state.heigth = state.heigth;
+	}
 
-		for (int i = 0; i < MAX_TEXTURE_SLOTS; i++)
+	if (changed & STATE_SHADER)
+	{
+		if (state.shader.Get() != _state.shader.Get())
 		{
-			if (state.texShaderBindings[i].Get() != _state.texShaderBindings[i].Get())
+			if (state.shader.Get())
 			{
-				if (state.texShaderBindings[i].Get())
-				{
-					// texture -> slot
-					GLTexture *glTex = getGLTexture(state.texShaderBindings[i].Get());
-					glBindTextureUnit(i, glTex->textureID());
-
-					// shader variable -> slot
-					GLint location = glGetUniformLocation(glShader->programID(), (TEXTURE_NAME + std::to_string(i)).c_str());
-					glUniform1i(location, i);
-				} else
-					glBindTextureUnit(i, 0);
-			}
+				// Uniform blocks of restored shader are bound to other ranges
+				GLShader *glShader = getGLShader(state.shader.Get());
+				glShader->bind();
+			} else
+				glUseProgram(0);
 		}
+		_state.shader = std::move(state.shader);
+	}
+
+	if (changed & STATE_MESH)
+	{
+		if (state.mesh.Get() != _state.mesh.Get())
+			glBindVertexArray(state.mesh.Get() ? getGLMesh(state.mesh.Get())->VAO_ID() : 0);
+		_state.mesh = std::move(state.mesh);
 	}
 
-	// Framebuffer
-	// TODO
+	if (changed & STATE_RENDER_TARGET)
+	{
+		if (state.renderTarget.Get() != _state.renderTarget.Get())
+			glBindFramebuffer(GL_FRAMEBUFFER, state.renderTarget.Get() ? getGLRenderTarget(state.renderTarget.Get())->ID() : 0);
+		_state.renderTarget = std::move(state.renderTarget);
+	}
 
-	// Clear
+	// Textures
+	// Shader variable -> slot is set at link time
 	//
-	if (state.clearColor[0] != _state.clearColor[0] || state.clearColor[1] != _state.clearColor[1] ||
-		state.clearColor[2] != _state.clearColor[2] || state.clearColor[3] != _state.clearColor[3])
-		glClearColor(state.clearColor[0], state.clearColor[1], state.clearColor[2], state.clearColor[3]);
+	if (changed >= STATE_TEXTURE_0)
+	{
+		for (int i = 0; i < MAX_TEXTURE_SLOTS; i++)
+		{
+			if (!(changed & (STATE_TEXTURE_0 << i)))
+				continue;
+
+			ITexture *tex = state.texShaderBindings[i].Get();
+			if (tex != _state.texShaderBindings[i].Get())
+				glBindTextureUnit(i, tex ? getGLTexture(tex)->textureID() : 0);
 
-	_state = state;
-	_statesStack.pop();
+			_state.texShaderBindings[i] = std::move(state.texShaderBindings[i]);
+		}
+	}
+
+	if (changed)
+	{
+		_state.pipelineState = saved.pipelineState;
+		_state.pipelineAttributes = saved.pipelineAttributes;
+	}
 
 	return S_OK;
 }
 
 API GLCoreRender::SetCurrentRenderTarget(IRenderTarget *pRenderTarget)
 {
+	saveState(STATE_RENDER_TARGET);
 	_state.renderTarget = RenderTargetPtr(pRenderTarget);
 
 	GLRenderTarget *glRT = getGLRenderTarget(pRenderTarget);
@@ -793,17 +1249,117 @@ API GLCoreRender::SetCurrentRenderTarget(IRenderTarget *pRenderTarget)
 
 API GLCoreRender::RestoreDefaultRenderTarget()
 {
+	saveState(STATE_RENDER_TARGET);
 	_state.renderTarget = RenderTargetPtr();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	return S_OK;
 }
 
+API GLCoreRender::SetPipelineState(ICorePipelineState *state)
+{
+	if (!state)
+		return E_INVALIDARG;
+
+	GLPipelineState *pso = static_cast<GLPipelineState*>(state);
+
+	if (_state.pipelineState == pso->id())
+	{
+		_stateStats.filtered();
+		return S_OK;
+	}
+
+	CHECK_GL_ERRORS();
+
+	SetShader(pso->desc().shader);
+
+	// Blending
+	//
+	if (pso->blending != _state.blending)
+	{
+		if (pso->blending)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+		saveState(STATE_BLEND);
+		_state.blending = pso->blending;
+		_stateStats.issued();
+	}
+	if (pso->srcBlend != _state.srcBlend || pso->dstBlend != _state.dstBlend)
+	{
+		glBlendFunc(pso->srcBlend, pso->dstBlend);
+		saveState(STATE_BLEND);
+		_state.srcBlend = pso->srcBlend;
+		_state.dstBlend = pso->dstBlend;
+		_stateStats.issued();
+	}
+
+	// Rasterizer
+	//
+	if (pso->culling != _state.culling)
+	{
+		if (pso->culling)
+			glEnable(GL_CULL_FACE);
+		else
+			glDisable(GL_CULL_FACE);
+		saveState(STATE_RASTER);
+		_state.culling = pso->culling;
+		_stateStats.issued();
+	}
+	if (pso->cullingMode != _state.cullingMode)
+	{
+		glCullFace(pso->cullingMode);
+		saveState(STATE_RASTER);
+		_state.cullingMode = pso->cullingMode;
+		_stateStats.issued();
+	}
+	if (pso->polygonMode != _state.polygonMode)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, pso->polygonMode);
+		saveState(STATE_RASTER);
+		_state.polygonMode = pso->polygonMode;
+		_stateStats.issued();
+	}
+
+	// Depth/Stencil
+	//
+	if (pso->depthTest != _state.depthTest)
+	{
+		if (pso->depthTest)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+		saveState(STATE_DEPTH);
+		_state.depthTest = pso->depthTest;
+		_stateStats.issued();
+	}
+	if (pso->depthWrite != _state.depthWrite)
+	{
+		glDepthMask(pso->depthWrite);
+		saveState(STATE_DEPTH);
+		_state.depthWrite = pso->depthWrite;
+		_stateStats.issued();
+	}
+
+	_state.pipelineState = pso->id();
+	_state.pipelineAttributes = pso->desc().attributes;
+
+	CHECK_GL_ERRORS();
+
+	return S_OK;
+}
+
 API GLCoreRender::SetShader(IShader* pShader)
 {
 	if (_state.shader.Get() == pShader)
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
 
+	saveState(STATE_SHADER);
 	_state.shader = ShaderPtr(pShader);
+	_state.pipelineState = 0u;
+	_stateStats.issued();
 
 	CHECK_GL_ERRORS();
 	
@@ -823,11 +1379,16 @@ API GLCoreRender::SetShader(IShader* pShader)
 API GLCoreRender::SetMesh(IMesh* mesh)
 {
 	if (_state.mesh.Get() == mesh)
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
 
 	CHECK_GL_ERRORS();
 
+	saveState(STATE_MESH);
 	_state.mesh = MeshPtr(mesh);
+	_stateStats.issued();
 
 	if (mesh == nullptr)
 		glBindVertexArray(0);
@@ -844,6 +1405,19 @@ API GLCoreRender::SetMesh(IMesh* mesh)
 
 API GLCoreRender::SetStructuredBufer(uint slot, IStructuredBuffer *buffer)
 {
+	if (slot < MAX_STRUCTURED_BUFFER_BINDINGS)
+	{
+		if (_structuredBufferBindings[slot].Get() == buffer)
+		{
+			_stateStats.filtered();
+			return S_OK;
+		}
+
+		_structuredBufferBindings[slot] = buffer;
+	}
+
+	_stateStats.issued();
+
 	if (buffer)
 	{
 		ICoreStructuredBuffer *coreBuffer;
@@ -860,28 +1434,25 @@ API GLCoreRender::BindTexture(uint slot, ITexture *texture)
 {
 	assert(slot < MAX_TEXTURE_SLOTS);
 
+	if (_state.texShaderBindings[slot].Get() == texture)
+	{
+		_stateStats.filtered();
+		return S_OK;
+	}
+
 	CHECK_GL_ERRORS();
 
-	if (_state.texShaderBindings[slot].Get() != texture)
+	// Shader variable -> slot is set at link time (GLShader::GLShader())
+	if (texture)
 	{
-		GLShader *glShader = getGLShader(_state.shader.Get());
-		GLint location = glGetUniformLocation(glShader->programID(), (TEXTURE_NAME + std::to_string(slot)).c_str());
-		if (location > -1)
-		{
-			// shader variable -> slot
-			glUniform1i(location, slot);
-
-			// texture -> slot
-			if (texture)
-			{
-				GLTexture *glTex = getGLTexture(texture);
-				glBindTextureUnit(slot, glTex->textureID());
-			} else
-				glBindTextureUnit(slot, 0);
+		GLTexture *glTex = getGLTexture(texture);
+		glBindTextureUnit(slot, glTex->textureID());
+	} else
+		glBindTextureUnit(slot, 0);
 
-			_state.texShaderBindings[slot] = texture;
-		}
-	}
+	saveState(STATE_TEXTURE_0 << slot);
+	_state.texShaderBindings[slot] = texture;
+	_stateStats.issued();
 
 	CHECK_GL_ERRORS();
 
@@ -895,6 +1466,12 @@ API GLCoreRender::UnbindAllTextures()
 	static const GLuint zeroTex[MAX_TEXTURE_SLOTS] = {};
 	glBindTextures(0, MAX_TEXTURE_SLOTS, zeroTex);
 
+	uint32_t bound = 0u;
+	for (int i = 0; i < MAX_TEXTURE_SLOTS; i++)
+		if (_state.texShaderBindings[i].Get())
+			bound |= STATE_TEXTURE_0 << i;
+	saveState(bound);
+
 	for (int i = 0; i < MAX_TEXTURE_SLOTS; i++)
 		_state.texShaderBindings[i] = nullptr;
 
@@ -912,6 +1489,15 @@ API GLCoreRender::Draw(IMesh *mesh, uint instances)
 	if (_state.mesh.Get() != mesh)
 		SetMesh(mesh);
 
+#ifdef _DEBUG
+	if (_state.pipelineState && _state.pipelineAttributes != INPUT_ATTRUBUTE::CUSTOM)
+	{
+		INPUT_ATTRUBUTE attribs;
+		mesh->GetAttributes(&attribs);
+		assert(attribs == _state.pipelineAttributes && "GLCoreRender::Draw(): mesh doesn't match vertex layout of pipeline state");
+	}
+#endif
+
 	uint vertecies;
 	mesh->GetNumberOfVertex(&vertecies);
 
@@ -922,9 +1508,8 @@ API GLCoreRender::Draw(IMesh *mesh, uint instances)
 
 	GLenum mode = (topology == VERTEX_TOPOLOGY::TRIANGLES) ? GL_TRIANGLES : GL_LINES;
 
-	GLsizei count;
-	if (glMesh->Indexes())
-		count = (glMesh->Indexes() > 65535) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	// Index type is chosen by importer from number of vertices, not indices
+	GLenum count = (glMesh->IndexFormat() == MESH_INDEX_FORMAT::INT32) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
 
 	if (instances > 1)
 	{
@@ -951,14 +1536,21 @@ API GLCoreRender::SetDepthTest(int enabled)
 	CHECK_GL_ERRORS();
 
 	if (bool(enabled) == bool(_state.depthTest))
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
+
+	_stateStats.issued();
 
 	if (enabled)
 		glEnable(GL_DEPTH_TEST);
 	else
 		glDisable(GL_DEPTH_TEST);
 
+	saveState(STATE_DEPTH);
 	_state.depthTest = enabled;
+	_state.pipelineState = 0u;
 
 	CHECK_GL_ERRORS();
 
@@ -975,37 +1567,26 @@ API GLCoreRender::SetBlendState(BLEND_FACTOR src, BLEND_FACTOR dest)
 			glEnable(GL_BLEND);
 		else
 			glDisable(GL_BLEND);
+		saveState(STATE_BLEND);
 		_state.blending = enabled;
-	}
-
-	auto EngToGLBlend = [](BLEND_FACTOR f) -> GLenum
-	{
-		switch(f)
-		{
-			case BLEND_FACTOR::NONE:
-			case BLEND_FACTOR::ZERO:				return GL_ZERO;
-			case BLEND_FACTOR::ONE:					return GL_ONE;
-			case BLEND_FACTOR::SRC_COLOR:			return GL_SRC_COLOR;
-			case BLEND_FACTOR::ONE_MINUS_SRC_COLOR:	return GL_ONE_MINUS_SRC_COLOR;
-			case BLEND_FACTOR::SRC_ALPHA:			return GL_SRC_ALPHA;
-			case BLEND_FACTOR::ONE_MINUS_SRC_ALPHA:	return GL_ONE_MINUS_SRC_ALPHA;
-			case BLEND_FACTOR::DEST_ALPHA:			return GL_DST_ALPHA;
-			case BLEND_FACTOR::ONE_MINUS_DEST_ALPHA:return GL_ONE_MINUS_DST_ALPHA;
-			case BLEND_FACTOR::DEST_COLOR:			return GL_DST_COLOR;
-			case BLEND_FACTOR::ONE_MINUS_DEST_COLOR:return GL_ONE_MINUS_DST_COLOR;
-		}
-		return GL_ZERO;
-	};
+		_state.pipelineState = 0u;
+		_stateStats.issued();
+	} else
+		_stateStats.filtered();
 
-	GLenum src_ = EngToGLBlend(src);
-	GLenum dest_ = EngToGLBlend(dest);
+	GLenum src_ = eng_to_gl_blend(src);
+	GLenum dest_ = eng_to_gl_blend(dest);
 
 	if (_state.srcBlend != src_ || _state.dstBlend != dest_)
 	{
 		glBlendFunc(src_, dest_);
+		saveState(STATE_BLEND);
 		_state.srcBlend = src_;
 		_state.dstBlend = dest_;
-	}
+		_state.pipelineState = 0u;
+		_stateStats.issued();
+	} else
+		_stateStats.filtered();
 
 	return S_OK;
 }
@@ -1013,10 +1594,15 @@ API GLCoreRender::SetBlendState(BLEND_FACTOR src, BLEND_FACTOR dest)
 API GLCoreRender::SetViewport(uint wNew, uint hNew)
 {
 	if (wNew == _state.width && hNew == _state.heigth) 
+	{
+		_stateStats.filtered();
 		return S_OK;
+	}
 
 	glViewport(0, 0, wNew, hNew);
+	_stateStats.issued();
 
+	saveState(STATE_VIEWPORT);
 	_state.width = wNew;
 	_state.heigth = hNew;
 
@@ -1033,7 +1619,17 @@ API GLCoreRender::GetViewport(OUT uint* wOut, OUT uint* hOut)
 API GLCoreRender::Clear()
 {
 	CHECK_GL_ERRORS();
+
+	// glClear() respects depth mask. Pipeline state of previous pass may disable depth writes,
+	// but depth must be cleared anyway as in DX11
+	if (!_state.depthWrite)
+		glDepthMask(GL_TRUE);
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	if (!_state.depthWrite)
+		glDepthMask(GL_FALSE);
+
 	CHECK_GL_ERRORS();
 	return S_OK;
 }
@@ -1092,6 +1688,29 @@ API GLCoreRender::BlitRenderTargetToDefault(IRenderTarget *pRenderTarget)
 	return S_OK;
 }
 
+GLPipelineState::GLPipelineState(const PipelineStateDesc& desc, uint64_t id) :
+	_desc(desc), _shader(desc.shader), _id(id)
+{
+	blending = desc.srcBlend != BLEND_FACTOR::NONE && desc.destBlend != BLEND_FACTOR::NONE;
+	srcBlend = eng_to_gl_blend(desc.srcBlend);
+	dstBlend = eng_to_gl_blend(desc.destBlend);
+
+	culling = desc.cullMode != CULL_MODE::NONE;
+	if (desc.cullMode == CULL_MODE::FRONT)
+		cullingMode = GL_FRONT;
+
+	polygonMode = desc.fillMode == FILL_MODE::WIREFRAME ? GL_LINE : GL_FILL;
+
+	depthTest = desc.depthTest;
+	depthWrite = desc.depthWrite;
+}
+
+API GLPipelineState::GetDesc(OUT PipelineStateDesc *desc)
+{
+	*desc = _desc;
+	return S_OK;
+}
+
 GLRenderTarget::GLRenderTarget(GLuint idIn) : _ID(idIn)
 {
 	for (int i = 0; i < MAX_RENDER_TARGETS; i++)
@@ -1,14 +1,28 @@
 #pragma once
 #include "Common.h"
 
+constexpr uint MAX_UNIFORM_BINDINGS = 16;
+constexpr uint MAX_STRUCTURED_BUFFER_BINDINGS = 16;
+
+// Frames in flight of uniform ring buffer and size of region for one frame
+constexpr uint UBO_RING_FRAMES = 3;
+constexpr size_t UBO_RING_FRAME_BYTES = 1024 * 1024;
+
 struct UBO final
 {
 	string name;
 	size_t bytes = 0u;
-	bool needFlush = true;
 	GLuint ID = 0u;
 	unique_ptr<uint8[]> data;
 
+	// Changed bytes of data not uploaded yet. Empty range if dirtyBegin >= dirtyEnd
+	size_t dirtyBegin = 0u;
+	size_t dirtyEnd = 0u;
+
+	// Location of data in UBORingBuffer. Valid only during frame ringFrame
+	GLintptr ringOffset = 0;
+	uint64_t ringFrame = 0u;
+
 	struct Parameter
 	{
 		string name;
@@ -25,7 +39,23 @@ public:
 	{
 		data = std::make_unique<uint8[]>(bytesIn);
 		memset(data.get(), 0, bytesIn);
+		dirtyEnd = bytesIn;
+	}
+
+	bool isDirty() const { return dirtyBegin < dirtyEnd; }
+	void markDirty(size_t offset, size_t size)
+	{
+		if (!isDirty())
+		{
+			dirtyBegin = offset;
+			dirtyEnd = offset + size;
+		} else
+		{
+			dirtyBegin = std::min(dirtyBegin, offset);
+			dirtyEnd = std::max(dirtyEnd, offset + size);
+		}
 	}
+	void clearDirty() { dirtyBegin = dirtyEnd = 0u; }
 
 	UBO(const UBO& r) = delete;
 
@@ -37,7 +67,10 @@ public:
 		ID = r.ID;
 		r.ID = 0u;
 		data = std::move(r.data);
-		needFlush = r.needFlush;
+		dirtyBegin = r.dirtyBegin;
+		dirtyEnd = r.dirtyEnd;
+		ringOffset = r.ringOffset;
+		ringFrame = r.ringFrame;
 	}
 
 	UBO& operator=(UBO&& r)
@@ -48,7 +81,10 @@ public:
 		ID = r.ID;
 		r.ID = 0u;
 		data = std::move(r.data);
-		needFlush = r.needFlush;
+		dirtyBegin = r.dirtyBegin;
+		dirtyEnd = r.dirtyEnd;
+		ringOffset = r.ringOffset;
+		ringFrame = r.ringFrame;
 	}
 
 	UBO& operator=(const UBO& r) = delete;
@@ -60,6 +96,38 @@ public:
 	}
 };
 
+//
+// Ring buffer for uniform blocks uploads
+//
+// One persistently mapped buffer split into regions, one per frame.
+// Every upload takes new range bound by glBindBufferRange,
+// so driver never waits for GPU still reading previous data of block.
+// Region is reused after UBO_RING_FRAMES frames when its fence is signaled
+//
+class UBORingBuffer final
+{
+	GLuint _ID = 0u;
+	uint8 *_mapped = nullptr;
+	size_t _frameBytes = 0u;
+	size_t _alignment = 256u;
+	size_t _offset = 0u; // in region of current frame
+	uint _region = 0u;
+	uint64_t _frame = 1u; // increases every frame, 0 is never current
+	GLsync _fences[UBO_RING_FRAMES] = {};
+
+public:
+	bool init(size_t frameBytes);
+	void free();
+	void nextFrame();
+
+	// Returns false if region of current frame is exhausted
+	bool allocate(size_t bytes, OUT GLintptr& offset, OUT uint8 *&pointer);
+
+	bool isInitialized() const { return _mapped != nullptr; }
+	GLuint ID() const { return _ID; }
+	uint64_t frame() const { return _frame; }
+};
+
 class GLRenderTarget final : public ICoreRenderTarget
 {
 	GLuint _ID = 0u;
@@ -81,13 +149,39 @@ public:
 };
 
 
-class GLCoreRender final : public ICoreRender
+// All values are translated to OpenGL at creation
+class GLPipelineState final : public ICorePipelineState
+{
+	PipelineStateDesc _desc;
+	ShaderPtr _shader;
+	uint64_t _id = 0u;
+
+public:
+	bool blending = false;
+	GLenum srcBlend = GL_ONE;
+	GLenum dstBlend = GL_ZERO;
+	bool culling = false;
+	GLint cullingMode = GL_BACK;
+	GLint polygonMode = GL_FILL;
+	bool depthTest = false;
+	bool depthWrite = true;
+
+	GLPipelineState(const PipelineStateDesc& desc, uint64_t id);
+
+	const PipelineStateDesc& desc() const { return _desc; }
+	uint64_t id() const { return _id; }
+
+	API GetDesc(OUT PipelineStateDesc *desc) override;
+};
+
+class GLCoreRender final : public ICoreRender, IProfilerCallback
 {
 	HDC _hdc{};
 	HGLRC _hRC{};
 	HWND _hWnd{};
 	int _pixelFormat = 0;
 	IResourceManager *_pResMan = nullptr;
+	string _shaderCompilerVersion; // vendor, renderer and version of driver
 
 	struct State
 	{
@@ -107,6 +201,7 @@ class GLCoreRender final : public ICoreRender
 		// Depth/Stencil
 		//
 		bool depthTest = false;
+		bool depthWrite = true;
 
 		// Viewport
 		//
@@ -132,11 +227,84 @@ class GLCoreRender final : public ICoreRender
 		// Clear
 		//
 		GLfloat clearColor[4] = {0.0f, 0.0, 0.0f, 0.0f};
+
+		// Pipeline state all fields above were set from. 0 if some field was changed after it
+		//
+		uint64_t pipelineState = 0u;
+		INPUT_ATTRUBUTE pipelineAttributes = INPUT_ATTRUBUTE::CUSTOM; // checked in Draw()
 	};
 
 	State _state;
-	std::stack<State> _statesStack;
-	
+
+	// Groups of State fields saved by PushStates() and restored by PopStates() together
+	enum STATE_FIELD : uint32_t
+	{
+		STATE_BLEND			= 1u << 0,
+		STATE_RASTER		= 1u << 1,
+		STATE_DEPTH			= 1u << 2,
+		STATE_VIEWPORT		= 1u << 3,
+		STATE_SHADER		= 1u << 4,
+		STATE_MESH			= 1u << 5,
+		STATE_RENDER_TARGET	= 1u << 6,
+		STATE_TEXTURE_0		= 1u << 7, // + slot
+	};
+	static_assert(7 + MAX_TEXTURE_SLOTS <= 32, "STATE_FIELD doesn't fit all texture slots");
+
+	// One PushStates() level. Field of _state is copied here before its first change,
+	// so PopStates() touches only fields changed after push
+	struct SavedState
+	{
+		uint32_t changed = 0u; // STATE_FIELD bits. Only these fields of values are valid
+		State values;
+		uint64_t pipelineState = 0u;
+		INPUT_ATTRUBUTE pipelineAttributes = INPUT_ATTRUBUTE::CUSTOM;
+	};
+	vector<SavedState> _savedStates; // grows to max nesting and is reused
+	uint _savedStatesNum = 0u;
+
+	void saveState(uint32_t field)
+	{
+		if (_savedStatesNum && (_savedStates[_savedStatesNum - 1].changed & field) != field)
+			saveStateSlow(field);
+	}
+	void saveStateSlow(uint32_t field); // field is one STATE_FIELD or any set of texture bits
+
+	UBORingBuffer _uboRing;
+
+	// Block name in shader ("ubo_" + name) -> layout of C++ struct
+	std::unordered_map<string, UniformBlockLayout> _uniformBlocks;
+
+	// Uniform buffer binding points. Rebound only if buffer or range changed
+	struct UniformBinding
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+	UniformBinding _uniformBindings[MAX_UNIFORM_BINDINGS]{};
+
+	// Shader storage buffer binding points. Not part of State: PushStates/PopStates don't touch them
+	StructuredBufferPtr _structuredBufferBindings[MAX_STRUCTURED_BUFFER_BINDINGS];
+
+	StateFilterStats _stateStats;
+
+	uint64_t _pipelineStatesCreated = 0u; // also id of last created state
+
+	// Programs compiled and linked by driver threads (GL_ARB_parallel_shader_compile).
+	// Key is hash of shader texts, so texts can be freed and allocated at the same address again
+	struct PendingProgram
+	{
+		GLuint programID;
+		GLuint vertID;
+		GLuint geomID;
+		GLuint fragID;
+	};
+	std::unordered_map<uint64_t, PendingProgram> _pendingPrograms;
+
+	static uint64_t programKey(const char *vertText, const char *fragText, const char *geomText);
+	static void deletePendingProgram(const PendingProgram& p);
+	HRESULT finishPendingProgram(OUT ICoreShader **pShader, const PendingProgram& p);
+
 	bool checkShaderErrors(int id, GLenum constant);
 	bool createShader(GLuint &id, GLenum type, const char* pText, GLuint programID);
 
@@ -145,6 +313,13 @@ public:
 	GLCoreRender();
 	virtual ~GLCoreRender();
 
+	UBORingBuffer& uboRing() { return _uboRing; }
+	UniformBlockLayout* uniformBlock(const char *blockName);
+	void bindUniformBuffer(GLuint slot, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	uint getNumLines() override;
+	string getString(uint i) override;
+
 	API Init(const WindowHandle* handle, int MSAASamples = 0, int VSyncOn = 1) override;
 	API Free() override;
 	API MakeCurrent(const WindowHandle* handle) override;
@@ -152,9 +327,18 @@ public:
 
 	API CreateMesh(OUT ICoreMesh **pMesh, const MeshDataDesc *dataDesc, const MeshIndexDesc *indexDesc, VERTEX_TOPOLOGY mode) override;
 	API CreateShader(OUT ICoreShader **pShader, const char *vertText, const char *fragText, const char *geomText) override;
+	API CreateShaderFromBinary(OUT ICoreShader **pShader, const uint8 *data, uint size) override;
+	API GetShaderBinary(ICoreShader *pShader, OUT uint8 *data, OUT uint *size) override;
+	API CompileShaderBinary(OUT uint8 **data, OUT uint *size, const char *vertText, const char *fragText, const char *geomText) override;
+	API GetShaderCompilerVersion(OUT const char **pVersion) override;
+	API StartShaderCompile(const char *vertText, const char *fragText, const char *geomText) override;
+	API IsShaderCompiling(OUT int *compiling, const char *vertText, const char *fragText, const char *geomText) override;
+	API CancelShaderCompile(const char *vertText, const char *fragText, const char *geomText) override;
 	API CreateTexture(OUT ICoreTexture **pTexture, uint8 *pData, uint width, uint height, TEXTURE_TYPE type, TEXTURE_FORMAT format, TEXTURE_CREATE_FLAGS flags, int mipmapsPresented) override;
 	API CreateRenderTarget(OUT ICoreRenderTarget **pRenderTarget) override;
 	API CreateStructuredBuffer(OUT ICoreStructuredBuffer **pStructuredBuffer, uint size, uint elementSize) override;
+	API RegisterUniformBlock(const UniformBlockDesc *desc) override;
+	API CreatePipelineState(OUT ICorePipelineState **pState, const PipelineStateDesc *desc) override;
 
 	API PushStates() override;
 	API PopStates() override;
@@ -162,6 +346,7 @@ public:
 	API RestoreDefaultRenderTarget() override;
 	API BindTexture(uint slot, ITexture* texture) override;
 	API UnbindAllTextures() override;
+	API SetPipelineState(ICorePipelineState *state) override;
 	API SetShader(IShader *pShader) override;
 	API SetMesh(IMesh* mesh) override;
 	API SetStructuredBufer(uint slot, IStructuredBuffer* buffer) override;
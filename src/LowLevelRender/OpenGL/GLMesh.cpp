@@ -8,7 +8,7 @@ DEFINE_LOG_HELPERS(_pCore)
 
 GLMesh::GLMesh(GLuint VAO, GLuint VBO, GLuint IBO, uint vertexNumber, uint indexNumber, MESH_INDEX_FORMAT indexFormat, VERTEX_TOPOLOGY mode, INPUT_ATTRUBUTE a):
 	_VAO(VAO), _VBO(VBO), _IBO(IBO),
-	_number_of_vertices(vertexNumber), _number_of_indicies(indexNumber), _index_presented(indexFormat != MESH_INDEX_FORMAT::NOTHING), _topology(mode), _attributes(a)
+	_number_of_vertices(vertexNumber), _number_of_indicies(indexNumber), _index_presented(indexFormat != MESH_INDEX_FORMAT::NOTHING), _index_format(indexFormat), _topology(mode), _attributes(a)
 {
 }
 
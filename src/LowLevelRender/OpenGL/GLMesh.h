@@ -20,6 +20,7 @@ public:
 
 	GLuint VAO_ID() const { return _VAO; }
 	uint Indexes() { return _number_of_indicies; }
+	MESH_INDEX_FORMAT IndexFormat() const { return _index_format; }
 
 	API GetNumberOfVertex(OUT uint *number) override;
 	API GetAttributes(OUT INPUT_ATTRUBUTE *attribs) override;
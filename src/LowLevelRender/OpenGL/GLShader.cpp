@@ -7,14 +7,23 @@ extern Core *_pCore;
 DEFINE_DEBUG_LOG_HELPERS(_pCore)
 DEFINE_LOG_HELPERS(_pCore)
 
+#define TEXTURE_NAME "_texture_"
+
 extern vector<UBO> UBOpool;
+extern UniformBufferIndex<UBO> UBOpoolIndex;
+
+static GLCoreRender* getGLCoreRender()
+{
+	ICoreRender *coreRender = getCoreRender(_pCore);
+	return static_cast<GLCoreRender*>(coreRender);
+}
 
 GLShader::GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID) :
 	_programID(programID), _vertID(vertID), _geomID(geomID), _fragID(fragID)
 {
 	// Get all unoform variables from all Uniform Buffer Objects for current shader
 
-	glUseProgram(_programID);
+	GLCoreRender *render = getGLCoreRender();
 
 	GLint numUBO = 0;
 	glGetProgramiv(_programID, GL_ACTIVE_UNIFORM_BLOCKS, &numUBO);
@@ -27,6 +36,12 @@ GLShader::GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID
 
 		glGetActiveUniformBlockName(_programID, i, sizeof(nameUBO), NULL, nameUBO);
 		glGetActiveUniformBlockiv(_programID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &bytesUBO);
+
+		// Some drivers report std140 size without padding of last member.
+		// Make byte width multiplied by 16 as DX11 does, so it's comparable with C++ struct
+		if (bytesUBO % 16 != 0)
+			bytesUBO = 16 * ((bytesUBO / 16) + 1);
+
 		glGetActiveUniformBlockiv(_programID, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &numIndices);
 
 		if (numIndices == 0)
@@ -34,6 +49,41 @@ GLShader::GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID
 
 		glGetActiveUniformBlockiv(_programID, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indicesArray);
 
+		// Block with the same name may have other layout in this shader.
+		// Offsets are compared in one query, names and types are queried only if layout differs
+		UniformBlockLayout *typed = render->uniformBlock(nameUBO);
+		if (typed && typed->poolIndex >= 0 && UBOpool[typed->poolIndex].bytes == (size_t)bytesUBO &&
+			UBOpool[typed->poolIndex].parameters.size() == (size_t)numIndices)
+		{
+			GLint offsets[2048];
+			glGetActiveUniformsiv(_programID, numIndices, reinterpret_cast<const GLuint*>(indicesArray), GL_UNIFORM_OFFSET, offsets);
+			std::sort(offsets, offsets + numIndices);
+
+			// Pool parameters are sorted by offset
+			const vector<UBO::Parameter> &parameters = UBOpool[typed->poolIndex].parameters;
+			bool sameLayout = true;
+			for (int k = 0; k < numIndices && sameLayout; k++)
+				sameLayout = parameters[k].offset == (size_t)offsets[k];
+
+			if (!sameLayout)
+				typed = nullptr;
+		} else
+			typed = nullptr;
+
+		// std140 block already validated by other shader has the same layout: no per-uniform queries
+		if (typed)
+		{
+			_bufferIndicies.push_back(typed->poolIndex);
+			UBOpoolIndex.addUser(typed->poolIndex);
+
+			const vector<UBO::Parameter> &parameters = UBOpool[typed->poolIndex].parameters;
+			for (size_t k = 0; k < parameters.size(); k++)
+				addParameter(parameters[k].name, {typed->poolIndex, (int)k});
+
+			addBlock(typed->name, typed->poolIndex);
+			continue;
+		}
+
 		vector<UBO::Parameter> parametersUBO;
 
 		// active UBO parameters
@@ -93,45 +143,30 @@ GLShader::GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID
 			parametersUBO.push_back(p);
 		}
 
-		// sort by offset for pretty view
-		#ifdef _DEBUG
-			std::sort(parametersUBO.begin(), parametersUBO.end(), [](const UBO::Parameter& a, const UBO::Parameter& b) -> bool
-			{ 
-				return a.offset < b.offset; 
-			});
-		#endif
+		// sort by offset: active uniforms order depends on driver, layout key shouldn't
+		std::sort(parametersUBO.begin(), parametersUBO.end(), [](const UBO::Parameter& a, const UBO::Parameter& b) -> bool
+		{ 
+			return a.offset < b.offset; 
+		});
 
 		// find existing buffer with same memory layout
-		int indexFound = -1;
-		{
-			for (int j = 0; indexFound == -1 && j < UBOpool.size(); j++)
-			{
-				bool isEqual = true;
-
-				if (UBOpool[j].name != nameUBO)
-					isEqual = false;
-
-				if (UBOpool[j].bytes != bytesUBO)
-					isEqual = false;
-
-				if (UBOpool[j].parameters.size() != parametersUBO.size())
-					isEqual = false;
+		const uint64_t layoutKey = UniformBufferIndex<UBO>::key(nameUBO, bytesUBO, parametersUBO);
+		int indexFound = UBOpoolIndex.find(UBOpool, layoutKey, nameUBO, bytesUBO, parametersUBO);
 
-				for (int k = 0; isEqual && k < parametersUBO.size(); k++)
-				{
-					if (UBOpool[j].parameters[k].name != parametersUBO[k].name ||
-						UBOpool[j].parameters[k].bytes != parametersUBO[k].bytes ||
-						UBOpool[j].parameters[k].offset != parametersUBO[k].offset ||
-						UBOpool[j].parameters[k].elements != parametersUBO[k].elements)
-					{
-						isEqual = 0;
-					}
-				}
+		// Validate layout of typed block in every shader. Block of other layout gets no handle
+		typed = render->uniformBlock(nameUBO);
+		if (typed)
+		{
+			const int poolIndex = indexFound != -1 ? indexFound : (int)UBOpool.size();
 
-				if (isEqual)
-					indexFound = j;
-			}
-		}		
+			if (typed->matches(parametersUBO, bytesUBO))
+			{
+				if (typed->poolIndex < 0)
+					typed->poolIndex = poolIndex;
+				addBlock(typed->name, poolIndex);
+			} else
+				LOG_WARNING_FORMATTED("GLShader::GLShader(): uniform block \"%s\" doesn't match registered C++ struct. SetUniformBlock() is ignored for it", nameUBO);
+		}
 
 		if (indexFound != -1) // buffer found
 		{
@@ -139,7 +174,7 @@ GLShader::GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID
 
 			for (size_t i = 0; i < parametersUBO.size(); i++)
 			{
-				_parameters[parametersUBO[i].name] = {(int)indexFound, (int)i};
+				addParameter(parametersUBO[i].name, {(int)indexFound, (int)i});
 			}
 		} else // not found => create new
 		{
@@ -155,12 +190,29 @@ GLShader::GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID
 
 			for (int i = 0; i < parametersUBO.size(); i++)
 			{
-				_parameters[parametersUBO[i].name] = {(int)UBOpool.size(), (int)i};
+				addParameter(parametersUBO[i].name, {(int)UBOpool.size(), (int)i});
 			}
 
+			UBOpoolIndex.add(layoutKey, (int)UBOpool.size());
 			UBOpool.emplace_back(std::move(UBO(id, bytesUBO, nameUBO, parametersUBO)));
 		}
 	}
+
+	// Block index -> binding point is program state, set it once
+	for (GLuint i = 0; i < (GLuint)_bufferIndicies.size(); i++)
+		glUniformBlockBinding(_programID, i, i);
+
+	// Sampler -> texture unit is program state too: sampler "_texture_N" always reads unit N,
+	// so binding texture doesn't need uniform location
+	for (int i = 0; i < MAX_TEXTURE_SLOTS; i++)
+	{
+		char nameSampler[32];
+		sprintf(nameSampler, TEXTURE_NAME "%i", i);
+
+		GLint location = glGetUniformLocation(_programID, nameSampler);
+		if (location > -1)
+			glProgramUniform1i(_programID, location, i);
+	}
 }
 
 GLShader::~GLShader()
@@ -169,18 +221,42 @@ GLShader::~GLShader()
 	if (_fragID != 0) {	glDeleteShader(_fragID); _fragID = 0; }
 	if (_geomID != 0) { glDeleteShader(_geomID); _geomID = 0; }
 	if (_programID != 0) { glDeleteProgram(_programID); _programID = 0; }
+
+	for (size_t index : _bufferIndicies)
+		UBOpoolIndex.removeUser(index);
+}
+
+void GLShader::addParameter(const string& name, const Parameter& p)
+{
+	_parameterHandles[name] = (uint)_parameters.size();
+	_parameters.push_back(p);
+}
+
+void GLShader::addBlock(const string& name, size_t bufferIndex)
+{
+	_blockHandles[name] = (uint)_blocks.size();
+	_blocks.push_back(bufferIndex);
 }
 
 void GLShader::setParameter(const char *name, const void *data)
 {
-	auto it = _parameters.find(name);
-	if (it == _parameters.end())
+	auto it = _parameterHandles.find(name);
+	if (it == _parameterHandles.end())
 	{
-		auto &p = _parameters[name];
+		// Remember unknown parameter to warn once
+		it = _parameterHandles.emplace(name, SHADER_PARAMETER_INVALID).first;
 		LOG_WARNING_FORMATTED("GLShader::setParameter() unable find parameter \"%s\"", name);
 	}
 
-	Parameter &p = _parameters[name];
+	setParameter(it->second, data);
+}
+
+void GLShader::setParameter(uint handle, const void *data)
+{
+	if (handle >= _parameters.size())
+		return;
+
+	Parameter &p = _parameters[handle];
 
 	if (p.bufferIndex < 0 || p.parameterIndex < 0)
 		return;
@@ -191,21 +267,61 @@ void GLShader::setParameter(const char *name, const void *data)
 	if (memcmp(pointer, data, pUBO.bytes))
 	{
 		memcpy(pointer, data, pUBO.bytes);
-		ubo.needFlush = true;
+		ubo.markDirty(pUBO.offset, pUBO.bytes);
 	}
 }
 
-void GLShader::bind()
+void GLShader::uploadBuffers()
 {
-	glUseProgram(_programID);
-	for (int i = 0; i < _bufferIndicies.size(); i++)
+	GLCoreRender *render = getGLCoreRender();
+	UBORingBuffer &ring = render->uboRing();
+
+	for (GLuint i = 0; i < (GLuint)_bufferIndicies.size(); i++)
 	{
 		UBO &ubo = UBOpool[_bufferIndicies[i]];
-		glBindBufferBase(GL_UNIFORM_BUFFER, i, ubo.ID);
-		glUniformBlockBinding(_programID, i, i);
+
+		if (ring.isInitialized())
+		{
+			// Range from previous frames can be overwritten already
+			if (ubo.isDirty() || ubo.ringFrame != ring.frame())
+			{
+				uint8 *pointer;
+				if (ring.allocate(ubo.bytes, ubo.ringOffset, pointer))
+				{
+					memcpy(pointer, ubo.data.get(), ubo.bytes);
+					ubo.ringFrame = ring.frame();
+					ubo.clearDirty();
+				} else
+				{
+					// Region is exhausted. Own buffer didn't receive updates that went to ring
+					ubo.ringFrame = 0u;
+					ubo.markDirty(0, ubo.bytes);
+				}
+			}
+
+			if (ubo.ringFrame == ring.frame())
+			{
+				render->bindUniformBuffer(i, ring.ID(), ubo.ringOffset, ubo.bytes);
+				continue;
+			}
+		}
+
+		if (ubo.isDirty())
+		{
+			glNamedBufferSubData(ubo.ID, ubo.dirtyBegin, ubo.dirtyEnd - ubo.dirtyBegin, ubo.data.get() + ubo.dirtyBegin);
+			ubo.clearDirty();
+		}
+
+		render->bindUniformBuffer(i, ubo.ID, 0, ubo.bytes);
 	}
 }
 
+void GLShader::bind()
+{
+	glUseProgram(_programID);
+	uploadBuffers();
+}
+
 API GLShader::SetFloatParameter(const char *name, float value)
 {
 	setParameter(name, &value);
@@ -230,18 +346,62 @@ API GLShader::SetUintParameter(const char *name, uint value)
 	return S_OK;
 }
 
-API GLShader::FlushParameters()
+API GLShader::GetParameterHandle(const char *name, OUT uint *handle)
 {
-	for (auto& idx : _bufferIndicies)
+	auto it = _parameterHandles.find(name);
+	*handle = it == _parameterHandles.end() ? SHADER_PARAMETER_INVALID : it->second;
+	return *handle == SHADER_PARAMETER_INVALID ? E_FAIL : S_OK;
+}
+
+API GLShader::SetFloatParameter(uint handle, float value)
+{
+	setParameter(handle, &value);
+	return S_OK;
+}
+
+API GLShader::SetVec4Parameter(uint handle, const vec4 *value)
+{
+	setParameter(handle, value);
+	return S_OK;
+}
+
+API GLShader::SetMat4Parameter(uint handle, const mat4 *value)
+{
+	setParameter(handle, value);
+	return S_OK;
+}
+
+API GLShader::SetUintParameter(uint handle, uint value)
+{
+	setParameter(handle, &value);
+	return S_OK;
+}
+
+API GLShader::GetUniformBlockHandle(const char *name, OUT uint *handle)
+{
+	auto it = _blockHandles.find(name);
+	*handle = it == _blockHandles.end() ? SHADER_PARAMETER_INVALID : it->second;
+	return *handle == SHADER_PARAMETER_INVALID ? E_FAIL : S_OK;
+}
+
+API GLShader::SetUniformBlock(uint handle, const void *data)
+{
+	if (handle >= _blocks.size())
+		return S_OK;
+
+	UBO &ubo = UBOpool[_blocks[handle]];
+	if (memcmp(ubo.data.get(), data, ubo.bytes))
 	{
-		UBO &ubo = UBOpool[idx];
-		if (ubo.needFlush)
-		{
-			glNamedBufferSubData(ubo.ID, 0, ubo.bytes, ubo.data.get());
-			ubo.needFlush = false;
-		}
+		memcpy(ubo.data.get(), data, ubo.bytes);
+		ubo.markDirty(0, ubo.bytes);
 	}
 
 	return S_OK;
 }
 
+API GLShader::FlushParameters()
+{
+	uploadBuffers();
+	return S_OK;
+}
+
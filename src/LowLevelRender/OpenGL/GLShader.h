@@ -17,12 +17,22 @@ class GLShader : public ICoreShader
 		int bufferIndex = -1; // index of UBO in UBOpool
 		int parameterIndex = -1; // index in UBO::parameters
 	};
-	std::unordered_map<string, Parameter> _parameters; // all shader parameters	
+	vector<Parameter> _parameters; // all shader parameters, index is parameter handle
+	std::unordered_map<string, uint> _parameterHandles;
 
+	// Typed blocks: handle -> index of UBO in UBOpool
+	vector<size_t> _blocks;
+	std::unordered_map<string, uint> _blockHandles;
+
+	void addParameter(const string& name, const Parameter& p);
+	void addBlock(const string& name, size_t bufferIndex);
 	void setParameter(const char *name, const void *data);
+	void setParameter(uint handle, const void *data);
+	void uploadBuffers();
 
 public:
 
+	// Program must be linked. Doesn't change current program
 	GLShader(GLuint programID, GLuint vertID, GLuint geomID, GLuint fragID);
 	virtual ~GLShader();
 
@@ -33,6 +43,13 @@ public:
 	API SetVec4Parameter(const char* name, const vec4 *value) override;
 	API SetMat4Parameter(const char* name, const mat4 *value) override;
 	API SetUintParameter(const char* name, uint value) override;
+	API GetParameterHandle(const char* name, OUT uint *handle) override;
+	API SetFloatParameter(uint handle, float value) override;
+	API SetVec4Parameter(uint handle, const vec4 *value) override;
+	API SetMat4Parameter(uint handle, const mat4 *value) override;
+	API SetUintParameter(uint handle, uint value) override;
+	API GetUniformBlockHandle(const char* name, OUT uint *handle) override;
+	API SetUniformBlock(uint handle, const void *data) override;
 	API FlushParameters() override;
 };
 
@@ -0,0 +1,365 @@
+#include "Pch.h"
+#include "MeshCache.h"
+
+namespace fs = std::experimental::filesystem;
+
+static const uint32_t MESH_CACHE_MAGIC = 0x434D4D52; // "RMMC"
+static const uint32_t MESH_CACHE_VERSION = 1;
+static const uint64_t MESH_CACHE_ALIGNMENT = 4096; // page
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceTime;
+	uint64_t sourceSize;
+	uint64_t sourceHash;
+	uint32_t meshNumber;
+	uint32_t namesBytes;
+};
+
+struct MeshCacheAttribute
+{
+	uint32_t presented;
+	uint32_t offset;
+	uint32_t stride;
+	uint32_t format;
+};
+
+struct MeshCacheEntry
+{
+	uint32_t nameOffset; // in names block
+	uint32_t nameLength;
+
+	float aabb[6]; // as AABB
+	float sphere[4]; // center, radius
+
+	uint32_t topology;
+	uint32_t vertexNumber;
+	MeshCacheAttribute attributes[MAX_VERTEX_ATTRIBUTES]; // position, normal, texture coordinates, color, tangent
+	uint64_t vertexOffset; // from beginning of file
+	uint64_t vertexBytes;
+
+	uint32_t indexFormat;
+	uint32_t indexNumber;
+	uint64_t indexOffset;
+	uint64_t indexBytes;
+};
+
+static uint64_t align(uint64_t offset)
+{
+	return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+static string cachePath(const string& sourcePath)
+{
+	return sourcePath + MESH_CACHE_EXTENSION;
+}
+
+static bool sourceTimeAndSize(const string& sourcePath, uint64_t& timeOut, uint64_t& sizeOut)
+{
+	std::error_code err;
+	const fs::path path = fs::u8path(sourcePath);
+
+	const auto time = fs::last_write_time(path, err);
+	if (err)
+		return false;
+
+	sizeOut = (uint64_t)fs::file_size(path, err);
+	if (err)
+		return false;
+
+	timeOut = (uint64_t)time.time_since_epoch().count();
+	return true;
+}
+
+static bool sourceHash(const string& sourcePath, uint64_t& hashOut)
+{
+	std::ifstream file(fs::u8path(sourcePath), std::ios::binary);
+	if (!file)
+		return false;
+
+	vector<char> chunk(1024 * 1024);
+	uint64_t h = HASH_SEED;
+
+	while (file)
+	{
+		file.read(chunk.data(), chunk.size());
+		h = hashBytes(h, chunk.data(), (size_t)file.gcount());
+	}
+
+	hashOut = h;
+	return true;
+}
+
+static void packAttributes(OUT MeshCacheAttribute attributes[MAX_VERTEX_ATTRIBUTES], const MeshDataDesc& d)
+{
+	attributes[0] = {1u, d.positionOffset, d.positionStride, (uint32_t)d.positionFormat};
+	attributes[1] = {d.normalsPresented, d.normalOffset, d.normalStride, (uint32_t)d.normalFormat};
+	attributes[2] = {d.texCoordPresented, d.texCoordOffset, d.texCoordStride, (uint32_t)d.texCoordFormat};
+	attributes[3] = {d.colorPresented, d.colorOffset, d.colorStride, (uint32_t)d.colorFormat};
+	attributes[4] = {d.tangentPresented, d.tangentOffset, d.tangentStride, (uint32_t)d.tangentFormat};
+}
+
+static void unpackAttributes(OUT MeshDataDesc& d, const MeshCacheAttribute attributes[MAX_VERTEX_ATTRIBUTES])
+{
+	const MeshCacheAttribute *a = attributes;
+	d.positionOffset = a[0].offset;		d.positionStride = a[0].stride;		d.positionFormat = (VERTEX_FORMAT)a[0].format;
+	d.normalsPresented = a[1].presented != 0;
+	d.normalOffset = a[1].offset;		d.normalStride = a[1].stride;		d.normalFormat = (VERTEX_FORMAT)a[1].format;
+	d.texCoordPresented = a[2].presented != 0;
+	d.texCoordOffset = a[2].offset;		d.texCoordStride = a[2].stride;		d.texCoordFormat = (VERTEX_FORMAT)a[2].format;
+	d.colorPresented = a[3].presented != 0;
+	d.colorOffset = a[3].offset;		d.colorStride = a[3].stride;		d.colorFormat = (VERTEX_FORMAT)a[3].format;
+	d.tangentPresented = a[4].presented != 0;
+	d.tangentOffset = a[4].offset;		d.tangentStride = a[4].stride;		d.tangentFormat = (VERTEX_FORMAT)a[4].format;
+}
+
+static uint64_t indexBytes(MESH_INDEX_FORMAT format, uint number)
+{
+	switch (format)
+	{
+		case MESH_INDEX_FORMAT::INT32: return 4ull * number;
+		case MESH_INDEX_FORMAT::INT16: return 2ull * number;
+	}
+	return 0;
+}
+
+// Cache is overwritten only by rename, so header is patched in place
+static bool updateSourceTime(const string& path, uint64_t time)
+{
+	std::fstream file(fs::u8path(path), std::ios::in | std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+
+	file.seekp(offsetof(MeshCacheHeader, sourceTime));
+	file.write(reinterpret_cast<const char*>(&time), sizeof(time));
+
+	return (bool)file;
+}
+
+bool MeshCacheFile::map(const string& path)
+{
+	const std::wstring wpath = fs::u8path(path).wstring();
+
+	_file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(_file, &fileSize) || (uint64_t)fileSize.QuadPart < sizeof(MeshCacheHeader))
+	{
+		close();
+		return false;
+	}
+	_size = (size_t)fileSize.QuadPart;
+
+	_mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping)
+		_view = static_cast<const uint8*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+
+	if (!_view)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshCacheFile::open(const string& sourcePath)
+{
+	close();
+
+	uint64_t time, size;
+	if (!sourceTimeAndSize(sourcePath, time, size))
+		return false;
+
+	const string path = cachePath(sourcePath);
+
+	if (!map(path))
+		return false;
+
+	const MeshCacheHeader *header = reinterpret_cast<const MeshCacheHeader*>(_view);
+
+	if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION)
+	{
+		close();
+		return false;
+	}
+
+	// Timestamp may change without content change (checkout, copy), then content decides
+	if (header->sourceTime != time || header->sourceSize != size)
+	{
+		uint64_t hash;
+		if (header->sourceSize != size || !sourceHash(sourcePath, hash) || hash != header->sourceHash)
+		{
+			close();
+			return false;
+		}
+
+		// Content is the same. New time is stored, so next open doesn't hash source again.
+		// File is opened for reading only by map(). If writing fails, cache is still valid
+		close();
+		updateSourceTime(path, time);
+
+		return map(path);
+	}
+
+	return true;
+}
+
+void MeshCacheFile::close()
+{
+	if (_view)
+		UnmapViewOfFile(_view);
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+
+	_view = nullptr;
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+	_size = 0;
+}
+
+bool MeshCacheFile::meshes(vector<MeshData>& meshesOut) const
+{
+	if (!_view)
+		return false;
+
+	const MeshCacheHeader *header = reinterpret_cast<const MeshCacheHeader*>(_view);
+	const uint64_t entriesEnd = sizeof(MeshCacheHeader) + uint64_t(header->meshNumber) * sizeof(MeshCacheEntry);
+	const uint64_t namesEnd = entriesEnd + header->namesBytes;
+
+	if (namesEnd > _size)
+		return false;
+
+	const MeshCacheEntry *entries = reinterpret_cast<const MeshCacheEntry*>(_view + sizeof(MeshCacheHeader));
+	const char *names = reinterpret_cast<const char*>(_view + entriesEnd);
+
+	const auto inFile = [&](uint64_t offset, uint64_t bytes) { return offset <= _size && bytes <= _size - offset; };
+
+	vector<MeshData> meshes(header->meshNumber);
+
+	for (uint32_t i = 0; i < header->meshNumber; i++)
+	{
+		const MeshCacheEntry& e = entries[i];
+		MeshData& m = meshes[i];
+
+		if (uint64_t(e.nameOffset) + e.nameLength > header->namesBytes || !inFile(e.vertexOffset, e.vertexBytes) || !inFile(e.indexOffset, e.indexBytes))
+			return false;
+
+		m.name.assign(names + e.nameOffset, e.nameLength);
+		m.aabb = {e.aabb[0], e.aabb[1], e.aabb[2], e.aabb[3], e.aabb[4], e.aabb[5]};
+		m.sphere.center = vec3(e.sphere[0], e.sphere[1], e.sphere[2]);
+		m.sphere.radius = e.sphere[3];
+		m.topology = (VERTEX_TOPOLOGY)e.topology;
+
+		unpackAttributes(m.desc, e.attributes);
+		m.desc.numberOfVertex = e.vertexNumber;
+		m.desc.pData = const_cast<uint8*>(_view + e.vertexOffset);
+
+		if (meshDataDescError(m.desc) || meshDataBytes(m.desc) > e.vertexBytes)
+			return false;
+
+		m.indexDesc.format = (MESH_INDEX_FORMAT)e.indexFormat;
+		m.indexDesc.number = e.indexNumber;
+		m.indexDesc.pData = e.indexBytes ? const_cast<uint8*>(_view + e.indexOffset) : nullptr;
+
+		if (indexBytes(m.indexDesc.format, e.indexNumber) > e.indexBytes)
+			return false;
+	}
+
+	meshesOut = std::move(meshes);
+	return true;
+}
+
+bool writeMeshCache(const string& sourcePath, const vector<MeshData>& meshes)
+{
+	MeshCacheHeader header{MESH_CACHE_MAGIC, MESH_CACHE_VERSION};
+	header.meshNumber = (uint32_t)meshes.size();
+
+	if (!sourceTimeAndSize(sourcePath, header.sourceTime, header.sourceSize) || !sourceHash(sourcePath, header.sourceHash))
+		return false;
+
+	vector<MeshCacheEntry> entries(meshes.size());
+	string names;
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		entries[i].nameOffset = (uint32_t)names.size();
+		entries[i].nameLength = (uint32_t)meshes[i].name.size();
+		names += meshes[i].name;
+	}
+	header.namesBytes = (uint32_t)names.size();
+
+	uint64_t offset = sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry) + names.size();
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshData& m = meshes[i];
+		MeshCacheEntry& e = entries[i];
+
+		e.aabb[0] = m.aabb.maxX; e.aabb[1] = m.aabb.minX;
+		e.aabb[2] = m.aabb.maxY; e.aabb[3] = m.aabb.minY;
+		e.aabb[4] = m.aabb.maxZ; e.aabb[5] = m.aabb.minZ;
+		e.sphere[0] = m.sphere.center.x; e.sphere[1] = m.sphere.center.y; e.sphere[2] = m.sphere.center.z; e.sphere[3] = m.sphere.radius;
+		e.topology = (uint32_t)m.topology;
+
+		packAttributes(e.attributes, m.desc);
+
+		e.vertexNumber = m.desc.numberOfVertex;
+		e.vertexOffset = offset = align(offset);
+		e.vertexBytes = meshDataBytes(m.desc);
+		offset += e.vertexBytes;
+
+		e.indexFormat = (uint32_t)m.indexDesc.format;
+		e.indexNumber = m.indexDesc.number;
+		e.indexOffset = offset = align(offset);
+		e.indexBytes = indexBytes(m.indexDesc.format, m.indexDesc.number);
+		offset += e.indexBytes;
+	}
+
+	const string path = cachePath(sourcePath);
+	const string tmpPath = path + ".tmp";
+
+	{
+		std::ofstream file(fs::u8path(tmpPath), std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+		file.write(names.data(), names.size());
+
+		const auto writeBlob = [&](uint64_t blobOffset, const uint8 *data, uint64_t bytes)
+		{
+			static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+			const uint64_t padding = blobOffset - (uint64_t)file.tellp();
+			file.write(zeros, padding);
+			file.write(reinterpret_cast<const char*>(data), bytes);
+		};
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			writeBlob(entries[i].vertexOffset, meshes[i].vertexData(), entries[i].vertexBytes);
+			writeBlob(entries[i].indexOffset, meshes[i].indexData(), entries[i].indexBytes);
+		}
+
+		if (!file)
+			return false;
+	}
+
+	// Write whole file first so reader never maps partial cache
+	std::error_code err;
+	fs::rename(fs::u8path(tmpPath), fs::u8path(path), err);
+	if (err)
+	{
+		fs::remove(fs::u8path(tmpPath), err);
+		return false;
+	}
+
+	return true;
+}
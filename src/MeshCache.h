@@ -0,0 +1,64 @@
+#pragma once
+#include "Common.h"
+
+//
+// Mesh on CPU ready for ICoreRender::CreateMesh()
+// Data is either owned (just imported) or points to mapped cache file
+//
+struct MeshData
+{
+	string name; // node name in model file
+	MeshDataDesc desc;
+	MeshIndexDesc indexDesc;
+	VERTEX_TOPOLOGY topology = VERTEX_TOPOLOGY::TRIANGLES;
+	AABB aabb{};
+	BoundingSphere sphere{};
+
+	vector<uint8> vertices; // owned data. Empty if desc.pData points to other memory
+	vector<uint8> indices;
+
+	uint8* vertexData() const { return vertices.empty() ? desc.pData : const_cast<uint8*>(vertices.data()); }
+	uint8* indexData() const { return indices.empty() ? indexDesc.pData : const_cast<uint8*>(indices.data()); }
+};
+
+//
+// Binary mesh cache
+//
+// Meshes of imported model are written next to source file ("model.fbx" -> "model.fbx.rmesh").
+// Cache is valid while source has the same modification time and size or, if they changed, the same content hash.
+// After content hash matched new modification time is written to cache, so source is hashed only once.
+// Any change of importer output must increase MESH_CACHE_VERSION
+//
+// Layout:
+// | MeshCacheHeader | MeshCacheEntry x meshes | names | vertices 0 | indices 0 | vertices 1 | ...
+// Each vertex and index blob starts at MESH_CACHE_ALIGNMENT boundary,
+// so mapped file is passed to CreateMesh() without copying
+//
+#define MESH_CACHE_EXTENSION ".rmesh"
+
+class MeshCacheFile final
+{
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = nullptr;
+	const uint8 *_view = nullptr;
+	size_t _size = 0;
+
+	bool map(const string& path);
+
+public:
+	MeshCacheFile() = default;
+	~MeshCacheFile() { close(); }
+
+	MeshCacheFile(const MeshCacheFile&) = delete;
+	MeshCacheFile& operator=(const MeshCacheFile&) = delete;
+
+	// Maps cache of source file. Returns false if there is no cache or it is out of date
+	bool open(const string& sourcePath);
+	void close();
+
+	// Data of meshes points to mapped file and valid until close()
+	bool meshes(vector<MeshData>& meshesOut) const;
+};
+
+// Thread-safe, doesn't log. Caller reports failure
+bool writeMeshCache(const string& sourcePath, const vector<MeshData>& meshes);
@@ -0,0 +1,238 @@
+#include "Pch.h"
+#include "MeshOptimizer.h"
+
+constexpr uint NO_INDEX = 0xFFFFFFFFu;
+
+uint weldVertices(uint8 *vertices, uint vertexNumber, uint stride, vector<uint>& indicesOut)
+{
+	indicesOut.resize(vertexNumber);
+
+	// Open addressing, load factor <= 0.5. Slot keeps index of unique vertex
+	size_t tableSize = 1;
+	while (tableSize < size_t(vertexNumber) * 2)
+		tableSize *= 2;
+	vector<uint> table(tableSize, NO_INDEX);
+	const size_t mask = tableSize - 1;
+
+	uint unique = 0;
+
+	// Unique vertex i is moved to position unique <= i, which is already processed
+	for (uint i = 0; i < vertexNumber; i++)
+	{
+		const uint8 *v = vertices + size_t(i) * stride;
+		size_t slot = (size_t)hashBytes(HASH_SEED, v, stride) & mask;
+
+		while (table[slot] != NO_INDEX && memcmp(vertices + size_t(table[slot]) * stride, v, stride) != 0)
+			slot = (slot + 1) & mask;
+
+		if (table[slot] == NO_INDEX)
+		{
+			if (unique != i)
+				memcpy(vertices + size_t(unique) * stride, v, stride);
+			table[slot] = unique++;
+		}
+
+		indicesOut[i] = table[slot];
+	}
+
+	return unique;
+}
+
+//
+// Forsyth's optimizer
+// Greedy: next triangle is the one with highest sum of its vertex scores.
+// Vertex score grows for vertices recently used (in simulated LRU cache)
+// and for vertices with few triangles left, so islands are finished before moving on
+//
+constexpr int FORSYTH_CACHE_SIZE = 32;
+constexpr float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+constexpr float FORSYTH_LAST_TRI_SCORE = 0.75f;
+constexpr float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+constexpr float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+static float forsythVertexScore(int cachePosition, uint remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	if (cachePosition >= 0)
+	{
+		// Vertices of last triangle get fixed score, so the same triangle is not reused immediately
+		if (cachePosition < 3)
+			score = FORSYTH_LAST_TRI_SCORE;
+		else
+		{
+			const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	score += FORSYTH_VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -FORSYTH_VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+void optimizeVertexCache(uint *indices, uint indexNumber, uint vertexNumber)
+{
+	const uint triNumber = indexNumber / 3;
+	if (triNumber < 2)
+		return;
+
+	// Triangles of each vertex: adjacency[adjacencyOffset[v] ... adjacencyOffset[v] + remaining[v]).
+	// Emitted triangles are swapped out of the range
+	vector<uint> remaining(vertexNumber, 0u);
+	for (uint i = 0; i < triNumber * 3; i++)
+		remaining[indices[i]]++;
+
+	vector<uint> adjacencyOffset(vertexNumber + 1, 0u);
+	for (uint v = 0; v < vertexNumber; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+	vector<uint> adjacency(triNumber * 3);
+	{
+		vector<uint> filled(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (uint t = 0; t < triNumber; t++)
+			for (uint k = 0; k < 3; k++)
+				adjacency[filled[indices[t * 3 + k]]++] = t;
+	}
+
+	vector<int> cachePosition(vertexNumber, -1);
+	vector<float> vertexScore(vertexNumber);
+	for (uint v = 0; v < vertexNumber; v++)
+		vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+	vector<float> triScore(triNumber);
+	for (uint t = 0; t < triNumber; t++)
+		triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	vector<uint8_t> emitted(triNumber, 0);
+	vector<uint> out;
+	out.reserve(triNumber * 3);
+
+	uint cache[FORSYTH_CACHE_SIZE + 3];
+	uint cacheCount = 0;
+	uint newCache[FORSYTH_CACHE_SIZE + 3];
+
+	uint bestTri = NO_INDEX;
+	uint nextUnemitted = 0; // when cache gives no candidate, continue with first triangle not emitted yet
+
+	for (uint n = 0; n < triNumber; n++)
+	{
+		if (bestTri == NO_INDEX)
+		{
+			while (emitted[nextUnemitted])
+				nextUnemitted++;
+			bestTri = nextUnemitted;
+		}
+
+		const uint *tri = indices + bestTri * 3;
+		emitted[bestTri] = 1;
+		out.push_back(tri[0]);
+		out.push_back(tri[1]);
+		out.push_back(tri[2]);
+
+		for (uint k = 0; k < 3; k++)
+		{
+			const uint v = tri[k];
+			uint *adj = &adjacency[adjacencyOffset[v]];
+			for (uint j = 0; j < remaining[v]; j++)
+			{
+				if (adj[j] == bestTri)
+				{
+					adj[j] = adj[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// LRU: vertices of emitted triangle go to front, rest are shifted
+		uint newCount = 0;
+		for (uint k = 0; k < 3; k++)
+			newCache[newCount++] = tri[k];
+		for (uint i = 0; i < cacheCount; i++)
+		{
+			const uint v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// Update scores of vertices in cache and evicted ones, and scores of their triangles
+		float bestScore = -1.0f;
+		bestTri = NO_INDEX;
+
+		for (uint i = 0; i < newCount; i++)
+		{
+			const uint v = newCache[i];
+			const int pos = i < (uint)FORSYTH_CACHE_SIZE ? (int)i : -1;
+			cachePosition[v] = pos;
+
+			const float score = forsythVertexScore(pos, remaining[v]);
+			const float diff = score - vertexScore[v];
+			vertexScore[v] = score;
+
+			const uint *adj = &adjacency[adjacencyOffset[v]];
+			for (uint j = 0; j < remaining[v]; j++)
+			{
+				const uint t = adj[j];
+				triScore[t] += diff;
+
+				if (pos >= 0 && triScore[t] > bestScore)
+				{
+					bestScore = triScore[t];
+					bestTri = t;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, (uint)FORSYTH_CACHE_SIZE);
+		memcpy(cache, newCache, cacheCount * sizeof(uint));
+	}
+
+	memcpy(indices, out.data(), out.size() * sizeof(uint));
+}
+
+uint optimizeVertexFetch(uint8 *vertices, uint vertexNumber, uint stride, uint *indices, uint indexNumber)
+{
+	vector<uint> remap(vertexNumber, NO_INDEX);
+	uint used = 0;
+
+	for (uint i = 0; i < indexNumber; i++)
+	{
+		uint &r = remap[indices[i]];
+		if (r == NO_INDEX)
+			r = used++;
+		indices[i] = r;
+	}
+
+	vector<uint8> reordered(size_t(used) * stride);
+	for (uint v = 0; v < vertexNumber; v++)
+		if (remap[v] != NO_INDEX)
+			memcpy(&reordered[size_t(remap[v]) * stride], vertices + size_t(v) * stride, stride);
+
+	memcpy(vertices, reordered.data(), reordered.size());
+
+	return used;
+}
+
+float calculateACMR(const uint *indices, uint indexNumber, uint vertexNumber, uint cacheSize)
+{
+	const uint triNumber = indexNumber / 3;
+	if (triNumber == 0)
+		return 0.0f;
+
+	// FIFO: vertex is in cache if less than cacheSize misses happened after it was loaded
+	vector<uint> loadedAt(vertexNumber, 0u); // number of misses including the one loaded vertex, 0 - never loaded
+	uint misses = 0;
+
+	for (uint i = 0; i < triNumber * 3; i++)
+	{
+		uint &stamp = loadedAt[indices[i]];
+		if (stamp == 0 || misses - stamp >= cacheSize)
+			stamp = ++misses;
+	}
+
+	return (float)misses / triNumber;
+}
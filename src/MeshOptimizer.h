@@ -0,0 +1,24 @@
+#pragma once
+#include "Common.h"
+
+//
+// Import-time processing of triangle lists
+//
+// Vertices are opaque blocks of stride bytes, so the same functions work for any vertex format.
+// Usual order: weldVertices() -> optimizeVertexCache() -> optimizeVertexFetch()
+//
+
+// Merges bitwise identical vertices. Unique vertices are moved to the beginning of array in order of first occurrence.
+// indicesOut receives one index per input vertex. Returns number of unique vertices
+uint weldVertices(uint8 *vertices, uint vertexNumber, uint stride, vector<uint>& indicesOut);
+
+// Reorders triangles to reuse post-transform vertex cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void optimizeVertexCache(uint *indices, uint indexNumber, uint vertexNumber);
+
+// Reorders vertices in order of first use by index buffer and remaps indices.
+// Unused vertices are removed. Returns number of vertices left
+uint optimizeVertexFetch(uint8 *vertices, uint vertexNumber, uint stride, uint *indices, uint indexNumber);
+
+// Average cache miss ratio: vertex shader invocations per triangle with FIFO cache of cacheSize vertices.
+// 3.0 for non-indexed triangles, about 0.6-0.7 for well optimized regular meshes
+float calculateACMR(const uint *indices, uint indexNumber, uint vertexNumber, uint cacheSize = 16);
@@ -18,6 +18,13 @@
 #include <cassert>
 #include <chrono>
 #include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <queue>
+#include <xmmintrin.h>
 
 #include <experimental/filesystem>
 
@@ -0,0 +1,163 @@
+#include "Pch.h"
+#include "FrameGraph.h"
+
+FrameGraph::Handle FrameGraph::Builder::create(const char *name, const TextureDesc& desc)
+{
+	Handle h = (Handle)_graph->_textures.size();
+
+	Texture t;
+	t.name = name;
+	t.desc = desc;
+	t.writers.push_back(_pass);
+	_graph->_textures.push_back(t);
+
+	_graph->_passes[_pass].creates.push_back(h);
+	return h;
+}
+
+FrameGraph::Handle FrameGraph::Builder::read(Handle h)
+{
+	assert(h < _graph->_textures.size());
+	_graph->_passes[_pass].reads.push_back(h);
+	return h;
+}
+
+FrameGraph::Handle FrameGraph::Builder::write(Handle h)
+{
+	assert(h < _graph->_textures.size());
+	_graph->_textures[h].writers.push_back(_pass);
+	_graph->_passes[_pass].writes.push_back(h);
+	return h;
+}
+
+void FrameGraph::Builder::setSideEffect()
+{
+	_graph->_passes[_pass].sideEffect = true;
+}
+
+ITexture* FrameGraph::Resources::getTexture(Handle h) const
+{
+	assert(h < _graph->_textures.size());
+	assert(_graph->_textures[h].tex && "Texture is not declared by pass or it was culled");
+	return _graph->_textures[h].tex;
+}
+
+void FrameGraph::addPass(const char *name, const SetupCallback& setup, const ExecuteCallback& execute)
+{
+	Pass p;
+	p.name = name;
+	p.execute = execute;
+	_passes.push_back(std::move(p));
+
+	Builder builder(this, (uint)_passes.size() - 1);
+	setup(builder);
+}
+
+void FrameGraph::use(Texture& t, uint pass)
+{
+	t.firstUse = std::min(t.firstUse, pass);
+	t.lastUse = std::max(t.lastUse, pass);
+}
+
+void FrameGraph::compile()
+{
+	// Pass is referenced by textures it writes, texture is referenced by passes read it
+	for (Pass& p : _passes)
+		p.refCount = (uint)(p.creates.size() + p.writes.size());
+
+	for (Pass& p : _passes)
+		for (Handle h : p.reads)
+			_textures[h].refCount++;
+
+	vector<Handle> unreferenced;
+	for (Handle h = 0; h < _textures.size(); h++)
+		if (_textures[h].refCount == 0)
+			unreferenced.push_back(h);
+
+	// Nobody reads texture -> writer may be culled -> textures read by writer may become unreferenced
+	while (!unreferenced.empty())
+	{
+		Texture &t = _textures[unreferenced.back()];
+		unreferenced.pop_back();
+
+		for (uint w : t.writers)
+		{
+			Pass &p = _passes[w];
+			if (p.refCount == 0 || --p.refCount > 0 || p.sideEffect)
+				continue;
+
+			for (Handle r : p.reads)
+				if (--_textures[r].refCount == 0)
+					unreferenced.push_back(r);
+		}
+	}
+
+	for (Texture& t : _textures)
+	{
+		t.firstUse = ~0u;
+		t.lastUse = 0;
+	}
+
+	for (uint i = 0; i < _passes.size(); i++)
+	{
+		Pass &p = _passes[i];
+		if (p.refCount == 0 && !p.sideEffect)
+			continue;
+
+		for (Handle h : p.creates) use(_textures[h], i);
+		for (Handle h : p.reads) use(_textures[h], i);
+		for (Handle h : p.writes) use(_textures[h], i);
+	}
+}
+
+void FrameGraph::execute()
+{
+	std::unordered_set<ITexture*> allocated;
+
+	_passesExecuted = 0;
+	_bytesAllocated = 0;
+
+	Resources resources(this);
+
+	for (uint i = 0; i < _passes.size(); i++)
+	{
+		Pass &p = _passes[i];
+		if (p.refCount == 0 && !p.sideEffect)
+			continue;
+
+		// Texture lifetime always starts at pass created it
+		for (Handle h : p.creates)
+		{
+			Texture &t = _textures[h];
+			_render->GetRenderTexture2D(&t.tex, t.desc.width, t.desc.height, t.desc.format);
+
+			if (allocated.insert(t.tex).second)
+				_bytesAllocated += calculateImageSize(t.desc.format, t.desc.width, t.desc.height);
+		}
+
+		p.execute(resources);
+		_passesExecuted++;
+
+		// Return textures to pool after last use, so next passes can take the same allocation
+		auto release = [&](Handle h)
+		{
+			Texture &t = _textures[h];
+			if (t.lastUse == i && t.tex)
+			{
+				_render->ReleaseRenderTexture2D(t.tex);
+				t.tex = nullptr;
+			}
+		};
+		for (Handle h : p.creates) release(h);
+		for (Handle h : p.reads) release(h);
+		for (Handle h : p.writes) release(h);
+	}
+
+	_texturesAllocated = (uint)allocated.size();
+}
+
+void FrameGraph::reset()
+{
+	_passes.clear();
+	_textures.clear();
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "Common.h"
+
+//
+// Frame graph
+//
+// Passes declare transient textures they create, read and write.
+// compile() culls passes which results are never used (and textures only they touch)
+// and computes first and last use of each texture.
+// execute() takes texture from render texture pool right before first use
+// and returns it right after last use, so textures with non-overlapping
+// lifetimes and same description share one allocation.
+//
+class FrameGraph
+{
+public:
+	typedef uint Handle;
+	static constexpr Handle INVALID_HANDLE = ~0u;
+
+	struct TextureDesc
+	{
+		uint width;
+		uint height;
+		TEXTURE_FORMAT format;
+	};
+
+	class Builder
+	{
+		FrameGraph *_graph;
+		uint _pass;
+
+	public:
+		Builder(FrameGraph *graph, uint pass) : _graph(graph), _pass(pass) {}
+
+		Handle create(const char *name, const TextureDesc& desc);
+		Handle read(Handle h);
+		Handle write(Handle h);
+
+		// Pass is never culled (writes to backbuffer, reads back data,...)
+		void setSideEffect();
+	};
+
+	class Resources
+	{
+		const FrameGraph *_graph;
+
+	public:
+		Resources(const FrameGraph *graph) : _graph(graph) {}
+
+		ITexture* getTexture(Handle h) const;
+	};
+
+	typedef std::function<void(Builder&)> SetupCallback;
+	typedef std::function<void(const Resources&)> ExecuteCallback;
+
+private:
+	struct Pass
+	{
+		const char *name;
+		ExecuteCallback execute;
+		vector<Handle> creates;
+		vector<Handle> reads;
+		vector<Handle> writes;
+		bool sideEffect{ false };
+		uint refCount{};
+	};
+
+	struct Texture
+	{
+		const char *name;
+		TextureDesc desc;
+		vector<uint> writers;
+		uint refCount{};
+		uint firstUse;
+		uint lastUse;
+		ITexture *tex{ nullptr };
+	};
+
+	IRender *_render{ nullptr };
+	vector<Pass> _passes;
+	vector<Texture> _textures;
+
+	// Statistic of last executed graph
+	uint _passesExecuted{};
+	uint _texturesAllocated{};
+	size_t _bytesAllocated{};
+
+	void use(Texture& t, uint pass);
+
+public:
+	FrameGraph(IRender *render) : _render(render) {}
+
+	void addPass(const char *name, const SetupCallback& setup, const ExecuteCallback& execute);
+	void compile();
+	void execute();
+	void reset();
+
+	uint passes() const { return (uint)_passes.size(); }
+	uint passesExecuted() const { return _passesExecuted; }
+	uint texturesDeclared() const { return (uint)_textures.size(); }
+	uint texturesAllocated() const { return _texturesAllocated; }
+	size_t bytesAllocated() const { return _bytesAllocated; }
+};
@@ -4,16 +4,21 @@
 class Mesh : public IMesh
 {
 	ICoreMesh *_coreMesh = nullptr;
+	AABB _aabb{};
+	BoundingSphere _sphere{};
 
 public:
 	Mesh(ICoreMesh *m) : _coreMesh(m) {}
 	Mesh(ICoreMesh *m, const string& filePath) : _coreMesh(m),_file(filePath) {}
+	Mesh(ICoreMesh *m, const string& filePath, const AABB& aabb, const BoundingSphere& sphere) : _coreMesh(m), _aabb(aabb), _sphere(sphere), _file(filePath) {}
 	virtual ~Mesh(); 
 
 	API GetCoreMesh(OUT ICoreMesh **meshOut) override;
 	API GetNumberOfVertex(OUT uint *number) override;
 	API GetAttributes(OUT INPUT_ATTRUBUTE *attribs) override;
 	API GetVertexTopology(OUT VERTEX_TOPOLOGY *topology) override;
+	API GetAABB(OUT AABB *aabb) override						{ *aabb = _aabb; return S_OK; }
+	API GetBoundingSphere(OUT BoundingSphere *sphere) override	{ *sphere = _sphere; return S_OK; }
 
 	BASE_RESOURCE_HEADER
 };
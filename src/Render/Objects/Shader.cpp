@@ -64,6 +64,41 @@ API Shader::SetUintParameter(const char *name, uint value)
 	return _coreShader->SetUintParameter(name, value);
 }
 
+API Shader::GetParameterHandle(const char *name, OUT uint *handle)
+{
+	return _coreShader->GetParameterHandle(name, handle);
+}
+
+API Shader::SetFloatParameter(uint handle, float value)
+{
+	return _coreShader->SetFloatParameter(handle, value);
+}
+
+API Shader::SetVec4Parameter(uint handle, const vec4 *value)
+{
+	return _coreShader->SetVec4Parameter(handle, value);
+}
+
+API Shader::SetMat4Parameter(uint handle, const mat4 *value)
+{
+	return _coreShader->SetMat4Parameter(handle, value);
+}
+
+API Shader::SetUintParameter(uint handle, uint value)
+{
+	return _coreShader->SetUintParameter(handle, value);
+}
+
+API Shader::GetUniformBlockHandle(const char *name, OUT uint *handle)
+{
+	return _coreShader->GetUniformBlockHandle(name, handle);
+}
+
+API Shader::SetUniformBlock(uint handle, const void *data)
+{
+	return _coreShader->SetUniformBlock(handle, data);
+}
+
 API Shader::FlushParameters()
 {
 	return _coreShader->FlushParameters();
@@ -22,6 +22,13 @@ public:
 	API SetVec4Parameter(const char* name, const vec4 *value) override;
 	API SetMat4Parameter(const char* name, const mat4 *value) override;
 	API SetUintParameter(const char* name, uint value) override;
+	API GetParameterHandle(const char* name, OUT uint *handle) override;
+	API SetFloatParameter(uint handle, float value) override;
+	API SetVec4Parameter(uint handle, const vec4 *value) override;
+	API SetMat4Parameter(uint handle, const mat4 *value) override;
+	API SetUintParameter(uint handle, uint value) override;
+	API GetUniformBlockHandle(const char* name, OUT uint *handle) override;
+	API SetUniformBlock(uint handle, const void *data) override;
 	API FlushParameters() override;
 
 
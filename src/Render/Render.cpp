@@ -4,12 +4,27 @@
 #include "ConsoleWindow.h"
 #include "SceneManager.h"
 #include "simplecpp.h"
+#include "ThreadPool.h"
+#include "ResourceManager.h"
+#include "UniformBlocks.h"
 #include <memory>
+#include <algorithm>
 
 extern Core *_pCore;
 DEFINE_DEBUG_LOG_HELPERS(_pCore)
 DEFINE_LOG_HELPERS(_pCore)
 
+// Must match STRUCTURED_BUFFER_IN slot of instance_buffer in common.h
+constexpr uint INSTANCE_BUFFER_SLOT = 1;
+
+// Free pool textures not requested for this number of frames are released
+constexpr int64_t TEXTURE_POOL_MAX_FREE_FRAMES = 3;
+
+static uint64_t texturePoolKey(uint width, uint height, TEXTURE_FORMAT format)
+{
+	return (uint64_t(width) << 40) | (uint64_t(height) << 16) | uint64_t(format);
+}
+
 /////////////////////////
 // Render
 /////////////////////////
@@ -280,6 +295,8 @@ Render::Render(ICoreRender *pCoreRender) : _pCoreRender(pCoreRender)
 	_pCore->GetSubSystem((ISubSystem**)&_fsystem, SUBSYSTEM_TYPE::FILESYSTEM);
 
 	_pCore->consoleWindow()->addCommand("shaders_reload", std::bind(&Render::shaders_reload, this, std::placeholders::_1, std::placeholders::_2));
+	_pCore->consoleWindow()->addCommand("shaders_warmup", std::bind(&Render::shaders_warmup, this, std::placeholders::_1, std::placeholders::_2));
+	_pCore->consoleWindow()->addCommand("texture_pool_budget", std::bind(&Render::texture_pool_budget, this, std::placeholders::_1, std::placeholders::_2));
 	
 	_pCore->AddProfilerCallback(this);
 }
@@ -291,11 +308,27 @@ Render::~Render()
 API Render::shaders_reload(const char ** args, uint argsNumber)
 {
 	return ShadersReload();
+}
+
+API Render::shaders_warmup(const char **args, uint argsNumber)
+{
+	return ShadersWarmUp();
 }
 
+API Render::texture_pool_budget(const char **args, uint argsNumber)
+{
+	if (argsNumber < 1)
+	{
+		LOG_FORMATTED("Texture pool budget: %u MB", (uint)(_texture_pool_budget / (1024 * 1024)));
+		return S_OK;
+	}
+
+	return SetRenderTexturePoolBudget((uint)atoi(args[0]));
+}
+
 uint Render::getNumLines()
 {
-	return 5;
+	return 12;
 }
 
 string Render::getString(uint i)
@@ -304,18 +337,32 @@ string Render::getString(uint i)
 	{
 		case 0: return "==== Render ====";
 		case 1: return "FPS: " + std::to_string(_pCore->FPSlazy());
-		case 2: return "Runtime Shaders: " + std::to_string(_shaders_pool.size());
-		case 3: return "Texture pool: " + std::to_string(_texture_pool.size());
-		case 4: return "";
+		case 2: return "Runtime Shaders: " + std::to_string(_shaders_pool.size()) + " (cache hits: " + std::to_string(_shaderCache.hits()) + ", misses: " + std::to_string(_shaderCache.misses()) + ")";
+		case 3: return "Texture pool: " + std::to_string(_texture_pool.size()) + " (" + std::to_string(_texture_pool_bytes / (1024 * 1024)) + " / " + std::to_string(_texture_pool_budget / (1024 * 1024)) + " MB)";
+		case 4:
+		{
+			string ret = "Texture pool formats:";
+			for (int f = 0; f < (int)TEXTURE_FORMAT::UNKNOWN; f++)
+				if (_texture_pool_format_bytes[f])
+					ret += string(" ") + formatName((TEXTURE_FORMAT)f) + " " + std::to_string(_texture_pool_format_bytes[f] / 1024) + " KB";
+			return ret;
+		}
+		case 5: return "Frame graph: passes " + std::to_string(_frameGraph.passesExecuted()) + "/" + std::to_string(_frameGraph.passes()) + ", textures " + std::to_string(_frameGraph.texturesAllocated()) + "/" + std::to_string(_frameGraph.texturesDeclared()) + " (" + std::to_string(_frameGraph.bytesAllocated() / (1024 * 1024)) + " MB)";
+		case 6: return "Visible meshes: " + std::to_string(_visibleMeshes);
+		case 7: return "Culled meshes: " + std::to_string(_culledMeshes);
+		case 8: return "State changes saved: " + std::to_string(_stateChangesSavedLastFrame);
+		case 9: return "Draw calls: " + std::to_string(_drawCallsLastFrame);
+		case 10: return "Shader jobs pending: " + std::to_string(_shaderJobs.size()) + " (driver: " + std::to_string(_shaderDriverJobs.size()) + ", reload: " + std::to_string(_shaderReloadJobs.size()) + ")";
+		case 11: return "";
 	}
 	assert(false);
 	return "";
 }
 
-void Render::renderForward(RenderBuffers& buffers, vector<RenderMesh>& meshes)
+void Render::renderForward(ITexture *colorHDR, ITexture *depth, vector<RenderMesh>& meshes)
 {
-	renderTarget->SetColorTexture(0, buffers.colorHDR.Get());
-	renderTarget->SetDepthTexture(buffers.depth.Get());
+	renderTarget->SetColorTexture(0, colorHDR);
+	renderTarget->SetDepthTexture(depth);
 	_pCoreRender->SetCurrentRenderTarget(renderTarget.Get());
 	{
 		_pCoreRender->Clear();
@@ -325,7 +372,7 @@ void Render::renderForward(RenderBuffers& buffers, vector<RenderMesh>& meshes)
 	_pCoreRender->RestoreDefaultRenderTarget();
 }
 
-void Render::renderEnginePost(RenderBuffers& buffers)
+void Render::renderEnginePost(ITexture *colorHDR, ITexture *color)
 {
 	//_pCoreRender->PushStates();
 
@@ -333,13 +380,11 @@ void Render::renderEnginePost(RenderBuffers& buffers)
 	_postPlane->GetAttributes(&attribs);
 
 	IShader *shader = getShader({attribs, RENDER_PASS::ENGINE_POST});
-	_pCoreRender->SetShader(shader);
-
-	_pCoreRender->BindTexture(0, buffers.colorHDR.Get());
+	_pCoreRender->SetPipelineState(pipelineState(shader, RENDER_PASS::ENGINE_POST, attribs));
 
-	_pCoreRender->SetDepthTest(0);
+	_pCoreRender->BindTexture(0, colorHDR);
 
-	renderTarget->SetColorTexture(0, buffers.color.Get());
+	renderTarget->SetColorTexture(0, color);
 	_pCoreRender->SetCurrentRenderTarget(renderTarget.Get());_pCoreRender->SetCurrentRenderTarget(renderTarget.Get());
 	{
 		_pCoreRender->Draw(_postPlane.Get());
@@ -347,7 +392,6 @@ void Render::renderEnginePost(RenderBuffers& buffers)
 	_pCoreRender->RestoreDefaultRenderTarget();
 
 	_pCoreRender->UnbindAllTextures();
-	_pCoreRender->SetDepthTest(1);
 
 	//_pCoreRender->PopStates();
 }
@@ -361,69 +405,71 @@ void Render::RenderFrame(const ICamera *pCamera)
 	const_cast<ICamera*>(pCamera)->GetViewProjectionMatrix(&ViewProjMat, aspect);
 	const_cast<ICamera*>(pCamera)->GetViewMatrix(&ViewMat);
 
+	// Application loads its resources in init callbacks, so all meshes are known here
+	if (!_shadersWarmedUp)
+		ShadersWarmUp();
+
+	_stateChangesSavedLastFrame = _stateChangesSaved;
+	_stateChangesSaved = 0;
+
+	_shaderSortIds.resetIfFull();
+	_textureSortIds.resetIfFull();
+	_meshSortIds.resetIfFull();
+	_drawCallsLastFrame = _drawCalls;
+	_drawCalls = 0;
+
 	vector<RenderMesh> meshes;
-	getRenderMeshes(meshes);
+	getRenderMeshes(meshes, ViewProjMat);
+
+	_frameGraph.reset();
 
-	RenderBuffers buffers = initBuffers(w, h);
+	FrameGraph::Handle colorHDR, depth, color;
 
 	// Forward pass
 	//
-	renderForward(buffers, meshes);
+	_frameGraph.addPass("Forward",
+		[&](FrameGraph::Builder& b)
+		{
+			colorHDR = b.create("colorHDR", {w, h, TEXTURE_FORMAT::RGBA16F});
+			depth = b.create("depth", {w, h, TEXTURE_FORMAT::D24S8});
+		},
+		[&](const FrameGraph::Resources& r)
+		{
+			renderForward(r.getTexture(colorHDR), r.getTexture(depth), meshes);
+		});
 
 	// Engine post pass
 	//
-	renderEnginePost(buffers);
-
+	_frameGraph.addPass("EnginePost",
+		[&](FrameGraph::Builder& b)
+		{
+			b.read(colorHDR);
+			color = b.create("color", {w, h, TEXTURE_FORMAT::RGBA8});
+		},
+		[&](const FrameGraph::Resources& r)
+		{
+			renderEnginePost(r.getTexture(colorHDR), r.getTexture(color));
+		});
 
-#if 0
-	///////////////////////////////
-	// ID pass
-	///////////////////////////////
-	//
-	// Render all models ID (only for debug picking)
+	// Copy to backbuffer (GL blits depth too)
 	//
-	{
-		renderTarget->SetColorTexture(0, buffers.id.Get());
-		renderTarget->SetDepthTexture(buffers.depth.Get());
-
-		_pCoreRender->SetCurrentRenderTarget(renderTarget.Get());
+	_frameGraph.addPass("Blit",
+		[&](FrameGraph::Builder& b)
 		{
-			_pCoreRender->Clear();
-
-			_draw_meshes(ViewMat, ViewProjMat, meshes, RENDER_PASS::ID);
-		}
-
-		#if 0
-			IInput *i;
-			_pCore->GetSubSystem((ISubSystem**)&i, SUBSYSTEM_TYPE::INPUT);
-			int pr;
-			i->IsMoisePressed(&pr, MOUSE_BUTTON::LEFT);
-			if (pr)
-			{
-				uint curX, curY;
-				i->GetMousePos(&curX, &curY);
-
-				ICoreTexture *coreTex;
-				tex->GetCoreTexture(&coreTex);
-				uint data;
-				uint read;
-				_pCoreRender->ReadPixel2D(coreTex, &data, &read, curX, curY);
-				if (read > 0)
-				{
-					LOG_FORMATTED("Id = %i", data);
-				}
-			}
-		#endif
-
-		_pCoreRender->RestoreDefaultRenderTarget();
-		renderTarget->UnbindAll();
-	}
-#endif
-
-	_pCoreRender->BlitRenderTargetToDefault(renderTarget.Get());
-	renderTarget->UnbindAll();
-
-	releaseBuffers(buffers);
+			b.read(color);
+			b.read(depth);
+			b.setSideEffect();
+		},
+		[&](const FrameGraph::Resources& r)
+		{
+			renderTarget->SetColorTexture(0, r.getTexture(color));
+			renderTarget->SetDepthTexture(r.getTexture(depth));
+			_pCoreRender->BlitRenderTargetToDefault(renderTarget.Get());
+			renderTarget->UnbindAll();
+		});
+
+	_frameGraph.compile();
+	_frameGraph.execute();
 }
 
 API Render::RenderPassIDPass(const ICamera *pCamera, ITexture *tex, ITexture *depthTex)
@@ -440,7 +486,7 @@ API Render::RenderPassIDPass(const ICamera *pCamera, ITexture *tex, ITexture *de
 	const_cast<ICamera*>(pCamera)->GetViewMatrix(&ViewMat);
 	
 	vector<RenderMesh> meshes;
-	getRenderMeshes(meshes);
+	getRenderMeshes(meshes, ViewProjMat);
 
 	renderTarget->SetColorTexture(0, tex);
 	renderTarget->SetDepthTexture(depthTex);
@@ -467,7 +513,7 @@ API Render::RenderPassGUI()
 	if (!shader)
 		return S_OK;
 
-	_pCoreRender->SetShader(shader);
+	_pCoreRender->SetPipelineState(pipelineState(shader, RENDER_PASS::FONT, attribs));
 
 	uint w, h;
 	_pCoreRender->GetViewport(&w, &h);
@@ -478,9 +524,6 @@ API Render::RenderPassGUI()
 
 	_pCoreRender->BindTexture(0, fontTexture.Get());
 
-	_pCoreRender->SetBlendState(BLEND_FACTOR::ONE, BLEND_FACTOR::ONE_MINUS_SRC_ALPHA);
-	_pCoreRender->SetDepthTest(0);
-
 	//string fps = "FPS=" + std::to_string(_pCore->FPSlazy());
 
 	float offsetVert = 0.0f;
@@ -537,131 +580,456 @@ API Render::RenderPassGUI()
 	_pCoreRender->UnbindAllTextures();
 	_pCoreRender->SetStructuredBufer(1, nullptr);
 
-	_pCoreRender->SetDepthTest(1);
-	_pCoreRender->SetBlendState(BLEND_FACTOR::NONE, BLEND_FACTOR::NONE);
-
 	return S_OK;
 }
 
 void Render::_update()
 {
-	auto before = _texture_pool.size();
+	// LRU list is ordered by release frame so only old textures at the front are visited
+	while (!_texture_lru.empty())
+	{
+		ITexture *tex = _texture_lru.front();
+		if (_pCore->frame() - _texture_pool[tex].frame <= TEXTURE_POOL_MAX_FREE_FRAMES)
+			break;
+		evictTexture2d(tex);
+	}
+
+	reloadChangedShaders();
+}
+
+Render::ShaderJobResult Render::prepareShader(const ShaderRequirement &req)
+{
+	ShaderJobResult ret;
+	vector<string> defines;
+
+	const auto process_shader = [&](const char *&ppTextOut, const char *ppTextIn, const string& fileNameIn, const string&& fileNameOut, int type) -> void
+	{
+		simplecpp::DUI dui;
+
+		if (isOpenGL())
+			dui.defines.push_back("ENG_OPENGL");
+		else
+			dui.defines.push_back("ENG_DIRECTX11");
+
+		if (type == 0)
+			dui.defines.push_back("ENG_SHADER_VERTEX");
+		else if (type == 1)
+			dui.defines.push_back("ENG_SHADER_PIXEL");
+		else if (type == 2)
+			dui.defines.push_back("ENG_SHADER_GEOMETRY");
+
+		if ((int)(req.attributes & INPUT_ATTRUBUTE::NORMAL)) dui.defines.push_back("ENG_INPUT_NORMAL");
+		if ((int)(req.attributes & INPUT_ATTRUBUTE::TEX_COORD)) dui.defines.push_back("ENG_INPUT_TEXCOORD");
+		if ((int)(req.attributes & INPUT_ATTRUBUTE::COLOR)) dui.defines.push_back("ENG_INPUT_COLOR");
+		if ((int)(req.attributes & INPUT_ATTRUBUTE::TANGENT)) dui.defines.push_back("ENG_INPUT_TANGENT");
+		if ((int)(req.attributes & INPUT_ATTRUBUTE::NORMAL_OCTAHEDRAL)) dui.defines.push_back("ENG_INPUT_NORMAL_OCTAHEDRAL");
+		if ((int)(req.attributes & INPUT_ATTRUBUTE::TANGENT_OCTAHEDRAL)) dui.defines.push_back("ENG_INPUT_TANGENT_OCTAHEDRAL");
+
+		defines.insert(defines.end(), dui.defines.begin(), dui.defines.end());
+
+		string fullPath = shaderDir() + '\\' + fileNameIn;
+
+		const ShaderSourceTokens &source = shaderSourceTokens(fullPath, ppTextIn);
+
+		// Preprocessor adds file names for macros, cached vector must stay untouched
+		simplecpp::OutputList outputList;
+		std::vector<std::string> files = source.files;
+		std::map<std::string, simplecpp::TokenList*> included = source.included;
+
+		simplecpp::TokenList outputTokens(files);
+
+		simplecpp::preprocess(outputTokens, *source.rawtokens, files, included, dui, &outputList);
+
+		// Headers missed by simplecpp::load() are loaded by preprocess() and owned by us
+		for (auto &it : included)
+			if (source.included.find(it.first) == source.included.end())
+				delete it.second;
+
+		const string out = outputTokens.stringify();
+		auto size = out.size();
+
+		// Workaround for opengl because C preprocessor eats up unknown derictive "#version 420"
+		if (isOpenGL())
+			size += 13;
+
+		char *tmp = new char[size + 1];
+		if (isOpenGL())
+		{
+			strncpy(tmp + 0, "#version 420\n", 13);
+			strncpy(tmp + 13, out.c_str(), size - 13);
+		} else
+			strncpy(tmp, out.c_str(), size);
 
-	_texture_pool.erase(std::remove_if(_texture_pool.begin(), _texture_pool.end(), [&](const TexturePoolable& r) -> bool
+		tmp[size] = '\0';
+
+		ppTextOut = tmp;
+	};
+
+	const char *text;
+
+	// Raw pointer: ComPtr copy would change reference counter from worker thread
+	ITextFile *targetShader = passShaderFile(req.pass);
+
+	targetShader->GetText(&text);
+
+	const char *pFileIn;
+	targetShader->GetFile(&pFileIn);
+	string fileIn = pFileIn;
+
+	process_shader(ret.vert, text, fileIn, "out_v.shader", 0);
+	process_shader(ret.frag, text, fileIn, "out_f.shader", 1);
+
+	ret.cacheKey = _shaderCache.key(ret.vert, nullptr, ret.frag, defines);
+	ret.cacheVariant = _shaderCache.variant(fileIn.c_str(), defines);
+
+	if (!_shaderCache.load(ret.cacheKey, ret.cacheVariant, ret.binary))
 	{
-		return r.free == 1 && (_pCore->frame() - r.frame) > 3;
-	}),
-    _texture_pool.end());
+		uint8 *data;
+		uint size;
+		if (SUCCEEDED(_pCoreRender->CompileShaderBinary(&data, &size, ret.vert, ret.frag, nullptr)))
+		{
+			ret.binary.assign(data, data + size);
+			delete[] data;
+			_shaderCache.save(ret.cacheKey, ret.cacheVariant, ret.binary.data(), size);
+		}
+	}
 
-	//if (before != _texture_pool.length())
-	//	LOG_FORMATTED("Render::_update() textures removed. was = %i, now = %i", before, _texture_pool.length());
+	return ret;
 }
 
-IShader* Render::getShader(const ShaderRequirement &req)
+ITextFile* Render::passShaderFile(RENDER_PASS pass)
+{
+	switch (pass)
+	{
+		case RENDER_PASS::ID: return _idShader.Get();
+		case RENDER_PASS::FORWARD: return _forwardShader.Get();
+		case RENDER_PASS::ENGINE_POST: return _postShader.Get();
+		case RENDER_PASS::FONT: return _fontShader.Get();
+	}
+	return nullptr;
+}
+
+string Render::shaderDir()
+{
+	// TODO: move to Common.h or filesystem
+	const char *pString;
+	_pCore->GetInstalledDir(&pString);
+	return string(pString) + '\\' + SHADER_DIR;
+}
+
+Render::ShaderSourceTokens::~ShaderSourceTokens()
+{
+	simplecpp::cleanup(included);
+}
+
+const Render::ShaderSourceTokens& Render::shaderSourceTokens(const string& fullPath, const char *text)
+{
+	std::lock_guard<std::mutex> lock(_shaderSourceTokensMutex);
+
+	auto it = _shaderSourceTokens.find(fullPath);
+	if (it != _shaderSourceTokens.end())
+		return *it->second;
+
+	ShaderSourceTokens *source = new ShaderSourceTokens;
+
+	simplecpp::OutputList outputList;
+	std::stringstream f(text);
+	source->rawtokens = unique_ptr<simplecpp::TokenList>(new simplecpp::TokenList(f, source->files, fullPath, &outputList));
+
+	// Tokenize all includes once. Variants differ only by defines
+	source->included = simplecpp::load(*source->rawtokens, source->files, simplecpp::DUI(), &outputList);
+
+	_shaderSourceTokens.emplace(fullPath, unique_ptr<ShaderSourceTokens>(source));
+
+	return *source;
+}
+
+// Shader takes ownership of texts. Texts of not created shaders must be freed here
+void Render::freeShaderTexts(ShaderJobResult& job)
+{
+	_pCoreRender->CancelShaderCompile(job.vert, job.frag, nullptr);
+	delete[] job.vert;
+	delete[] job.frag;
+	job.vert = nullptr;
+	job.frag = nullptr;
+}
+
+// Binary is created on worker if backend can compile without context (DX11).
+// Otherwise driver threads compile it if driver supports that (GL), CreateShader() takes result
+bool Render::startDriverCompile(const ShaderJobResult& job)
+{
+	return job.binary.empty() && SUCCEEDED(_pCoreRender->StartShaderCompile(job.vert, job.frag, nullptr));
+}
+
+IShader* Render::compileShader(ShaderJobResult& job)
 {
 	IShader *pShader = nullptr;
 
+	bool compiled = false;
+
+	if (!job.binary.empty())
+		compiled = SUCCEEDED(_pResMan->CreateShaderFromBinary(&pShader, job.binary.data(), (uint)job.binary.size(), job.vert, nullptr, job.frag)) && pShader != nullptr;
+
+	if (!compiled)
+	{
+		compiled = SUCCEEDED(_pResMan->CreateShader(&pShader, job.vert, nullptr, job.frag)) && pShader != nullptr;
+
+		uint size;
+		ICoreShader *coreShader = compiled ? getCoreShader(pShader) : nullptr;
+		if (coreShader && SUCCEEDED(_pCoreRender->GetShaderBinary(coreShader, nullptr, &size)))
+		{
+			job.binary.resize(size);
+			if (SUCCEEDED(_pCoreRender->GetShaderBinary(coreShader, job.binary.data(), &size)))
+				_shaderCache.save(job.cacheKey, job.cacheVariant, job.binary.data(), size);
+		}
+	}
+
+	if (!compiled)
+	{
+		freeShaderTexts(job);
+		return nullptr;
+	}
+
+	return pShader;
+}
+
+IShader* Render::createShader(const ShaderRequirement &req, ShaderJobResult& job)
+{
+	IShader *pShader = compileShader(job);
+
+	if (!pShader)
+	{
+		LOG_FATAL("Render::_get_shader(): can't compile standard shader\n");
+		_shaders_pool.emplace(req, ShaderPtr(nullptr));
+	}
+	else
+		_shaders_pool.emplace(req, ShaderPtr(pShader));
+
+	return pShader;
+}
+
+IShader* Render::getShader(const ShaderRequirement &req)
+{
 	auto it = _shaders_pool.find(req);
+	if (it != _shaders_pool.end())
+		return it->second.Get();
+
+	// Variant is compiling by driver already. CreateShader() waits for it
+	auto driverIt = _shaderDriverJobs.find(req);
+	if (driverIt != _shaderDriverJobs.end())
+	{
+		ShaderJobResult job = driverIt->second;
+		_shaderDriverJobs.erase(driverIt);
+		return createShader(req, job);
+	}
+
+	// Variant is compiling on worker already
+	auto jobIt = _shaderJobs.find(req);
+	if (jobIt != _shaderJobs.end())
+	{
+		ShaderJobResult job = jobIt->second.get();
+		_shaderJobs.erase(jobIt);
+		return createShader(req, job);
+	}
 
+	ShaderJobResult job = prepareShader(req);
+	return createShader(req, job);
+}
+
+IShader* Render::getShaderAsync(const ShaderRequirement &req)
+{
+	auto it = _shaders_pool.find(req);
 	if (it != _shaders_pool.end())
+		return it->second.Get();
+
+	auto driverIt = _shaderDriverJobs.find(req);
+	if (driverIt != _shaderDriverJobs.end())
 	{
-		ShaderPtr& shaderPtr = it->second;
-		return shaderPtr.Get();
+		int compiling;
+		_pCoreRender->IsShaderCompiling(&compiling, driverIt->second.vert, driverIt->second.frag, nullptr);
+		if (compiling)
+			return nullptr;
+
+		ShaderJobResult job = driverIt->second;
+		_shaderDriverJobs.erase(driverIt);
+		return createShader(req, job);
 	}
-	else
+
+	auto jobIt = _shaderJobs.find(req);
+	if (jobIt == _shaderJobs.end())
 	{
-		const auto process_shader = [&](const char *&ppTextOut, const char *ppTextIn, const string& fileNameIn, const string&& fileNameOut, int type) -> void
-		{
-			simplecpp::DUI dui;
-
-			if (isOpenGL())
-				dui.defines.push_back("ENG_OPENGL");
-			else
-				dui.defines.push_back("ENG_DIRECTX11");
-
-			if (type == 0)
-				dui.defines.push_back("ENG_SHADER_VERTEX");
-			else if (type == 1)
-				dui.defines.push_back("ENG_SHADER_PIXEL");
-			else if (type == 2)
-				dui.defines.push_back("ENG_SHADER_GEOMETRY");
-
-			if ((int)(req.attributes & INPUT_ATTRUBUTE::NORMAL)) dui.defines.push_back("ENG_INPUT_NORMAL");
-			if ((int)(req.attributes & INPUT_ATTRUBUTE::TEX_COORD)) dui.defines.push_back("ENG_INPUT_TEXCOORD");
-			if ((int)(req.attributes & INPUT_ATTRUBUTE::COLOR)) dui.defines.push_back("ENG_INPUT_COLOR");
-
-			// TODO: move to Common.h or filesystem
-			const char *pString;
-			_pCore->GetInstalledDir(&pString);
-			string installedDir = string(pString);
-			string fullPath = installedDir + '\\' + SHADER_DIR + '\\' + fileNameIn;
-
-			simplecpp::OutputList outputList;
-			std::vector<std::string> files;
-			string textIn = ppTextIn;
-			std::stringstream f(textIn);
-			std::map<std::string, simplecpp::TokenList*> included;
-
-			simplecpp::TokenList rawtokens(f, files, fullPath, &outputList);
-
-			simplecpp::TokenList outputTokens(files);
-
-			simplecpp::preprocess(outputTokens, rawtokens, files, included, dui, &outputList);
-			const string out = outputTokens.stringify();
-			auto size = out.size();
-
-			// Workaround for opengl because C preprocessor eats up unknown derictive "#version 420"
-			if (isOpenGL())
-				size += 13;
-
-			char *tmp = new char[size + 1];
-			if (isOpenGL())
-			{
-				strncpy(tmp + 0, "#version 420\n", 13);
-				strncpy(tmp + 13, out.c_str(), size - 13);
-			} else
-				strncpy(tmp, out.c_str(), size);
+		_shaderJobs.emplace(req, _pCore->threadPool()->submit([this, req]() { return prepareShader(req); }));
+		return nullptr;
+	}
 
-			tmp[size] = '\0';
+	if (jobIt->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return nullptr;
 
-			ppTextOut = tmp;
-		};
+	ShaderJobResult job = jobIt->second.get();
+	_shaderJobs.erase(jobIt);
 
-		const char *text;
+	// Main thread doesn't wait for compilation
+	if (startDriverCompile(job))
+	{
+		_shaderDriverJobs.emplace(req, job);
+		return nullptr;
+	}
 
-		WRL::ComPtr<ITextFile> targetShader;
+	return createShader(req, job);
+}
 
-		switch (req.pass)
-		{
-			case RENDER_PASS::ID: targetShader = _idShader; break;
-			case RENDER_PASS::FORWARD: targetShader = _forwardShader; break;
-			case RENDER_PASS::ENGINE_POST: targetShader = _postShader; break;
-			case RENDER_PASS::FONT: targetShader = _fontShader; break;
-		}
+void Render::waitShaderJobs()
+{
+	for (auto &it : _shaderJobs)
+	{
+		ShaderJobResult job = it.second.get();
+		freeShaderTexts(job);
+	}
+	_shaderJobs.clear();
+
+	for (auto &it : _shaderDriverJobs)
+		freeShaderTexts(it.second);
+	_shaderDriverJobs.clear();
+
+	for (auto &it : _shaderReloadJobs)
+	{
+		ShaderJobResult job = it.second.get();
+		freeShaderTexts(job);
+	}
+	_shaderReloadJobs.clear();
+}
 
-		targetShader->GetText(&text);
+// simplecpp keeps paths with '/' separators, Windows paths are case insensitive
+static string normalizeShaderPath(string path)
+{
+	std::replace(path.begin(), path.end(), '\\', '/');
+	std::transform(path.begin(), path.end(), path.begin(), ::tolower);
+	return path;
+}
 
-		const char *pFileIn;
-		targetShader->GetFile(&pFileIn);
-		string fileIn = pFileIn;
+void Render::reloadChangedShaders()
+{
+	// Changes made during compilation stay in watcher until batch is finished
+	if (!_shaderReloadJobs.empty())
+	{
+		for (auto &it : _shaderReloadJobs)
+			if (it.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return;
+		finishShaderReload();
+	}
 
-		const char *textVertOut; 
-		const char *textFragOut;
+	// Shader texts and tokens can't be changed while workers read them.
+	// Variants compiled by driver are prepared from current texts and would be stale after reload
+	if (!_shaderJobs.empty() || !_shaderDriverJobs.empty())
+		return;
 
-		process_shader(textVertOut, text, fileIn, "out_v.shader", 0);
-		process_shader(textFragOut, text, fileIn, "out_f.shader", 1);
+	vector<string> files;
+	bool overflow = false;
+	if (!_shaderWatcher.popChanges(files, overflow))
+		return;
 
-		bool compiled = SUCCEEDED(_pResMan->CreateShader(&pShader, textVertOut, nullptr, textFragOut)) && pShader != nullptr;
+	const string dir = shaderDir();
 
-		if (!compiled)
-		{
-			LOG_FATAL("Render::_get_shader(): can't compile standard shader\n");
-			_shaders_pool.emplace(req, ShaderPtr(nullptr));
-		}
+	std::unordered_set<string> changed;
+	for (const string& f : files)
+		changed.insert(normalizeShaderPath(dir + '\\' + f));
+
+	std::unordered_set<int> passes;
+
+	for (RENDER_PASS pass : {RENDER_PASS::ID, RENDER_PASS::FORWARD, RENDER_PASS::ENGINE_POST, RENDER_PASS::FONT})
+	{
+		ITextFile *file = passShaderFile(pass);
+
+		const char *pFile;
+		file->GetFile(&pFile);
+		const string fullPath = dir + '\\' + pFile;
+
+		bool affected = overflow || changed.find(normalizeShaderPath(fullPath)) != changed.end();
+
+		// Included files are known only after source was tokenized
+		auto tokensIt = _shaderSourceTokens.find(fullPath);
+		if (tokensIt != _shaderSourceTokens.end())
+			for (const string& dependency : tokensIt->second->files)
+				affected = affected || changed.find(normalizeShaderPath(dependency)) != changed.end();
+
+		if (!affected)
+			continue;
+
+		file->Reload();
+
+		if (tokensIt != _shaderSourceTokens.end())
+			_shaderSourceTokens.erase(tokensIt);
+
+		passes.insert((int)pass);
+	}
+
+	if (passes.empty())
+		return;
+
+	for (auto &it : _shaders_pool)
+	{
+		if (passes.find((int)it.first.pass) == passes.end())
+			continue;
+
+		ShaderRequirement req = it.first;
+		_shaderReloadJobs.emplace_back(req, _pCore->threadPool()->submit([this, req]() { return prepareShader(req); }));
+	}
+
+	LOG_FORMATTED("Shader files changed, recompiling %u variants...", (uint)_shaderReloadJobs.size());
+}
+
+void Render::finishShaderReload()
+{
+	vector<std::pair<ShaderRequirement, ShaderPtr>> shaders;
+	bool failed = false;
+
+	// Compiled already on workers if backend supports it (DX11).
+	// GL compiles here, whole batch in parallel if driver can
+	vector<std::pair<ShaderRequirement, ShaderJobResult>> jobs;
+	for (auto &it : _shaderReloadJobs)
+	{
+		jobs.emplace_back(it.first, it.second.get());
+		startDriverCompile(jobs.back().second);
+	}
+
+	_shaderReloadJobs.clear();
+
+	for (auto &it : jobs)
+	{
+		ShaderJobResult& job = it.second;
+
+		IShader *shader = nullptr;
+		if (failed)
+			freeShaderTexts(job);
 		else
-			_shaders_pool.emplace(req, ShaderPtr(pShader));
+			shader = compileShader(job);
+
+		// Variant that failed before has nothing to keep. It is retried and doesn't fail the batch
+		auto prev = _shaders_pool.find(it.first);
+		const bool hadShader = prev != _shaders_pool.end() && prev->second;
+
+		if (shader == nullptr && !hadShader)
+			continue;
+
+		failed = failed || shader == nullptr;
+
+		shaders.emplace_back(it.first, ShaderPtr(shader));
 	}
-	return pShader;
+
+	// Old variants stay in use until error is fixed, new ones are released with shaders vector
+	if (failed)
+	{
+		LOG_WARNING("Render::finishShaderReload(): shader compilation failed, previous shaders are kept");
+		return;
+	}
+
+	_shaderMeshParameters.clear();
+	_pipelineStates.clear();
+
+	for (auto &it : shaders)
+		_shaders_pool[it.first] = it.second;
+
+	LOG_FORMATTED("Shaders reloaded: %u variants", (uint)shaders.size());
 }
 
 bool Render::isOpenGL()
@@ -671,99 +1039,514 @@ bool Render::isOpenGL()
 	return (strcmp("GLCoreRender", gapi) == 0);	
 }
 
-void Render::getRenderMeshes(vector<RenderMesh>& meshes_vec)
+void Render::CullingBounds::resize(uint n)
 {
-	SceneManager *sm = (SceneManager*)_pSceneMan;
+	const size_t packed = (n + 3) & ~3u;
+	centerX.resize(packed); centerY.resize(packed); centerZ.resize(packed);
+	extentX.resize(packed); extentY.resize(packed); extentZ.resize(packed);
+	number = n;
+}
 
-	for (tree<IGameObject*>::iterator it = sm->_gameobjects.begin(); it != sm->_gameobjects.end(); ++it)
+void Render::CullingBounds::set(uint i, const AABB& aabb)
+{
+	centerX[i] = (aabb.maxX + aabb.minX) * 0.5f;
+	centerY[i] = (aabb.maxY + aabb.minY) * 0.5f;
+	centerZ[i] = (aabb.maxZ + aabb.minZ) * 0.5f;
+	extentX[i] = (aabb.maxX - aabb.minX) * 0.5f;
+	extentY[i] = (aabb.maxY - aabb.minY) * 0.5f;
+	extentZ[i] = (aabb.maxZ - aabb.minZ) * 0.5f;
+}
+
+void Render::CullingBounds::copy(uint dst, uint src)
+{
+	centerX[dst] = centerX[src]; centerY[dst] = centerY[src]; centerZ[dst] = centerZ[src];
+	extentX[dst] = extentX[src]; extentY[dst] = extentY[src]; extentZ[dst] = extentZ[src];
+}
+
+//
+// Tests 4 boxes per iteration against 6 frustum planes
+// Box is outside if for any plane: dot(n, center) + d + dot(|n|, extents) < 0
+//
+void Render::cullBounds(const mat4& ViewProj)
+{
+	vec4 planes[6];
+	extractFrustumPlanes(planes, ViewProj);
+
+	const size_t packed = _cullingBounds.centerX.size();
+	_visibility.resize(packed);
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t i = 0; i < packed; i += 4)
 	{
-		IGameObject *go = *it;
-		IModel *model = dynamic_cast<IModel*>(go);
-		if (model)
+		const __m128 cx = _mm_loadu_ps(&_cullingBounds.centerX[i]);
+		const __m128 cy = _mm_loadu_ps(&_cullingBounds.centerY[i]);
+		const __m128 cz = _mm_loadu_ps(&_cullingBounds.centerZ[i]);
+		const __m128 ex = _mm_loadu_ps(&_cullingBounds.extentX[i]);
+		const __m128 ey = _mm_loadu_ps(&_cullingBounds.extentY[i]);
+		const __m128 ez = _mm_loadu_ps(&_cullingBounds.extentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+
+		for (int p = 0; p < 6; p++)
 		{
-			uint meshes;
-			model->GetNumberOfMesh(&meshes);
+			const vec4& pl = planes[p];
 
-			for (auto j = 0u; j < meshes; j++)
-			{
-				uint id;
-				model->GetID(&id);
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(pl.x)), _mm_mul_ps(cy, _mm_set1_ps(pl.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(pl.z)), _mm_set1_ps(pl.w)));
 
-				IMesh *mesh = nullptr;
-				model->GetMesh(&mesh, j);
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(pl.x))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(pl.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(std::abs(pl.z))));
 
-				mat4 mat;
-				model->GetModelMatrix(&mat);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+		}
 
-				meshes_vec.push_back({id, mesh, mat});
-			}
+		int mask = _mm_movemask_ps(outside);
+
+		for (int j = 0; j < 4; j++)
+			_visibility[i + j] = (mask & (1 << j)) ? 0 : 1;
+	}
+}
+
+API Render::SceneSubscriber::Call(OUT IGameObject *go)
+{
+	if (_added)
+		_render->addRenderObject(go);
+	else
+		_render->removeRenderObject(go);
+	return S_OK;
+}
+
+void Render::subscribeTransform(RenderObject& obj, bool subscribe)
+{
+	IPositionEvent *posEv;
+	IRotationEvent *rotEv;
+	IScaleEvent *scaleEv;
+	obj.model->GetPositionEv(&posEv);
+	obj.model->GetRotationEv(&rotEv);
+	obj.model->GetScaleEv(&scaleEv);
+
+	if (subscribe)
+	{
+		posEv->Subscribe(obj.subscriber.get());
+		rotEv->Subscribe(obj.subscriber.get());
+		scaleEv->Subscribe(obj.subscriber.get());
+	} else
+	{
+		posEv->Unsubscribe(obj.subscriber.get());
+		rotEv->Unsubscribe(obj.subscriber.get());
+		scaleEv->Unsubscribe(obj.subscriber.get());
+	}
+}
+
+void Render::addRenderObject(IGameObject *go)
+{
+	IModel *model = dynamic_cast<IModel*>(go);
+	if (!model || _renderObjectsIdx.find(model) != _renderObjectsIdx.end())
+		return;
+
+	RenderObject obj;
+	obj.model = model;
+	model->GetID(&obj.id);
+
+	uint meshes;
+	model->GetNumberOfMesh(&meshes);
+	obj.meshes.resize(meshes);
+	for (auto j = 0u; j < meshes; j++)
+		model->GetMesh(&obj.meshes[j], j);
+
+	obj.subscriber = unique_ptr<TransformSubscriber>(new TransformSubscriber(this, model));
+	subscribeTransform(obj, true);
+
+	const uint idx = (uint)_renderObjects.size();
+	_renderObjects.push_back(std::move(obj));
+	_renderObjectsIdx.emplace(model, idx);
+	_cullingBounds.resize(idx + 1);
+
+	markRenderObjectDirty(model);
+}
+
+void Render::removeRenderObject(IGameObject *go)
+{
+	IModel *model = dynamic_cast<IModel*>(go);
+	if (!model)
+		return;
+
+	auto it = _renderObjectsIdx.find(model);
+	if (it == _renderObjectsIdx.end())
+		return;
+
+	const uint idx = it->second;
+	const uint last = (uint)_renderObjects.size() - 1;
+
+	subscribeTransform(_renderObjects[idx], false);
+	_renderObjectsIdx.erase(it);
+
+	// Swap with last to keep array contiguous
+	if (idx != last)
+	{
+		_renderObjects[idx] = std::move(_renderObjects[last]);
+		_cullingBounds.copy(idx, last);
+		_renderObjectsIdx[_renderObjects[idx].model] = idx;
+	}
+
+	_renderObjects.pop_back();
+	_cullingBounds.resize(last);
+}
+
+void Render::markRenderObjectDirty(IModel *model)
+{
+	auto it = _renderObjectsIdx.find(model);
+	if (it == _renderObjectsIdx.end())
+		return;
+
+	RenderObject &obj = _renderObjects[it->second];
+	if (obj.dirty)
+		return;
+
+	obj.dirty = true;
+	_dirtyRenderObjects.push_back(model);
+}
+
+void Render::updateRenderObjects()
+{
+	for (IModel *model : _dirtyRenderObjects)
+	{
+		auto it = _renderObjectsIdx.find(model);
+		if (it == _renderObjectsIdx.end())
+			continue; // removed after been marked
+
+		const uint idx = it->second;
+		RenderObject &obj = _renderObjects[idx];
+
+		model->GetModelMatrix(&obj.modelMat);
+		model->GetNormalMatrix(&obj.normalMat);
+
+		AABB aabb;
+		model->GetWorldAABB(&aabb);
+		_cullingBounds.set(idx, aabb);
+
+		obj.dirty = false;
+	}
+
+	_dirtyRenderObjects.clear();
+}
+
+void Render::getRenderMeshes(vector<RenderMesh>& meshes_vec, const mat4& ViewProj)
+{
+	updateRenderObjects();
+
+	cullBounds(ViewProj);
+
+	_visibleMeshes = 0;
+	_culledMeshes = 0;
+
+	for (size_t i = 0; i < _renderObjects.size(); i++)
+	{
+		const RenderObject &obj = _renderObjects[i];
+
+		if (!_visibility[i])
+		{
+			_culledMeshes += (uint)obj.meshes.size();
+			continue;
 		}
+
+		_visibleMeshes += (uint)obj.meshes.size();
+
+		for (IMesh *mesh : obj.meshes)
+			meshes_vec.push_back({obj.id, mesh, obj.modelMat, obj.normalMat});
 	}
 }
 
-void Render::setShaderMeshParameters(RENDER_PASS pass, RenderMesh *mesh, IShader *shader)
+const Render::ShaderMeshParameters& Render::shaderMeshParameters(IShader *shader)
 {
-	if (mesh)
+	auto it = _shaderMeshParameters.find(shader);
+	if (it != _shaderMeshParameters.end())
+		return it->second;
+
+	// Not all blocks exist in every pass. Missing ones get SHADER_PARAMETER_INVALID
+	ShaderMeshParameters p;
+	shader->GetUniformBlockHandle("vertex_transformation_parameters", &p.transformation);
+	shader->GetUniformBlockHandle("id", &p.id);
+	shader->GetUniformBlockHandle("material_parameters", &p.material);
+	shader->GetUniformBlockHandle("light_parameters", &p.light);
+
+	return _shaderMeshParameters.emplace(shader, p).first->second;
+}
+
+ICorePipelineState* Render::pipelineState(IShader *shader, RENDER_PASS pass, INPUT_ATTRUBUTE attributes)
+{
+	auto it = _pipelineStates.find(shader);
+	if (it != _pipelineStates.end())
+		return it->second.get();
+
+	PipelineStateDesc desc;
+	desc.shader = shader;
+	desc.attributes = attributes;
+
+	switch (pass)
 	{
-		mat4 MVP = ViewProjMat * mesh->modelMat;
-		shader->SetMat4Parameter("MVP", &MVP);
+		case RENDER_PASS::ENGINE_POST:
+			desc.depthTest = false;
+			desc.depthWrite = false;
+			break;
+		case RENDER_PASS::FONT:
+			desc.srcBlend = BLEND_FACTOR::ONE;
+			desc.destBlend = BLEND_FACTOR::ONE_MINUS_SRC_ALPHA;
+			desc.depthTest = false;
+			desc.depthWrite = false;
+			break;
+		default:
+			break;
+	}
+
+	ICorePipelineState *state;
+	if (FAILED(_pCoreRender->CreatePipelineState(&state, &desc)))
+		return nullptr;
+
+	return _pipelineStates.emplace(shader, unique_ptr<ICorePipelineState>(state)).first->second.get();
+}
 
-		mat4 M = mesh->modelMat;
-		mat4 NM = M.Inverse().Transpose();
-		shader->SetMat4Parameter("NM", &NM);
+void Render::setShaderMeshParameters(RENDER_PASS pass, RenderMesh *mesh, IShader *shader, uint instanceOffset)
+{
+	const ShaderMeshParameters &p = shaderMeshParameters(shader);
+
+	if (mesh)
+	{
+		VertexTransformationParameters transformation{};
+		transformation.VP = ViewProjMat;
+		transformation.instance_offset = instanceOffset;
+		shader->SetUniformBlock(p.transformation, &transformation);
 	}
 
 	if (pass == RENDER_PASS::ID)
 	{
-		shader->SetUintParameter("model_id", mesh->model_id);
+		IdParameters id{};
+		id.model_id = mesh->model_id;
+		shader->SetUniformBlock(p.id, &id);
 	}
 	else if (pass == RENDER_PASS::FORWARD)
 	{
-		shader->SetVec4Parameter("main_color", &vec4(1.0f, 1.0f, 1.0f, 1.0f));
-		shader->SetVec4Parameter("nL_world", &(vec4(1.0f, -2.0f, 3.0f, 0.0f).Normalized()));
+		MaterialParameters material{};
+		material.main_color = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+		shader->SetUniformBlock(p.material, &material);
+
+		LightParameters light{};
+		light.nL_world = vec4(1.0f, -2.0f, 3.0f, 0.0f).Normalized();
+		shader->SetUniformBlock(p.light, &light);
 	}
 
 	shader->FlushParameters();
 }
 
-void Render::drawMeshes(vector<RenderMesh>& meshes, RENDER_PASS pass)
+uint Render::SortIds::get(const void *ptr)
+{
+	if (!ptr)
+		return 0;
+
+	auto it = _ids.find(ptr);
+	if (it != _ids.end())
+		return it->second;
+
+	if (_ids.size() >= _maxId)
+	{
+		_full = true;
+		return _maxId;
+	}
+
+	uint id = (uint)_ids.size() + 1;
+	_ids.emplace(ptr, id);
+	return id;
+}
+
+// LSD radix sort by 8 bits. Skips digits that are the same for all keys
+void Render::radixSort(vector<RenderQueueItem>& items, vector<RenderQueueItem>& tmp)
+{
+	const size_t n = items.size();
+	if (n < 2)
+		return;
+
+	tmp.resize(n);
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {};
+
+		for (size_t i = 0; i < n; i++)
+			counts[(items[i].key >> shift) & 0xFF]++;
+
+		if (counts[(items[0].key >> shift) & 0xFF] == n)
+			continue;
+
+		size_t offset = 0;
+		for (int d = 0; d < 256; d++)
+		{
+			size_t c = counts[d];
+			counts[d] = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0; i < n; i++)
+			tmp[counts[(items[i].key >> shift) & 0xFF]++] = items[i];
+
+		items.swap(tmp);
+	}
+}
+
+void Render::buildRenderQueue(vector<RenderMesh>& meshes, RENDER_PASS pass)
 {
-	for(RenderMesh &renderMesh : meshes)
+	_renderQueue.clear();
+
+	for (uint i = 0; i < (uint)meshes.size(); i++)
 	{
+		RenderMesh &renderMesh = meshes[i];
+
 		INPUT_ATTRUBUTE attribs;
 		renderMesh.mesh->GetAttributes(&attribs);
 
-		IShader *shader = getShader({attribs, pass});
-
+		// Missing variant is compiled on worker thread.
+		// Until it is ready mesh is drawn with position only variant or skipped
+		IShader *shader = getShaderAsync({attribs, pass});
+		if (!shader)
+			shader = getShaderAsync({INPUT_ATTRUBUTE::POSITION, pass});
 		if (!shader)
 			continue;
-		
-		_pCoreRender->SetShader(shader);
-		setShaderMeshParameters(pass, &renderMesh, shader);
 
-		if (bool(attribs & INPUT_ATTRUBUTE::TEX_COORD))
-			_pCoreRender->BindTexture(0, whiteTexture.Get());
+		ITexture *texture = bool(attribs & INPUT_ATTRUBUTE::TEX_COORD) ? whiteTexture.Get() : nullptr;
+
+		// View space depth of model origin
+		const mat4 &M = renderMesh.modelMat;
+		vec4 viewPos = ViewMat * vec4(M.el_2D[0][3], M.el_2D[1][3], M.el_2D[2][3], 1.0f);
+		float depth = -viewPos.z;
+		if (!(depth > 0.0f))
+			depth = 0.0f;
 
-		_pCoreRender->Draw(renderMesh.mesh);
+		// Positive floats keep order when compared as integers
+		uint32_t depthBits;
+		memcpy(&depthBits, &depth, sizeof(float));
+		uint64_t depth20 = depthBits >> 12;
 
-		if (bool(attribs & INPUT_ATTRUBUTE::TEX_COORD))
-			_pCoreRender->BindTexture(0, nullptr);
+		uint64_t shaderId = _shaderSortIds.get(shader);
+		uint64_t textureId = _textureSortIds.get(texture);
+		uint64_t meshId = _meshSortIds.get(renderMesh.mesh);
+
+		uint64_t key = (uint64_t)pass << 61;
+
+		if (renderMesh.transparent)
+			key |= (1ull << 60) | ((~depth20 & 0xFFFFF) << 40) | (shaderId << 28) | (textureId << 16) | meshId;
+		else
+			key |= (shaderId << 48) | (textureId << 36) | (meshId << 20) | depth20;
+
+		_renderQueue.push_back({key, i, shader, texture});
 	}
+
+	radixSort(_renderQueue, _renderQueueTmp);
 }
 
-ITexture* Render::getRenderTargetTexture2d(uint width, uint height, TEXTURE_FORMAT format)
+void Render::uploadInstanceData()
 {
-	for (TexturePoolable &tex : _texture_pool)
+	const uint needed = (uint)_instanceData.size();
+
+	if (!_instanceBuffer || _instanceBufferSize < needed)
+	{
+		_instanceBufferSize = std::max(needed, std::max(_instanceBufferSize * 2, 256u));
+
+		IStructuredBuffer *sb;
+		_pResMan->CreateStructuredBuffer(&sb, _instanceBufferSize * sizeof(InstanceData), sizeof(InstanceData));
+		_instanceBuffer = StructuredBufferPtr(sb);
+	}
+
+	_instanceBuffer->SetData(reinterpret_cast<uint8*>(&_instanceData[0]), needed * sizeof(InstanceData));
+}
+
+void Render::drawMeshes(vector<RenderMesh>& meshes, RENDER_PASS pass)
+{
+	buildRenderQueue(meshes, pass);
+
+	const size_t n = _renderQueue.size();
+	if (n == 0)
+		return;
+
+	// Instance data in queue order
+	_instanceData.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const RenderMesh &renderMesh = meshes[_renderQueue[i].index];
+		_instanceData[i].M = renderMesh.modelMat;
+		_instanceData[i].NM = renderMesh.normalMat;
+	}
+
+	uploadInstanceData();
+
+	_pCoreRender->SetStructuredBufer(INSTANCE_BUFFER_SLOT, _instanceBuffer.Get());
+
+	IShader *currentShader = nullptr;
+	ITexture *currentTexture = nullptr;
+
+	for (size_t i = 0; i < n;)
 	{
-		if (tex.free)
+		RenderQueueItem &item = _renderQueue[i];
+		RenderMesh &renderMesh = meshes[item.index];
+
+		// Batch = run of items with same shader, texture and mesh.
+		// ID pass writes model_id per draw so it can't be batched
+		size_t end = i + 1;
+		if (pass != RENDER_PASS::ID)
+		{
+			while (end < n &&
+				_renderQueue[end].shader == item.shader &&
+				_renderQueue[end].texture == item.texture &&
+				meshes[_renderQueue[end].index].mesh == renderMesh.mesh)
+				end++;
+		}
+
+		if (item.shader != currentShader)
 		{
-			if (width == tex.width && height == tex.height && format == tex.format)
+			// Position only variant can be drawn with any mesh, so vertex layout isn't fixed
+			_pCoreRender->SetPipelineState(pipelineState(item.shader, pass, INPUT_ATTRUBUTE::CUSTOM));
+			currentShader = item.shader;
+		} else
+			_stateChangesSaved++;
+
+		setShaderMeshParameters(pass, &renderMesh, item.shader, (uint)i);
+
+		if (item.texture)
+		{
+			if (item.texture != currentTexture)
 			{
-				tex.free = 0;
-				tex.frame = _pCore->frame();
-				return tex.tex.Get();
-			}
+				_pCoreRender->BindTexture(0, item.texture);
+				currentTexture = item.texture;
+			} else
+				_stateChangesSaved++;
 		}
+
+		_pCoreRender->Draw(renderMesh.mesh, (uint)(end - i));
+		_drawCalls++;
+
+		i = end;
+	}
+
+	if (currentTexture)
+		_pCoreRender->BindTexture(0, nullptr);
+
+	_pCoreRender->SetStructuredBufer(INSTANCE_BUFFER_SLOT, nullptr);
+}
+
+ITexture* Render::getRenderTargetTexture2d(uint width, uint height, TEXTURE_FORMAT format)
+{
+	const uint64_t key = texturePoolKey(width, height, format);
+
+	auto freeIt = _texture_free_lists.find(key);
+	if (freeIt != _texture_free_lists.end() && !freeIt->second.empty())
+	{
+		ITexture *tex = freeIt->second.back();
+		freeIt->second.pop_back();
+
+		TexturePoolable &tp = _texture_pool[tex];
+		_texture_lru.erase(tp.lruIt);
+		tp.free = false;
+		tp.frame = _pCore->frame();
+		return tex;
 	}
 
 	TEXTURE_CREATE_FLAGS flags = TEXTURE_CREATE_FLAGS::USAGE_RENDER_TARGET | TEXTURE_CREATE_FLAGS::COORDS_WRAP | TEXTURE_CREATE_FLAGS::FILTER_POINT;
@@ -771,45 +1554,79 @@ ITexture* Render::getRenderTargetTexture2d(uint width, uint height, TEXTURE_FORM
 	ITexture *tex;
 	_pResMan->CreateTexture(&tex, width, height, TEXTURE_TYPE::TYPE_2D, format, flags);
 
-	_texture_pool.push_back({_pCore->frame(), 0, width, height, format, TexturePtr(tex)});
+	const size_t bytes = calculateImageSize(format, width, height);
+	_texture_pool.emplace(tex, TexturePoolable{_pCore->frame(), false, key, format, bytes, TexturePtr(tex), _texture_lru.end()});
+	_texture_pool_bytes += bytes;
+	_texture_pool_format_bytes[(int)format] += bytes;
+
+	shrinkTexturePool(_texture_pool_budget);
 
 	return tex;
 }
+
 void Render::releaseTexture2d(ITexture *tex)
 {
-	for (TexturePoolable &tp : _texture_pool)
-	{
-		if (tp.tex.Get() == tex)
-			tp.free = 1;
-	}
+	auto it = _texture_pool.find(tex);
+	if (it == _texture_pool.end() || it->second.free)
+		return;
+
+	TexturePoolable &tp = it->second;
+	tp.free = true;
+	tp.frame = _pCore->frame();
+	tp.lruIt = _texture_lru.insert(_texture_lru.end(), tex);
+	_texture_free_lists[tp.key].push_back(tex);
+
+	shrinkTexturePool(_texture_pool_budget);
 }
 
-RenderBuffers Render::initBuffers(uint w, uint h)
+void Render::evictTexture2d(ITexture *tex)
 {
-	RenderBuffers ret;
+	auto it = _texture_pool.find(tex);
+	assert(it != _texture_pool.end() && it->second.free);
 
-	ret.width = w;
-	ret.height = h;
-	ret.color = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::RGBA8);
-	ret.colorHDR = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::RGBA16F);
-	ret.depth = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::D24S8);
-	ret.directLight = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::RGBA16F);
-	ret.normal = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::RGBA8);
-	ret.shading = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::RGBA8);
-	ret.id = getRenderTargetTexture2d(w, h, TEXTURE_FORMAT::R32UI);
+	TexturePoolable &tp = it->second;
 
-	return ret;
+	auto freeIt = _texture_free_lists.find(tp.key);
+	vector<ITexture*> &freeList = freeIt->second;
+	freeList.erase(std::find(freeList.begin(), freeList.end(), tex));
+	if (freeList.empty())
+		_texture_free_lists.erase(freeIt);
+
+	_texture_lru.erase(tp.lruIt);
+	_texture_pool_bytes -= tp.bytes;
+	_texture_pool_format_bytes[(int)tp.format] -= tp.bytes;
+
+	_texture_pool.erase(it);
+}
+
+void Render::shrinkTexturePool(size_t budget)
+{
+	// Only free textures can be evicted. Pool stays over budget while all textures are in use
+	while (_texture_pool_bytes > budget && !_texture_lru.empty())
+		evictTexture2d(_texture_lru.front());
 }
 
-void Render::releaseBuffers(RenderBuffers& buffers)
+void Render::registerUniformBlocks()
 {
-	releaseTexture2d(buffers.color.Get());		buffers.color = nullptr;
-	releaseTexture2d(buffers.colorHDR.Get());	buffers.colorHDR = nullptr;
-	releaseTexture2d(buffers.depth.Get());		buffers.depth = nullptr;
-	releaseTexture2d(buffers.directLight.Get());buffers.directLight = nullptr;
-	releaseTexture2d(buffers.normal.Get());		buffers.normal = nullptr;
-	releaseTexture2d(buffers.shading.Get());	buffers.shading = nullptr;
-	releaseTexture2d(buffers.id.Get());			buffers.id = nullptr;
+	static const UniformBlockField transformationFields[] =
+	{
+		UNIFORM_BLOCK_FIELD(VertexTransformationParameters, VP),
+		UNIFORM_BLOCK_FIELD(VertexTransformationParameters, instance_offset)
+	};
+	static const UniformBlockField idFields[] = { UNIFORM_BLOCK_FIELD(IdParameters, model_id) };
+	static const UniformBlockField materialFields[] = { UNIFORM_BLOCK_FIELD(MaterialParameters, main_color) };
+	static const UniformBlockField lightFields[] = { UNIFORM_BLOCK_FIELD(LightParameters, nL_world) };
+
+	const UniformBlockDesc blocks[] =
+	{
+		{"vertex_transformation_parameters", transformationFields, 2, sizeof(VertexTransformationParameters)},
+		{"id", idFields, 1, sizeof(IdParameters)},
+		{"material_parameters", materialFields, 1, sizeof(MaterialParameters)},
+		{"light_parameters", lightFields, 1, sizeof(LightParameters)},
+	};
+
+	for (const UniformBlockDesc &desc : blocks)
+		_pCoreRender->RegisterUniformBlock(&desc);
 }
 
 void Render::Init()
@@ -818,6 +1635,32 @@ void Render::Init()
 
 	_pCore->AddUpdateCallback(std::bind(&Render::_update, this));
 
+	registerUniformBlocks();
+
+	const char *workingDir;
+	_pCore->GetWorkingDir(&workingDir);
+	const char *gapi;
+	_pCoreRender->GetName(&gapi);
+	const char *compilerVersion;
+	_pCoreRender->GetShaderCompilerVersion(&compilerVersion);
+	_shaderCache.init(string(workingDir) + '\\' + SHADER_CACHE_DIR, gapi, compilerVersion);
+
+	if (!_shaderWatcher.start(shaderDir()))
+		LOG_WARNING("Render::Init(): can't watch shader directory. Use shaders_reload command after changes");
+
+	// Render list
+	IGameObjectEvent *ev;
+	_gameObjectAddedSubscriber = unique_ptr<SceneSubscriber>(new SceneSubscriber(this, true));
+	_gameObjectDeleteSubscriber = unique_ptr<SceneSubscriber>(new SceneSubscriber(this, false));
+	_pSceneMan->GetGameObjectAddedEvent(&ev);
+	ev->Subscribe(_gameObjectAddedSubscriber.get());
+	_pSceneMan->GetDeleteGameObjectEvent(&ev);
+	ev->Subscribe(_gameObjectDeleteSubscriber.get());
+
+	SceneManager *sm = (SceneManager*)_pSceneMan;
+	for (tree<IGameObject*>::iterator it = sm->_gameobjects.begin(); it != sm->_gameobjects.end(); ++it)
+		addRenderObject(*it);
+
 	// Shaders
 	ITextFile *shader;
 
@@ -877,6 +1720,24 @@ void Render::Free()
 	for (auto &r : _records)
 		r.buffer.Reset();
 
+	_instanceBuffer.Reset();
+
+	_shaderWatcher.stop();
+	waitShaderJobs();
+
+	for (RenderObject &obj : _renderObjects)
+		subscribeTransform(obj, false);
+	_renderObjects.clear();
+	_renderObjectsIdx.clear();
+	_dirtyRenderObjects.clear();
+	_cullingBounds.resize(0);
+
+	IGameObjectEvent *ev;
+	_pSceneMan->GetGameObjectAddedEvent(&ev);
+	ev->Unsubscribe(_gameObjectAddedSubscriber.get());
+	_pSceneMan->GetDeleteGameObjectEvent(&ev);
+	ev->Unsubscribe(_gameObjectDeleteSubscriber.get());
+
 	fontTexture.Reset();
 	whiteTexture.Reset();
 	_postPlane.Reset();
@@ -885,7 +1746,14 @@ void Render::Free()
 	_forwardShader.Reset();
 	_idShader.Reset();
 	_texture_pool.clear();
+	_texture_free_lists.clear();
+	_texture_lru.clear();
+	_texture_pool_bytes = 0;
+	memset(_texture_pool_format_bytes, 0, sizeof(_texture_pool_format_bytes));
 	_shaders_pool.clear();
+	_shaderMeshParameters.clear();
+	_pipelineStates.clear();
+	_shaderSourceTokens.clear();
 }
 
 API Render::GetRenderTexture2D(OUT ITexture **texOut, uint width, uint height, TEXTURE_FORMAT format)
@@ -901,14 +1769,92 @@ API Render::ReleaseRenderTexture2D(ITexture *texIn)
 	return S_OK;
 }
 
+API Render::SetRenderTexturePoolBudget(uint megabytes)
+{
+	_texture_pool_budget = size_t(megabytes) * 1024 * 1024;
+	shrinkTexturePool(_texture_pool_budget);
+	return S_OK;
+}
+
 API Render::ShadersReload()
 {
 	LOG("Shaders reloading...");
+	waitShaderJobs();
 	_idShader->Reload();
 	_forwardShader->Reload();
 	_postShader->Reload();
 	_fontShader->Reload();
 	_shaders_pool.clear();
+	_shaderMeshParameters.clear();
+	_pipelineStates.clear();
+	_shaderSourceTokens.clear();
+	_shadersWarmedUp = false;
+	return S_OK;
+}
+
+API Render::ShadersWarmUp()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Attribute masks used by loaded meshes
+	// Position only variants are fallback for variants compiled asynchronously
+	std::unordered_set<int> masks = {(int)INPUT_ATTRUBUTE::POSITION};
+
+	for (IMesh *mesh : ((ResourceManager*)_pResMan)->LoadedMeshes())
+	{
+		INPUT_ATTRUBUTE attribs;
+		mesh->GetAttributes(&attribs);
+		masks.insert((int)attribs);
+	}
+
+	INPUT_ATTRUBUTE planeAttribs;
+	_postPlane->GetAttributes(&planeAttribs);
+
+	vector<ShaderRequirement> reqs;
+	for (int mask : masks)
+	{
+		reqs.push_back({(INPUT_ATTRUBUTE)mask, RENDER_PASS::FORWARD});
+		reqs.push_back({(INPUT_ATTRUBUTE)mask, RENDER_PASS::ID});
+	}
+	reqs.push_back({planeAttribs, RENDER_PASS::ENGINE_POST});
+	reqs.push_back({planeAttribs, RENDER_PASS::FONT});
+
+	// Preprocess and compile all variants in parallel...
+	uint compiled = 0;
+	for (const ShaderRequirement &req : reqs)
+	{
+		if (_shaders_pool.find(req) != _shaders_pool.end() || _shaderJobs.find(req) != _shaderJobs.end())
+			continue;
+
+		_shaderJobs.emplace(req, _pCore->threadPool()->submit([this, req]() { return prepareShader(req); }));
+		compiled++;
+	}
+
+	// ...driver compiles them in parallel if backend can't compile on workers...
+	for (const ShaderRequirement &req : reqs)
+	{
+		auto jobIt = _shaderJobs.find(req);
+		if (jobIt == _shaderJobs.end())
+			continue;
+
+		ShaderJobResult job = jobIt->second.get();
+		_shaderJobs.erase(jobIt);
+
+		if (startDriverCompile(job))
+			_shaderDriverJobs.emplace(req, job);
+		else
+			createShader(req, job);
+	}
+
+	// ...then create them on this thread
+	for (const ShaderRequirement &req : reqs)
+		getShader(req);
+
+	_shadersWarmedUp = true;
+
+	const float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	LOG_FORMATTED("Render::ShadersWarmUp(): %u variants (%u new) in %.1f ms", (uint)reqs.size(), compiled, ms);
+
 	return S_OK;
 }
 
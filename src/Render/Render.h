@@ -1,22 +1,13 @@
 #pragma once
 #include "Common.h"
+#include "FrameGraph.h"
+#include "ShaderCache.h"
+#include "ShaderWatcher.h"
 
-struct RenderBuffers
+namespace simplecpp
 {
-	uint height;
-	uint width;
-
-	TexturePtr color;		// RGBA8	- Result tonemaped frame
-	TexturePtr colorHDR;	// RGBA16F	- HDR frame
-	TexturePtr depth;		// D24S8	- Hardware depth
-
-	// GBuffer
-	TexturePtr normal;		// RGB8		- World space normal
-	TexturePtr shading;		// RGB8		- ?
-
-	TexturePtr directLight;	// RGB16F	- Accumulation texture for all lights
-	TexturePtr id;			// R32UI	- Models id
-};
+	class TokenList;
+}
 
 //
 // Hight-lever render
@@ -40,26 +31,215 @@ class Render : public IRender, IProfilerCallback
 
 	TexturePtr fontTexture;
 
+	//
+	// Transient render textures pool
+	// Free textures are kept in lists keyed by (width, height, format).
+	// Free textures are evicted in LRU order when pool exceeds VRAM budget
+	// or when they are not requested for a few frames
+	//
 	struct TexturePoolable
 	{
 		int64_t frame;
-		int free;
-		uint width;
-		uint height;
+		bool free;
+		uint64_t key;
 		TEXTURE_FORMAT format;
+		size_t bytes;
 		TexturePtr tex;
+		std::list<ITexture*>::iterator lruIt;
 	};
-	vector<TexturePoolable> _texture_pool;
+	std::unordered_map<ITexture*, TexturePoolable> _texture_pool;
+	std::unordered_map<uint64_t, vector<ITexture*>> _texture_free_lists;
+	std::list<ITexture*> _texture_lru; // free textures, least recently released first
+	size_t _texture_pool_bytes{};
+	size_t _texture_pool_budget{ 256 * 1024 * 1024 };
+	size_t _texture_pool_format_bytes[(int)TEXTURE_FORMAT::UNKNOWN + 1]{};
 
 	std::unordered_map<ShaderRequirement, ShaderPtr, ShaderRequirement> _shaders_pool;
 
+	// Uniform block handles set per draw call. Resolved once per shader variant,
+	// cleared together with shaders in pool
+	struct ShaderMeshParameters
+	{
+		uint transformation;
+		uint id;
+		uint material;
+		uint light;
+	};
+	std::unordered_map<IShader*, ShaderMeshParameters> _shaderMeshParameters;
+
+	// One pipeline state per shader variant: render state is fixed for pass.
+	// Cleared together with shaders in pool
+	std::unordered_map<IShader*, unique_ptr<ICorePipelineState>> _pipelineStates;
+
+	ShaderCache _shaderCache;
+
+	// Result of shader variant preparation. Can be done on worker thread
+	struct ShaderJobResult
+	{
+		const char *vert{ nullptr };
+		const char *frag{ nullptr };
+		uint64_t cacheKey{};
+		uint64_t cacheVariant{};
+		vector<uint8> binary; // from cache or compiled on worker, empty if backend can't compile without context
+	};
+	std::unordered_map<ShaderRequirement, std::future<ShaderJobResult>, ShaderRequirement> _shaderJobs;
+	// Prepared variants compiled by driver threads (GL with GL_ARB_parallel_shader_compile)
+	std::unordered_map<ShaderRequirement, ShaderJobResult, ShaderRequirement> _shaderDriverJobs;
+	bool _shadersWarmedUp{ false };
+
+	// Tokenized shader source and all its includes.
+	// Built once per file, read-only for workers until ShadersReload
+	struct ShaderSourceTokens
+	{
+		vector<string> files;
+		unique_ptr<simplecpp::TokenList> rawtokens;
+		std::map<string, simplecpp::TokenList*> included;
+
+		~ShaderSourceTokens();
+	};
+	std::unordered_map<string, unique_ptr<ShaderSourceTokens>> _shaderSourceTokens;
+	std::mutex _shaderSourceTokensMutex;
+
+	// Hot reload. Variants depending on modified files are recompiled on workers
+	// and replace old variants all at once when whole batch is compiled
+	ShaderWatcher _shaderWatcher;
+	vector<std::pair<ShaderRequirement, std::future<ShaderJobResult>>> _shaderReloadJobs;
+
+	// Rebuilt every frame. Transient textures are taken from texture pool
+	FrameGraph _frameGraph{ this };
+
 	struct RenderMesh
 	{
 		uint model_id;
 		IMesh *mesh{ nullptr };
 		mat4 modelMat;
+		mat4 normalMat;
+		bool transparent{ false };
+	};
+
+	//
+	// Render queue
+	//
+	// Sort key layout (from high bits to low):
+	// opaque:      | pass 3 | 0 | shader 12 | texture 12 | mesh 16 | depth 20       |
+	// transparent: | pass 3 | 1 | inverted depth 20 | shader 12 | texture 12 | mesh 16 |
+	// So opaque meshes are grouped by state and drawn front-to-back inside group,
+	// transparent meshes are drawn after opaque back-to-front
+	//
+	struct RenderQueueItem
+	{
+		uint64_t key;
+		uint index; // in RenderMesh array
+		IShader *shader;
+		ITexture *texture;
+	};
+	vector<RenderQueueItem> _renderQueue;
+	vector<RenderQueueItem> _renderQueueTmp;
+
+	// Maps pointer to small number for sort key field, one map per field.
+	// Ids don't change during frame: when field is exhausted new pointers share the last id
+	// and map is reset before next frame
+	class SortIds
+	{
+		std::unordered_map<const void*, uint> _ids;
+		uint _maxId;
+		bool _full{ false };
+
+	public:
+		explicit SortIds(uint maxId) : _maxId(maxId) {}
+
+		uint get(const void *ptr);
+		void resetIfFull() { if (_full) { _ids.clear(); _full = false; } }
+	};
+	SortIds _shaderSortIds{ 0xFFF };
+	SortIds _textureSortIds{ 0xFFF };
+	SortIds _meshSortIds{ 0xFFFF };
+
+	// Shader and texture binds skipped by drawMeshes() because state was already set
+	uint _stateChangesSaved{};
+	uint _stateChangesSavedLastFrame{};
+
+	// Per-instance transformations of all drawn meshes
+	// Must match InstanceData in common.h
+	struct InstanceData
+	{
+		mat4 M;
+		mat4 NM;
+	};
+	vector<InstanceData> _instanceData;
+	StructuredBufferPtr _instanceBuffer;
+	uint _instanceBufferSize{}; // in elements
+
+	uint _drawCalls{};
+	uint _drawCallsLastFrame{};
+
+	// World space bounds of all render objects in SoA layout (center, extents)
+	// Element i corresponds to _renderObjects[i]
+	// Arrays are padded to multiple of 4 for SIMD. Padding results are ignored
+	struct CullingBounds
+	{
+		vector<float> centerX;
+		vector<float> centerY;
+		vector<float> centerZ;
+		vector<float> extentX;
+		vector<float> extentY;
+		vector<float> extentZ;
+		uint number{};
+
+		void resize(uint n);
+		void set(uint i, const AABB& worldAABB);
+		void copy(uint dst, uint src);
+	};
+
+	// Marks render object dirty when game object transform changed
+	class TransformSubscriber : public IPositionEventSubscriber, public IRotationEventSubscriber, public IScaleEventSubscriber
+	{
+		Render *_render;
+		IModel *_model;
+	public:
+		TransformSubscriber(Render *render, IModel *model) : _render(render), _model(model) {}
+		API Call(OUT vec3 *v) override { _render->markRenderObjectDirty(_model); return S_OK; }
+		API Call(OUT quat *q) override { _render->markRenderObjectDirty(_model); return S_OK; }
+	};
+
+	class SceneSubscriber : public IGameObjectEventSubscriber
+	{
+		Render *_render;
+		bool _added;
+	public:
+		SceneSubscriber(Render *render, bool added) : _render(render), _added(added) {}
+		API Call(OUT IGameObject *go) override;
+	};
+
+	//
+	// Persistent render list
+	// Updated incrementally from scene manager events (add/delete)
+	// and game object transform events. Nothing is recalculated for static objects
+	//
+	struct RenderObject
+	{
+		IModel *model{ nullptr };
+		uint id{};
+		vector<IMesh*> meshes;
+		mat4 modelMat;
+		mat4 normalMat;
+		bool dirty{ false };
+		unique_ptr<TransformSubscriber> subscriber;
 	};
 
+	vector<RenderObject> _renderObjects;
+	std::unordered_map<IModel*, uint> _renderObjectsIdx;
+	vector<IModel*> _dirtyRenderObjects;
+	unique_ptr<SceneSubscriber> _gameObjectAddedSubscriber;
+	unique_ptr<SceneSubscriber> _gameObjectDeleteSubscriber;
+
+	CullingBounds _cullingBounds;
+	vector<uint8_t> _visibility;
+
+	// Culling statistic (last frame)
+	uint _visibleMeshes{};
+	uint _culledMeshes{};
+
 	// Frame data
 	mat4 ViewMat;
 	mat4 ViewProjMat;
@@ -84,22 +264,48 @@ class Render : public IRender, IProfilerCallback
 	vector<RenderProfileRecord> _records;
 
 	API shaders_reload(const char **args, uint argsNumber);
+	API shaders_warmup(const char **args, uint argsNumber);
+	API texture_pool_budget(const char **args, uint argsNumber);
 
 	uint getNumLines() override;
 	string getString(uint i) override;
 
-	void renderForward(RenderBuffers& buffers, vector<RenderMesh>& meshes);
-	void renderEnginePost(RenderBuffers& buffers);
-	void setShaderMeshParameters(RENDER_PASS pass, RenderMesh *mesh, IShader *shader);
+	void renderForward(ITexture *colorHDR, ITexture *depth, vector<RenderMesh>& meshes);
+	void renderEnginePost(ITexture *colorHDR, ITexture *color);
+	void registerUniformBlocks();
+	const ShaderMeshParameters& shaderMeshParameters(IShader *shader);
+	ICorePipelineState* pipelineState(IShader *shader, RENDER_PASS pass, INPUT_ATTRUBUTE attributes);
+	void setShaderMeshParameters(RENDER_PASS pass, RenderMesh *mesh, IShader *shader, uint instanceOffset);
 	void drawMeshes(vector<RenderMesh>& meshes, RENDER_PASS pass);
+	void buildRenderQueue(vector<RenderMesh>& meshes, RENDER_PASS pass);
+	void uploadInstanceData();
+	static void radixSort(vector<RenderQueueItem>& items, vector<RenderQueueItem>& tmp);
 	void _update();
+	ITextFile* passShaderFile(RENDER_PASS pass);
+	string shaderDir();
+	const ShaderSourceTokens& shaderSourceTokens(const string& fullPath, const char *text);
+	ShaderJobResult prepareShader(const ShaderRequirement &req);
+	IShader* compileShader(ShaderJobResult& job);
+	void freeShaderTexts(ShaderJobResult& job);
+	bool startDriverCompile(const ShaderJobResult& job);
+	IShader* createShader(const ShaderRequirement &req, ShaderJobResult& job);
 	IShader* getShader(const ShaderRequirement &req);
+	IShader* getShaderAsync(const ShaderRequirement &req);
+	void waitShaderJobs();
+	void reloadChangedShaders();
+	void finishShaderReload();
 	bool isOpenGL();
-	void getRenderMeshes(vector<RenderMesh>& meshes);	
+	void getRenderMeshes(vector<RenderMesh>& meshes, const mat4& ViewProj);
+	void cullBounds(const mat4& ViewProj);
+	void addRenderObject(IGameObject *go);
+	void removeRenderObject(IGameObject *go);
+	void markRenderObjectDirty(IModel *model);
+	void updateRenderObjects();
+	void subscribeTransform(RenderObject& obj, bool subscribe);
 	ITexture* getRenderTargetTexture2d(uint width, uint height, TEXTURE_FORMAT format);
 	void releaseTexture2d(ITexture *tex);
-	RenderBuffers initBuffers(uint w, uint h);
-	void releaseBuffers(RenderBuffers& buffers);
+	void evictTexture2d(ITexture *tex);
+	void shrinkTexturePool(size_t budget);
 
 public:
 
@@ -116,7 +322,9 @@ public:
 	API RenderPassGUI() override;
 	API GetRenderTexture2D(OUT ITexture **texOut, uint width, uint height, TEXTURE_FORMAT format) override;
 	API ReleaseRenderTexture2D(ITexture *texIn) override;
+	API SetRenderTexturePoolBudget(uint megabytes) override;
 	API ShadersReload() override;
+	API ShadersWarmUp() override;
 	API GetName(OUT const char **pName) override;
 };
 
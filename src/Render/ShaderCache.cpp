@@ -0,0 +1,222 @@
+#include "Pch.h"
+#include "ShaderCache.h"
+#include "Core.h"
+
+namespace fs = std::experimental::filesystem;
+
+extern Core *_pCore;
+DEFINE_DEBUG_LOG_HELPERS(_pCore)
+DEFINE_LOG_HELPERS(_pCore)
+
+static const uint32_t SHADER_CACHE_MAGIC = 0x43534D52; // "RMSC"
+static const uint32_t SHADER_CACHE_VERSION = 3;
+static const uint64_t SHADER_CACHE_MAX_UNUSED_DAYS = 30;
+
+struct ShaderCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t variant;
+	uint64_t backend;
+	uint64_t compiler;
+	uint64_t lastUse; // seconds since epoch. Updated on every load
+	uint32_t size;
+};
+
+static uint64_t now_seconds()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void ShaderCache::init(const string& dir, const char *backend, const char *compilerVersion)
+{
+	_dir = dir;
+	_backend = hashString(HASH_SEED, backend);
+	_compiler = hashString(_backend, compilerVersion);
+
+	std::error_code err;
+	fs::create_directories(fs::u8path(_dir), err);
+	if (err)
+	{
+		LOG_WARNING_FORMATTED("ShaderCache::init(): can't create directory \"%s\". Shaders won't be cached", _dir.c_str());
+		return;
+	}
+
+	// Entries are never requested again after driver update or change of compile flags.
+	// Compiler version of other backends is unknown here, so their entries are removed only if superseded or unused
+	const uint64_t now = now_seconds();
+	const uint64_t maxUnused = SHADER_CACHE_MAX_UNUSED_DAYS * 24 * 60 * 60;
+
+	struct Entry
+	{
+		fs::path path;
+		uint64_t key;
+		uint64_t lastUse;
+	};
+	std::unordered_map<uint64_t, Entry> live; // variant -> most recently used entry
+	vector<fs::path> outdated;
+
+	for (fs::directory_iterator it(fs::u8path(_dir), err), end; !err && it != end; it.increment(err))
+	{
+		if (!fs::is_regular_file(it->status()) || it->path().extension() != ".bin")
+			continue;
+
+		ShaderCacheHeader header;
+		{
+			std::ifstream file(it->path(), std::ios::binary);
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+			if (!file || header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION ||
+				(header.backend == _backend && header.compiler != _compiler) ||
+				header.lastUse + maxUnused < now)
+			{
+				outdated.push_back(it->path());
+				continue;
+			}
+		}
+
+		// Older entry of the same variant is superseded by edit of shader
+		auto v = live.emplace(header.variant, Entry{it->path(), header.key, header.lastUse});
+		if (!v.second)
+		{
+			if (v.first->second.lastUse < header.lastUse)
+			{
+				outdated.push_back(v.first->second.path);
+				v.first->second = Entry{it->path(), header.key, header.lastUse};
+			} else
+				outdated.push_back(it->path());
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto& v : live)
+			_variantKeys.emplace(v.first, v.second.key);
+	}
+
+	uint removed = 0;
+	for (const fs::path& path : outdated)
+	{
+		std::error_code removeErr;
+		if (fs::remove(path, removeErr))
+			removed++;
+	}
+
+	if (removed > 0)
+		LOG_FORMATTED("ShaderCache::init(): removed %u outdated entries", removed);
+}
+
+string ShaderCache::entryPath(uint64_t key) const
+{
+	char name[32];
+	sprintf(name, "%016llx.bin", (unsigned long long)key);
+	return _dir + '\\' + name;
+}
+
+uint64_t ShaderCache::key(const char *vert, const char *geom, const char *frag, const vector<string>& defines) const
+{
+	uint64_t h = _compiler;
+	for (const string& d : defines)
+		h = hashString(h, d.c_str());
+	h = hashString(h, vert);
+	h = hashString(h, geom);
+	h = hashString(h, frag);
+	return h;
+}
+
+uint64_t ShaderCache::variant(const char *file, const vector<string>& defines) const
+{
+	uint64_t h = hashString(_backend, file);
+	for (const string& d : defines)
+		h = hashString(h, d.c_str());
+	return h;
+}
+
+void ShaderCache::use(uint64_t key, uint64_t variant)
+{
+	uint64_t superseded;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		uint64_t& live = _variantKeys[variant];
+		superseded = live;
+		live = key;
+	}
+
+	if (superseded != 0 && superseded != key)
+	{
+		std::error_code err;
+		fs::remove(fs::u8path(entryPath(superseded)), err);
+	}
+}
+
+bool ShaderCache::load(uint64_t key, uint64_t variant, vector<uint8>& data)
+{
+	std::fstream file(fs::u8path(entryPath(key)), std::ios::in | std::ios::out | std::ios::binary);
+	if (!file)
+	{
+		_misses++;
+		return false;
+	}
+
+	ShaderCacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key || header.compiler != _compiler)
+	{
+		_misses++;
+		return false;
+	}
+
+	data.resize(header.size);
+	file.read(reinterpret_cast<char*>(data.data()), header.size);
+
+	if (!file)
+	{
+		_misses++;
+		return false;
+	}
+
+	// Not critical if it fails: entry is just pruned earlier
+	const uint64_t lastUse = now_seconds();
+	file.seekp(offsetof(ShaderCacheHeader, lastUse));
+	file.write(reinterpret_cast<const char*>(&lastUse), sizeof(lastUse));
+
+	use(key, variant);
+
+	_hits++;
+	return true;
+}
+
+void ShaderCache::save(uint64_t key, uint64_t variant, const uint8 *data, uint size)
+{
+	if (_dir.empty())
+		return;
+
+	const string path = entryPath(key);
+	const string tmpPath = path + ".tmp";
+
+	{
+		std::ofstream file(fs::u8path(tmpPath), std::ios::binary | std::ios::trunc);
+		if (!file)
+			return;
+
+		ShaderCacheHeader header{SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, key, variant, _backend, _compiler, now_seconds(), size};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data), size);
+
+		if (!file)
+			return;
+	}
+
+	// Write whole file first so other process never reads partial entry
+	std::error_code err;
+	fs::rename(fs::u8path(tmpPath), fs::u8path(path), err);
+	if (err)
+	{
+		fs::remove(fs::u8path(tmpPath), err);
+		return;
+	}
+
+	use(key, variant);
+}
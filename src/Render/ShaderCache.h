@@ -0,0 +1,47 @@
+#pragma once
+#include "Common.h"
+
+//
+// On-disk cache of compiled shaders (GL program binaries or D3D bytecode)
+//
+// Entry key is hash of preprocessed source, defines, backend name and compiler version.
+// Preprocessed source already contains all included files (common/*.h),
+// so any change in shader or include produces new key.
+// Compiler version contains compile flags and driver version (ICoreRender::GetShaderCompilerVersion).
+//
+// Stale entries are removed:
+// - Variant (shader file and defines) has one live entry. Entry is superseded when
+//   other key of the same variant is saved or loaded, in this run or found by init() later.
+// - init() removes entries of other compiler version of the same backend
+//   and entries not used for SHADER_CACHE_MAX_UNUSED_DAYS (shader file was deleted).
+//
+// Binary format is opaque here: ICoreRender::GetShaderBinary/CreateShaderFromBinary.
+// key(), variant(), load() and save() may be called from worker threads
+//
+class ShaderCache
+{
+	string _dir;
+	uint64_t _backend{};
+	uint64_t _compiler{};
+
+	std::mutex _mutex;
+	std::unordered_map<uint64_t, uint64_t> _variantKeys; // variant -> key of live entry, guarded by _mutex
+
+	std::atomic<uint> _hits{};
+	std::atomic<uint> _misses{};
+
+	string entryPath(uint64_t key) const;
+	void use(uint64_t key, uint64_t variant); // removes superseded entry
+
+public:
+	void init(const string& dir, const char *backend, const char *compilerVersion);
+
+	uint64_t key(const char *vert, const char *geom, const char *frag, const vector<string>& defines) const;
+	uint64_t variant(const char *file, const vector<string>& defines) const;
+
+	bool load(uint64_t key, uint64_t variant, vector<uint8>& data);
+	void save(uint64_t key, uint64_t variant, const uint8 *data, uint size);
+
+	uint hits() const { return _hits; }
+	uint misses() const { return _misses; }
+};
@@ -0,0 +1,126 @@
+#include "Pch.h"
+#include "ShaderWatcher.h"
+
+// Time without new notifications after which changes are reported
+constexpr auto SHADER_WATCHER_QUIET_TIME = std::chrono::milliseconds(200);
+
+ShaderWatcher::~ShaderWatcher()
+{
+	stop();
+}
+
+bool ShaderWatcher::start(const string& dir)
+{
+	stop();
+
+	_dir = CreateFileW(ConvertFromUtf8ToUtf16(dir).c_str(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+	if (_dir == INVALID_HANDLE_VALUE)
+		return false;
+
+	_stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	_thread = std::thread(&ShaderWatcher::watch, this);
+
+	return true;
+}
+
+void ShaderWatcher::stop()
+{
+	if (_thread.joinable())
+	{
+		SetEvent(_stopEvent);
+		_thread.join();
+	}
+
+	if (_stopEvent)
+	{
+		CloseHandle(_stopEvent);
+		_stopEvent = nullptr;
+	}
+
+	if (_dir != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(_dir);
+		_dir = INVALID_HANDLE_VALUE;
+	}
+
+	_changed.clear();
+	_overflow = false;
+}
+
+void ShaderWatcher::watch()
+{
+	alignas(DWORD) uint8 buffer[16 * 1024];
+
+	OVERLAPPED overlapped{};
+	overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	HANDLE events[2] = { overlapped.hEvent, _stopEvent };
+
+	for (;;)
+	{
+		ResetEvent(overlapped.hEvent);
+
+		if (!ReadDirectoryChangesW(_dir, buffer, sizeof(buffer), TRUE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr))
+			break;
+
+		DWORD bytes = 0;
+
+		if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0)
+		{
+			CancelIo(_dir);
+			GetOverlappedResult(_dir, &overlapped, &bytes, TRUE);
+			break;
+		}
+
+		if (!GetOverlappedResult(_dir, &overlapped, &bytes, FALSE))
+			break;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_lastChange = std::chrono::steady_clock::now();
+
+		// Buffer is too small for all notifications
+		if (bytes == 0)
+		{
+			_overflow = true;
+			continue;
+		}
+
+		const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer);
+		for (;;)
+		{
+			if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+				_changed.insert(ConvertFromUtf16ToUtf8(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR))));
+
+			if (info->NextEntryOffset == 0)
+				break;
+
+			info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const uint8*>(info) + info->NextEntryOffset);
+		}
+	}
+
+	CloseHandle(overlapped.hEvent);
+}
+
+bool ShaderWatcher::popChanges(vector<string>& files, bool& overflow)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_changed.empty() && !_overflow)
+		return false;
+
+	if (std::chrono::steady_clock::now() - _lastChange < SHADER_WATCHER_QUIET_TIME)
+		return false;
+
+	files.assign(_changed.begin(), _changed.end());
+	overflow = _overflow;
+
+	_changed.clear();
+	_overflow = false;
+
+	return true;
+}
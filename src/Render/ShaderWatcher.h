@@ -0,0 +1,35 @@
+#pragma once
+#include "Common.h"
+
+//
+// Watches shader directory (with subdirectories) for modified files
+//
+// ReadDirectoryChangesW is waited on dedicated thread, not thread pool:
+// thread is blocked all the time.
+// Editors save file in several steps (truncate, write, rename),
+// so changes are reported only after directory is quiet for a while.
+//
+class ShaderWatcher
+{
+	HANDLE _dir{ INVALID_HANDLE_VALUE };
+	HANDLE _stopEvent{ nullptr };
+	std::thread _thread;
+
+	std::mutex _mutex;
+	std::unordered_set<string> _changed;
+	std::chrono::steady_clock::time_point _lastChange;
+	bool _overflow{ false };
+
+	void watch();
+
+public:
+	~ShaderWatcher();
+
+	bool start(const string& dir);
+	void stop();
+
+	// Returns false if nothing changed or files are still being written.
+	// Paths are relative to watched directory.
+	// overflow is set if OS lost notifications: everything should be reloaded
+	bool popChanges(vector<string>& files, bool& overflow);
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include "Common.h"
+
+//
+// C++ mirrors of shader uniform blocks
+//
+// Layout follows std140: vec4 and mat4 are aligned by 16 bytes, block size is multiple of 16.
+// Blocks are registered in ICoreRender and validated against reflection at shader creation,
+// then whole block is updated by IShader::SetUniformBlock()
+//
+
+#define UNIFORM_BLOCK_FIELD(STRUCT, FIELD) { #FIELD, (uint)offsetof(STRUCT, FIELD), (uint)sizeof(STRUCT::FIELD) }
+
+// common/common.h
+struct VertexTransformationParameters
+{
+	mat4 VP;
+	uint instance_offset;
+	uint _padding[3];
+};
+
+// id.shader
+struct IdParameters
+{
+	uint model_id;
+	uint _padding[3];
+};
+
+// mesh.shader
+struct MaterialParameters
+{
+	vec4 main_color;
+};
+
+// mesh.shader
+struct LightParameters
+{
+	vec4 nL_world;
+};
@@ -12,6 +12,9 @@
 #include "Camera.h"
 #include "ConsoleWindow.h"
 #include "SceneManager.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
 #include <memory>
 
 
@@ -29,6 +32,57 @@ extern Core *_pCore;
 DEFINE_DEBUG_LOG_HELPERS(_pCore)
 DEFINE_LOG_HELPERS(_pCore)
 
+// DDS decoded on CPU, ready for ICoreRender::CreateTexture()
+struct TextureData
+{
+	unique_ptr<uint8[]> file;
+	unique_ptr<uint8[]> remapped; // RGB -> RGBA
+	uint8 *pixels = nullptr; // points to file or remapped
+	uint width = 0;
+	uint height = 0;
+	TEXTURE_FORMAT format = TEXTURE_FORMAT::UNKNOWN;
+	bool mipmapsPresented = false;
+};
+
+struct ResourceManager::LoadJob
+{
+	enum class TYPE
+	{
+		MODEL,
+		TEXTURE,
+		TEXT_FILE
+	};
+
+	TYPE type;
+	string path; // as passed to Load*Async()
+	string fullPath;
+	TEXTURE_CREATE_FLAGS flags{};
+	LoadHandle *handle = nullptr; // reference of resource manager, released when job is finished
+	std::future<void> decoded; // not valid if there is nothing to do on worker
+
+	// Filled on worker thread
+	string error; // logged on main thread
+	LogBuffer log; // printed on main thread
+	MeshCacheFile cache;
+	vector<MeshData> meshes;
+	TextureData texture;
+	char *text = nullptr;
+
+	// Upload progress. Model is uploaded mesh by mesh within time budget
+	bool started = false;
+	size_t nextMesh = 0;
+	vector<IMesh*> created;
+
+	~LoadJob() { delete[] text; }
+};
+
+void LogBuffer::flush()
+{
+	for (const auto& m : _messages)
+		LOG(m.second.c_str(), m.first);
+	_messages.clear();
+}
+
 #ifdef USE_FBX
 
 #ifdef IOS_REF
@@ -36,17 +90,17 @@ DEFINE_LOG_HELPERS(_pCore)
 #define IOS_REF (*(pManager->GetIOSettings()))
 #endif
 
-void ResourceManager::_FBX_initialize_SDK_objects(FbxManager*& pManager, FbxScene*& pScene)
+void ResourceManager::_FBX_initialize_SDK_objects(LogBuffer& log, FbxManager*& pManager, FbxScene*& pScene) const
 {
 	pManager = FbxManager::Create();
 
 	if (!pManager)
 	{
-		if (fbxDebug) LOG_FATAL("Error: Unable to create FBX Manager!");
+		if (fbxDebug) log.add(LOG_TYPE::FATAL, "Error: Unable to create FBX Manager!");
 		return;
 	}
 
-	if (fbxDebug) LOG_NORMAL_FORMATTED("Autodesk FBX SDK version %s", pManager->GetVersion());
+	if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Autodesk FBX SDK version %s", pManager->GetVersion());
 
 	FbxIOSettings* ios = FbxIOSettings::Create(pManager, IOSROOT);
 	pManager->SetIOSettings(ios);
@@ -60,19 +114,19 @@ void ResourceManager::_FBX_initialize_SDK_objects(FbxManager*& pManager, FbxScen
 
 	if (!pScene)
 	{
-		LOG_FATAL("Error: Unable to create FBX scene!");
+		log.add(LOG_TYPE::FATAL, "Error: Unable to create FBX scene!");
 		return;
 	}
 }
 
-void ResourceManager::_FBX_destroy_SDK_objects(FbxManager* pManager, bool pExitStatus)
+void ResourceManager::_FBX_destroy_SDK_objects(LogBuffer& log, FbxManager* pManager, bool pExitStatus) const
 {
 	if (pManager) pManager->Destroy();
 	if (pExitStatus)
-		if (fbxDebug) LOG("FBX SDK destroyed");
+		if (fbxDebug) log.add(LOG_TYPE::NORMAL, "FBX SDK destroyed");
 }
 
-bool ResourceManager::_FBX_load_scene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename)
+bool ResourceManager::_FBX_load_scene(LogBuffer& log, FbxManager* pManager, FbxDocument* pScene, const char* pFilename) const
 {
 	int lFileMajor, lFileMinor, lFileRevision;
 	int lSDKMajor, lSDKMinor, lSDKRevision;
@@ -93,31 +147,31 @@ bool ResourceManager::_FBX_load_scene(FbxManager* pManager, FbxDocument* pScene,
 	{
 		FbxString error = lImporter->GetStatus().GetErrorString();
 
-		LOG_FATAL("Call to FbxImporter::Initialize() failed.");
-		LOG_FATAL_FORMATTED("Error returned: %s", error.Buffer());
+		log.add(LOG_TYPE::FATAL, "Call to FbxImporter::Initialize() failed.");
+		log.add(LOG_TYPE::FATAL, "Error returned: %s", error.Buffer());
 
 		if (lImporter->GetStatus().GetCode() == FbxStatus::eInvalidFileVersion)
 		{
-			LOG_FORMATTED("FBX file format version for this FBX SDK is %d.%d.%d", lSDKMajor, lSDKMinor, lSDKRevision);
-			LOG_FORMATTED("FBX file format version for file '%s' is %d.%d.%d", pFilename, lFileMajor, lFileMinor, lFileRevision);
+			log.add(LOG_TYPE::NORMAL, "FBX file format version for this FBX SDK is %d.%d.%d", lSDKMajor, lSDKMinor, lSDKRevision);
+			log.add(LOG_TYPE::NORMAL, "FBX file format version for file '%s' is %d.%d.%d", pFilename, lFileMajor, lFileMinor, lFileRevision);
 		}
 
 		return false;
 	}
 
-	if (fbxDebug) LOG_FORMATTED("FBX file format version for this FBX SDK is %d.%d.%d", lSDKMajor, lSDKMinor, lSDKRevision);
+	if (fbxDebug) log.add(LOG_TYPE::NORMAL, "FBX file format version for this FBX SDK is %d.%d.%d", lSDKMajor, lSDKMinor, lSDKRevision);
 
 	if (lImporter->IsFBX())
 	{
-		if (fbxDebug) LOG_FORMATTED("FBX file format version for file '%s' is %d.%d.%d", pFilename, lFileMajor, lFileMinor, lFileRevision);
+		if (fbxDebug) log.add(LOG_TYPE::NORMAL, "FBX file format version for file '%s' is %d.%d.%d", pFilename, lFileMajor, lFileMinor, lFileRevision);
 
 		// From this point, it is possible to access animation stack information without
 		// the expense of loading the entire file.
 		lAnimStackCount = lImporter->GetAnimStackCount();
 
-		if (fbxDebug) LOG("Animation Stack Information:");
-		if (fbxDebug) LOG_FORMATTED("Number of Animation Stacks: %d", lAnimStackCount);
-		if (fbxDebug) LOG_FORMATTED("Current Animation Stack: \"%s\"", lImporter->GetActiveAnimStackName().Buffer());
+		if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Animation Stack Information:");
+		if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Number of Animation Stacks: %d", lAnimStackCount);
+		if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Current Animation Stack: \"%s\"", lImporter->GetActiveAnimStackName().Buffer());
 
 		// Set the import states. By default, the import states are always set to 
 		// true. The code below shows how to change these states.
@@ -134,27 +188,135 @@ bool ResourceManager::_FBX_load_scene(FbxManager* pManager, FbxDocument* pScene,
 	lStatus = lImporter->Import(pScene);
 
 	if (lStatus == false && lImporter->GetStatus().GetCode() == FbxStatus::ePasswordError)
-		LOG_FATAL("No support entering password!");
+		log.add(LOG_TYPE::FATAL, "No support entering password!");
 
 	lImporter->Destroy();
 
 	return lStatus;
 }
 
-void ResourceManager::_FBX_load_scene_hierarchy(vector<IMesh*>& meshes, FbxScene * pScene, const char *pFullPath, const char *pRelativePath)
+void ResourceManager::_FBX_load_scene_hierarchy(LogBuffer& log, vector<MeshData>& meshes, FbxScene * pScene, const char *pFullPath, const char *pRelativePath) const
 {
 	FbxString lString;
 
-	if (fbxDebug) LOG("Scene hierarchy:");
+	if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Scene hierarchy:");
 
 	FbxNode* lRootNode = pScene->GetRootNode();
-	_FBX_load_node(meshes, lRootNode, 0, pFullPath, pRelativePath);
+	vector<FbxNode*> meshNodes;
+	_FBX_load_node(log, meshNodes, lRootNode, 0, pFullPath, pRelativePath);
+
+	// Scene graph is walked on this thread, meshes are converted in parallel.
+	// FBX SDK objects must not be accessed concurrently, so instanced nodes sharing FbxMesh
+	// make one job and each worker only reads geometry of its own FbxMesh. Transforms are evaluated above.
+	// This thread takes meshes too and doesn't wait for workers to start,
+	// so import doesn't deadlock when called from worker thread
+	vector<size_t> nodeJobs(meshNodes.size()); // node -> job converting its FbxMesh
+	std::unordered_map<FbxMesh*, size_t> meshJobs;
+
+	struct Jobs
+	{
+		vector<FbxNode*> nodes; // first node using mesh
+		vector<MeshData> meshes;
+		vector<FBXMeshStats> stats;
+		vector<uint8_t> loaded;
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> done{0};
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::exception_ptr error; // first exception thrown by conversion, guarded by mutex
+	};
+
+	auto jobs = std::make_shared<Jobs>();
+
+	for (size_t i = 0; i < meshNodes.size(); i++)
+	{
+		FbxMesh *pMesh = (FbxMesh*)meshNodes[i]->GetNodeAttribute();
+		auto it = meshJobs.emplace(pMesh, jobs->nodes.size()).first;
+		if (it->second == jobs->nodes.size())
+			jobs->nodes.push_back(meshNodes[i]);
+		nodeJobs[i] = it->second;
+	}
+
+	jobs->meshes.resize(jobs->nodes.size());
+	jobs->stats.resize(jobs->nodes.size());
+	jobs->loaded.resize(jobs->nodes.size());
+
+	const size_t count = jobs->nodes.size();
+
+	const auto convert = [this, jobs, count]()
+	{
+		size_t i;
+		while ((i = jobs->next++) < count)
+		{
+			FbxNode *node = jobs->nodes[i];
+
+			// Mesh must be counted as done anyway, otherwise caller waits forever
+			try
+			{
+				jobs->loaded[i] = _FBX_load_mesh(jobs->meshes[i], jobs->stats[i], (FbxMesh*)node->GetNodeAttribute(), node);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(jobs->mutex);
+				if (!jobs->error)
+					jobs->error = std::current_exception();
+			}
+
+			if (++jobs->done == count)
+			{
+				std::lock_guard<std::mutex> lock(jobs->mutex);
+				jobs->finished.notify_one();
+			}
+		}
+	};
+
+	ThreadPool *pool = _pCore->threadPool();
+	const size_t helpers = std::min(count, (size_t)pool->threads());
+	for (size_t i = 1; i < helpers; i++)
+		pool->run(convert);
+
+	convert();
+
+	{
+		std::unique_lock<std::mutex> lock(jobs->mutex);
+		jobs->finished.wait(lock, [&]() { return jobs->done == count; });
+	}
+
+	// Same as if meshes were converted on this thread
+	if (jobs->error)
+		std::rethrow_exception(jobs->error);
+
+	// Every node gets its own copy of shared mesh, named after node
+	vector<size_t> users(count);
+	for (size_t job : nodeJobs)
+		users[job]++;
+
+	for (size_t i = 0; i < meshNodes.size(); i++)
+	{
+		const size_t job = nodeJobs[i];
+		if (!jobs->loaded[job])
+			continue;
+
+		const FBXMeshStats& st = jobs->stats[job];
+		if (fbxDebug)
+			log.debug("(eMesh) %-10.10s VERTS=%u->%u ACMR=3.00->%.2f (welded)->%.2f (optimized) STRIDE=%u->%u",
+			meshNodes[i]->GetName(), st.corners, st.vertices, st.acmrWelded, st.acmrOptimized, st.strideBefore, st.stride);
+
+		if (--users[job] == 0)
+			meshes.push_back(std::move(jobs->meshes[job]));
+		else
+			meshes.push_back(jobs->meshes[job]);
+
+		MeshData& m = meshes.back();
+		m.name = meshNodes[i]->GetName();
+		m.desc.pData = m.vertices.data(); // copy points to its own vertices
+	}
 
 	if (meshes.size() == 0)
-		LOG_WARNING("No meshes loaded");
+		log.add(LOG_TYPE::WARNING, "No meshes loaded");
 }
 
-void ResourceManager::_FBX_load_node(vector<IMesh*>& meshes, FbxNode* pNode, int depth, const char *fullPath, const char *pRelativePath)
+void ResourceManager::_FBX_load_node(LogBuffer& log, vector<FbxNode*>& meshNodes, FbxNode* pNode, int depth, const char *fullPath, const char *pRelativePath) const
 {
 	FbxString lString;
 	FbxNodeAttribute* node = pNode->GetNodeAttribute();
@@ -163,23 +325,23 @@ void ResourceManager::_FBX_load_node(vector<IMesh*>& meshes, FbxNode* pNode, int
 
 	switch (lAttributeType)
 	{
-		case FbxNodeAttribute::eMesh:		_FBX_load_mesh(meshes, (FbxMesh*)pNode->GetNodeAttribute(), pNode, fullPath, pRelativePath); break;
-		case FbxNodeAttribute::eMarker:		LOG(("(eMarker) " + lString + pNode->GetName()).Buffer()); break;
-		case FbxNodeAttribute::eSkeleton:	LOG(("(eSkeleton) " + lString + pNode->GetName()).Buffer()); break;
-		case FbxNodeAttribute::eNurbs:		LOG(("(eNurbs) " + lString + pNode->GetName()).Buffer()); break;
-		case FbxNodeAttribute::ePatch:		LOG(("(ePatch) " + lString + pNode->GetName()).Buffer()); break;
-		case FbxNodeAttribute::eCamera:		_FBX_load_node_transform(pNode, ("(eCamera) " + lString + pNode->GetName()).Buffer()); break;
-		case FbxNodeAttribute::eLight:		LOG(("(eLight) " + lString + pNode->GetName()).Buffer()); break;
-		case FbxNodeAttribute::eLODGroup:	LOG(("(eLODGroup) " + lString + pNode->GetName()).Buffer()); break;
-		default:							_FBX_load_node_transform(pNode, ("(unknown!) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::eMesh:		_FBX_load_mesh_node(log, meshNodes, pNode); break;
+		case FbxNodeAttribute::eMarker:		log.add(LOG_TYPE::NORMAL, ("(eMarker) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::eSkeleton:	log.add(LOG_TYPE::NORMAL, ("(eSkeleton) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::eNurbs:		log.add(LOG_TYPE::NORMAL, ("(eNurbs) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::ePatch:		log.add(LOG_TYPE::NORMAL, ("(ePatch) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::eCamera:		_FBX_load_node_transform(log, pNode, ("(eCamera) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::eLight:		log.add(LOG_TYPE::NORMAL, ("(eLight) " + lString + pNode->GetName()).Buffer()); break;
+		case FbxNodeAttribute::eLODGroup:	log.add(LOG_TYPE::NORMAL, ("(eLODGroup) " + lString + pNode->GetName()).Buffer()); break;
+		default:							_FBX_load_node_transform(log, pNode, ("(unknown!) " + lString + pNode->GetName()).Buffer()); break;
 	}
 
 	int childs = pNode->GetChildCount();
 	if (childs)
 	{
-		if (fbxDebug) LOG_FORMATTED("for node=%s childs=%i", pNode->GetName(), childs);
+		if (fbxDebug) log.add(LOG_TYPE::NORMAL, "for node=%s childs=%i", pNode->GetName(), childs);
 		for (int i = 0; i < childs; i++)
-			_FBX_load_node(meshes, pNode->GetChild(i), depth + 1, fullPath, pRelativePath);
+			_FBX_load_node(log, meshNodes, pNode->GetChild(i), depth + 1, fullPath, pRelativePath);
 	}
 }
 
@@ -189,26 +351,28 @@ void add_tabs(FbxString& buff, int tabs)
 		buff += " ";
 }
 
-void ResourceManager::_FBX_load_mesh(vector<IMesh*>& meshes, FbxMesh *pMesh, FbxNode *pNode, const char *fullPath, const char *pRelativePath)
+void ResourceManager::_FBX_load_mesh_node(LogBuffer& log, vector<FbxNode*>& meshNodes, FbxNode *pNode) const
 {
-	int control_points_count = pMesh->GetControlPointsCount();
-	int polygon_count = pMesh->GetPolygonCount();
-	int normal_element_count = pMesh->GetElementNormalCount();
-	int uv_layer_count = pMesh->GetElementUVCount();
-	int tangent_layers_count = pMesh->GetElementTangentCount();
-	int binormal_layers_count = pMesh->GetElementBinormalCount();
-
-	string path = string(pRelativePath) + "#" + string(pNode->GetName());
+	FbxMesh *pMesh = (FbxMesh*)pNode->GetNodeAttribute();
 
 	FbxVector4 tr = pNode->EvaluateGlobalTransform().GetT();
 	FbxVector4 rot = pNode->EvaluateGlobalTransform().GetR();
 	FbxVector4 sc = pNode->EvaluateGlobalTransform().GetS();
 
 	if (fbxDebug)
-		DEBUG_LOG_FORMATTED("(eMesh) %-10.10s T=(%.1f %.1f %.1f) R=(%.1f %.1f %.1f) S=(%.1f %.1f %.1f) CP=%5d POLYS=%5d NORMAL=%d UV=%d TANG=%d BINORM=%d", 
+		log.debug("(eMesh) %-10.10s T=(%.1f %.1f %.1f) R=(%.1f %.1f %.1f) S=(%.1f %.1f %.1f) CP=%5d POLYS=%5d NORMAL=%d UV=%d TANG=%d BINORM=%d", 
 		pNode->GetName(),
 		tr[0], tr[1], tr[2], rot[0], rot[1], rot[2], sc[0], sc[1], sc[2],
-		control_points_count, polygon_count, normal_element_count, uv_layer_count, tangent_layers_count, binormal_layers_count);
+		pMesh->GetControlPointsCount(), pMesh->GetPolygonCount(), pMesh->GetElementNormalCount(), pMesh->GetElementUVCount(), pMesh->GetElementTangentCount(), pMesh->GetElementBinormalCount());
+
+	meshNodes.push_back(pNode);
+}
+
+bool ResourceManager::_FBX_load_mesh(OUT MeshData& mesh, OUT FBXMeshStats& stats, FbxMesh *pMesh, FbxNode *pNode) const
+{
+	int polygon_count = pMesh->GetPolygonCount();
+	int normal_element_count = pMesh->GetElementNormalCount();
+	int uv_layer_count = pMesh->GetElementUVCount();
 
 	struct Vertex
 	{
@@ -234,7 +398,7 @@ void ResourceManager::_FBX_load_mesh(vector<IMesh*>& meshes, FbxMesh *pMesh, Fbx
 		for (int t = 0; t < polygon_size - 2; t++) // triangulate large polygons
 			for (int j = 0; j < 3; j++)
 			{
-				Vertex v;
+				Vertex v{}; // zeroed: absent attributes
 
 				int local_vert_idx = t + j;
 				if (j == 0)
@@ -366,68 +530,265 @@ void ResourceManager::_FBX_load_mesh(vector<IMesh*>& meshes, FbxMesh *pMesh, Fbx
 		vertex_counter += polygon_size;
 	}
 
+	if (vertecies.empty())
+		return false;
+
+	// Compact vertex formats
+	// Half position only if its rounding error (|p| * 2^-11) is small relative to mesh size,
+	// it is not for meshes far from origin of node. UV in 16 bit unorm only if there is no tiling
+	float maxAbs = 0.0f;
+	float minP[3] = {vertecies[0].x, vertecies[0].y, vertecies[0].z};
+	float maxP[3] = {minP[0], minP[1], minP[2]};
+	bool uvNormalized = true;
+
+	for (const Vertex& v : vertecies)
+	{
+		const float p[3] = {v.x, v.y, v.z};
+		for (int k = 0; k < 3; k++)
+		{
+			maxAbs = std::max(maxAbs, fabs(p[k]));
+			minP[k] = std::min(minP[k], p[k]);
+			maxP[k] = std::max(maxP[k], p[k]);
+		}
+		uvNormalized = uvNormalized && v.tx >= 0.0f && v.tx <= 1.0f && v.ty >= 0.0f && v.ty <= 1.0f;
+	}
+
+	const float meshSize = std::max(maxP[0] - minP[0], std::max(maxP[1] - minP[1], maxP[2] - minP[2]));
+
 	MeshDataDesc vertDesc;
-	vertDesc.pData = reinterpret_cast<uint8*>(&vertecies[0]);
-	vertDesc.numberOfVertex = (uint)vertecies.size();
-	vertDesc.positionOffset = 0;
-	vertDesc.positionStride = sizeof(Vertex);
+	vertDesc.positionFormat = (maxAbs < 65504.0f && maxAbs <= meshSize) ? VERTEX_FORMAT::HALF : VERTEX_FORMAT::FLOAT;
 	vertDesc.normalsPresented = normal_element_count > 0;
-	vertDesc.normalOffset = (normal_element_count > 0) * 16;
-	vertDesc.normalStride = (normal_element_count > 0) * sizeof(Vertex);
+	vertDesc.normalFormat = VERTEX_FORMAT::OCTAHEDRAL;
 	vertDesc.texCoordPresented = uv_layer_count > 0;
-	vertDesc.texCoordOffset = (uv_layer_count > 0) * 32;
-	vertDesc.texCoordStride = (uv_layer_count > 0) * sizeof(Vertex);
+	vertDesc.texCoordFormat = uvNormalized ? VERTEX_FORMAT::UNORM16 : VERTEX_FORMAT::FLOAT;
 
-	MeshIndexDesc indexDesc;
-	indexDesc.pData = nullptr;
-	indexDesc.number = 0;
+	uint stride = vertexAttributeBytes(INPUT_ATTRUBUTE::POSITION, vertDesc.positionFormat);
+	if (vertDesc.normalsPresented)
+	{
+		vertDesc.normalOffset = stride;
+		stride += vertexAttributeBytes(INPUT_ATTRUBUTE::NORMAL, vertDesc.normalFormat);
+	}
+	if (vertDesc.texCoordPresented)
+	{
+		vertDesc.texCoordOffset = stride;
+		stride += vertexAttributeBytes(INPUT_ATTRUBUTE::TEX_COORD, vertDesc.texCoordFormat);
+	}
+	vertDesc.positionStride = stride;
+	vertDesc.normalStride = vertDesc.normalsPresented * stride;
+	vertDesc.texCoordStride = vertDesc.texCoordPresented * stride;
 
-	ICoreMesh *pCoreMesh = nullptr;
-	_pCoreRender->CreateMesh((ICoreMesh**)&pCoreMesh, &vertDesc, &indexDesc, VERTEX_TOPOLOGY::TRIANGLES);
+	const uint cornersNumber = (uint)vertecies.size();
+	vector<uint8> packed(size_t(cornersNumber) * stride, uint8(0));
 
-	if (pCoreMesh)
-		meshes.push_back(new Mesh(pCoreMesh, path));
-	else
-		LOG_FATAL("ResourceManager::_FBX_load_mesh(): Can not create mesh");
+	for (uint i = 0; i < cornersNumber; i++)
+	{
+		const Vertex& v = vertecies[i];
+		uint8 *out = &packed[size_t(i) * stride];
+
+		if (vertDesc.positionFormat == VERTEX_FORMAT::HALF)
+		{
+			const uint16_t h[4] = {floatToHalf(v.x), floatToHalf(v.y), floatToHalf(v.z), floatToHalf(1.0f)};
+			memcpy(out, h, sizeof(h));
+		} else
+			memcpy(out, &v.x, 16);
+
+		if (vertDesc.normalsPresented)
+		{
+			int16_t n[2];
+			encodeOctahedral(n, v.nx, v.ny, v.nz);
+			memcpy(out + vertDesc.normalOffset, n, sizeof(n));
+		}
+
+		if (vertDesc.texCoordPresented)
+		{
+			if (vertDesc.texCoordFormat == VERTEX_FORMAT::UNORM16)
+			{
+				const uint16_t uv[2] = {uint16_t(v.tx * 65535.0f + 0.5f), uint16_t(v.ty * 65535.0f + 0.5f)};
+				memcpy(out + vertDesc.texCoordOffset, uv, sizeof(uv));
+			} else
+				memcpy(out + vertDesc.texCoordOffset, &v.tx, 8);
+		}
+	}
+
+	vertecies = vector<Vertex>();
+
+	// Polygon corners -> unique vertices + index buffer ordered for post-transform cache and vertex fetch.
+	// Welded after packing, so corners different only in dropped bits are merged too
+	uint8 *vertexData = packed.data();
+
+	vector<uint> indices;
+	uint vertexNumber = weldVertices(vertexData, cornersNumber, stride, indices);
+	const float acmrWelded = calculateACMR(indices.data(), (uint)indices.size(), vertexNumber);
+
+	optimizeVertexCache(indices.data(), (uint)indices.size(), vertexNumber);
+	vertexNumber = optimizeVertexFetch(vertexData, vertexNumber, stride, indices.data(), (uint)indices.size());
+	packed.resize(size_t(vertexNumber) * stride);
+
+	stats = {cornersNumber, vertexNumber, acmrWelded, calculateACMR(indices.data(), (uint)indices.size(), vertexNumber), (uint)sizeof(Vertex), stride};
+
+	vertDesc.pData = packed.data();
+	vertDesc.numberOfVertex = vertexNumber;
+
+	mesh.name = pNode->GetName();
+	mesh.desc = vertDesc;
+	mesh.indexDesc.number = (uint)indices.size();
+
+	if (vertexNumber <= 0xFFFFu)
+	{
+		mesh.indexDesc.format = MESH_INDEX_FORMAT::INT16;
+		mesh.indices.resize(indices.size() * sizeof(uint16_t));
+		uint16_t *indices16 = reinterpret_cast<uint16_t*>(mesh.indices.data());
+		for (size_t i = 0; i < indices.size(); i++)
+			indices16[i] = (uint16_t)indices[i];
+	} else
+	{
+		mesh.indexDesc.format = MESH_INDEX_FORMAT::INT32;
+		mesh.indices.resize(indices.size() * sizeof(uint));
+		memcpy(mesh.indices.data(), indices.data(), mesh.indices.size());
+	}
+
+	calculateMeshBounds(mesh.aabb, mesh.sphere, vertDesc);
+
+	mesh.vertices = std::move(packed);
+
+	return true;
 }
 
-void ResourceManager::_FBX_load_node_transform(FbxNode* pNode, const char *str)
+void ResourceManager::_FBX_load_node_transform(LogBuffer& log, FbxNode* pNode, const char *str) const
 {
 	FbxVector4 tr = pNode->EvaluateGlobalTransform().GetT();
 	FbxVector4 rot = pNode->EvaluateGlobalTransform().GetR();
 	FbxVector4 sc = pNode->EvaluateGlobalTransform().GetS();
 
 	if (fbxDebug)
-		DEBUG_LOG_FORMATTED("%s T=(%.1f %.1f %.1f) R=(%.1f %.1f %.1f) S=(%.1f %.1f %.1f)", str, tr[0], tr[1], tr[2], rot[0], rot[1], rot[2], sc[0], sc[1], sc[2]);
+		log.debug("%s T=(%.1f %.1f %.1f) R=(%.1f %.1f %.1f) S=(%.1f %.1f %.1f)", str, tr[0], tr[1], tr[2], rot[0], rot[1], rot[2], sc[0], sc[1], sc[2]);
 }
-vector<IMesh*> ResourceManager::_FBX_load_meshes(const char *pFullPath, const char *pRelativePath)
+vector<MeshData> ResourceManager::_FBX_load_meshes(LogBuffer& log, const char *pFullPath, const char *pRelativePath) const
 {
 	FbxManager* lSdkManager = NULL;
 	FbxScene* lScene = NULL;
-	vector<IMesh*> meshes;
+	vector<MeshData> meshes;
 
-	if (fbxDebug) LOG("Initializing FBX SDK...");
+	if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Initializing FBX SDK...");
 
-	_FBX_initialize_SDK_objects(lSdkManager, lScene);
+	_FBX_initialize_SDK_objects(log, lSdkManager, lScene);
 
 	FbxString lFilePath(pFullPath);
 
-	LOG_FORMATTED("Loading file: %s", lFilePath.Buffer());
+	log.add(LOG_TYPE::NORMAL, "Loading file: %s", lFilePath.Buffer());
 
-	bool lResult = _FBX_load_scene(lSdkManager, lScene, lFilePath.Buffer());
+	bool lResult = _FBX_load_scene(log, lSdkManager, lScene, lFilePath.Buffer());
 
 	if (!lResult)
-		LOG_FATAL("An error occurred while loading the scene...");
+		log.add(LOG_TYPE::FATAL, "An error occurred while loading the scene...");
 	else
-		_FBX_load_scene_hierarchy(meshes, lScene, pFullPath, pRelativePath);
+		_FBX_load_scene_hierarchy(log, meshes, lScene, pFullPath, pRelativePath);
 
-	if (fbxDebug) LOG("Destroying FBX SDK...");
-	_FBX_destroy_SDK_objects(lSdkManager, lResult);
+	if (fbxDebug) log.add(LOG_TYPE::NORMAL, "Destroying FBX SDK...");
+	_FBX_destroy_SDK_objects(log, lSdkManager, lResult);
 
 	return std::move(meshes);
 }
+
+API ResourceManager::mesh_cache_build(const char **args, uint argsNumber)
+{
+	if (argsNumber == 0)
+	{
+		LOG("Usage: mesh_cache_build <model path relative to data directory> ...");
+		return S_OK;
+	}
+
+	for (uint i = 0; i < argsNumber; i++)
+	{
+		const string fullPath = constructFullPath(args[i]);
+
+		if (!errorIfPathNotExist(fullPath))
+			continue;
+
+		MeshCacheFile cache;
+		if (cache.open(fullPath))
+		{
+			LOG_FORMATTED("mesh_cache_build: \"%s\" is up to date", args[i]);
+			continue;
+		}
+
+		LogBuffer log;
+		const vector<MeshData> meshes = _FBX_load_meshes(log, fullPath.c_str(), args[i]);
+		log.flush();
+
+		if (!meshes.empty() && writeMeshCache(fullPath, meshes))
+			LOG_FORMATTED("mesh_cache_build: \"%s\" done", args[i]);
+		else
+			LOG_WARNING_FORMATTED("mesh_cache_build: can't write cache for \"%s\"", args[i]);
+	}
+
+	return S_OK;
+}
 #endif
 
+IMesh* ResourceManager::createMesh(const MeshData& m, const char *pRelativePath)
+{
+	MeshDataDesc desc = m.desc;
+	desc.pData = m.vertexData();
+
+	MeshIndexDesc indexDesc = m.indexDesc;
+	indexDesc.pData = m.indexData();
+
+	const string path = string(pRelativePath) + "#" + m.name;
+
+	ICoreMesh *pCoreMesh = nullptr;
+	_pCoreRender->CreateMesh((ICoreMesh**)&pCoreMesh, &desc, &indexDesc, m.topology);
+
+	if (!pCoreMesh)
+	{
+		LOG_FATAL_FORMATTED("ResourceManager::createMesh(): Can not create mesh \"%s\"", path.c_str());
+		return nullptr;
+	}
+
+	return new Mesh(pCoreMesh, path, m.aabb, m.sphere);
+}
+
+vector<IMesh*> ResourceManager::createMeshes(const vector<MeshData>& meshes, const char *pRelativePath)
+{
+	vector<IMesh*> ret;
+	ret.reserve(meshes.size());
+
+	for (const MeshData& m : meshes)
+		if (IMesh *mesh = createMesh(m, pRelativePath))
+			ret.push_back(mesh);
+
+	return ret;
+}
+
+void ResourceManager::addSharedMeshes(const vector<IMesh*>& meshes)
+{
+	for (IMesh *m : meshes)
+	{
+		const char *meshName;
+		m->GetFile(&meshName);
+
+		_sharedMeshes.emplace(meshName, m);
+	}
+}
+
+IModel* ResourceManager::addModel(const vector<IMesh*>& meshes)
+{
+	IModel *model = new Model(meshes);
+	uint id;
+	model->GetID(&id);
+
+	#ifdef PROFILE_RESOURCES
+		DEBUG_LOG_FORMATTED("ResourceManager::LoadModel() new Model %#010x id = %i", model, id);
+	#endif
+
+	_runtimeGameobjects.emplace(model);
+
+	SceneManager *sm = static_cast<SceneManager*>(getSceneManager(_pCore));
+	sm->addGameObject(static_cast<IModel*>(model));
+
+	return model;
+}
+
 Render* getRender()
 {
 	IRender *ret;
@@ -441,6 +802,9 @@ ResourceManager::ResourceManager()
 	_pCore->GetSubSystem((ISubSystem**)&_pFilesystem, SUBSYSTEM_TYPE::FILESYSTEM);
 
 	_pCore->consoleWindow()->addCommand("resources_list", std::bind(&ResourceManager::resources_list, this, std::placeholders::_1, std::placeholders::_2));
+#ifdef USE_FBX
+	_pCore->consoleWindow()->addCommand("mesh_cache_build", std::bind(&ResourceManager::mesh_cache_build, this, std::placeholders::_1, std::placeholders::_2));
+#endif
 
 	_pCore->AddProfilerCallback(this);
 }
@@ -457,7 +821,9 @@ void ResourceManager::ReloadTextFile(ITextFile *shaderText)
 	DEBUG_LOG_FORMATTED("Reloading shader %s ...", pShaderName);
 	const char *t = loadTextFile(pShaderName);
 
-	shaderText->SetText(t);
+	// File can be locked by editor. Previous text is better than nothing
+	if (t)
+		shaderText->SetText(t);
 }
 
 void ResourceManager::Init()
@@ -466,6 +832,8 @@ void ResourceManager::Init()
 
 	_pCore->GetSubSystem((ISubSystem**)&_pCoreRender, SUBSYSTEM_TYPE::CORE_RENDER);
 
+	_pCore->AddUpdateCallback(std::bind(&ResourceManager::update, this));
+
 	LOG("Resource Manager initalized");
 }
 
@@ -474,9 +842,22 @@ size_t ResourceManager::sharedResources()
 	return _sharedMeshes.size() + _sharedTextures.size() + _sharedTextFiles.size();
 }
 
+vector<IMesh*> ResourceManager::LoadedMeshes()
+{
+	vector<IMesh*> ret;
+	ret.reserve(_sharedMeshes.size() + _runtimeMeshes.size());
+
+	for (auto &it : _sharedMeshes)
+		ret.push_back(it.second);
+	for (IMesh *mesh : _runtimeMeshes)
+		ret.push_back(mesh);
+
+	return ret;
+}
+
 size_t ResourceManager::runtimeResources()
 {
-	return _runtimeTextures.size() + _runtimeMeshes.size() + _runtimeGameobjects.size() + _runtimeRenderTargets.size() + _runtimeStructuredBuffers.size();
+	return _runtimeTextures.size() + _runtimeMeshes.size() + _runtimeGameobjects.size() + _runtimeRenderTargets.size() + _runtimeStructuredBuffers.size() + _runtimeLoadHandles.size();
 }
 
 API ResourceManager::resources_list(const char **args, uint argsNumber)
@@ -487,6 +868,7 @@ API ResourceManager::resources_list(const char **args, uint argsNumber)
 	LOG_FORMATTED("Runtime Textures: %i", _runtimeTextures.size());
 	LOG_FORMATTED("Runtime Game Objects: %i", _runtimeGameobjects.size());
 	LOG_FORMATTED("Runtime Shaders: %i", _runtimeShaders.size());
+	LOG_FORMATTED("Runtime Load Handles: %i (loading: %i, uploading: %i)", _runtimeLoadHandles.size(), _loadJobs.size(), _uploads.size());
 
 	#define PRINT_RUNTIME_RESOURCES(TITLE, SET) \
 	LOG(TITLE); \
@@ -528,7 +910,7 @@ API ResourceManager::resources_list(const char **args, uint argsNumber)
 
 uint ResourceManager::getNumLines()
 {
-	return 4;
+	return 5;
 }
 
 string ResourceManager::getString(uint i)
@@ -538,7 +920,8 @@ string ResourceManager::getString(uint i)
 		case 0: return "===== Resource Manager =====";
 		case 1: return "Shared resources: " + std::to_string(sharedResources());
 		case 2: return "Runtime resources: " + std::to_string(runtimeResources());
-		case 3: return "";
+		case 3: return "Async loads: " + std::to_string(_loadJobs.size()) + " (upload queue: " + std::to_string(_uploads.size()) + ")";
+		case 4: return "";
 	};
 	assert(0);
 	return "";
@@ -571,6 +954,18 @@ API ResourceManager::GetName(OUT const char **pName)
 
 API ResourceManager::Free()
 {
+	// Unfinished asynchronous loads are cancelled. Workers must finish before that
+	for (auto &job : _loadJobs)
+	{
+		job->decoded.wait();
+		cancelLoad(*job);
+	}
+	_loadJobs.clear();
+
+	for (auto &job : _uploads)
+		cancelLoad(*job);
+	_uploads.clear();
+
 	whiteTetxure->Release();
 	whiteTetxure = nullptr;
 
@@ -620,32 +1015,74 @@ vector<IMesh*> ResourceManager::findLoadedMeshes(const char* pRelativeModelPath,
 	return std::move(out);
 }
 
-const char* ResourceManager::loadTextFile(const char *pShaderName)
+string ResourceManager::textFileFullPath(const char *pShaderName)
 {
-	IFile *pFile = nullptr;
-	uint fileSize = 0;
-	
 	const char *pString;
 	_pCore->GetInstalledDir(&pString);
 	string installedDir = string(pString);
-	string shader_path = installedDir + '\\' + SHADER_DIR + '\\' + pShaderName;
+	return installedDir + '\\' + SHADER_DIR + '\\' + pShaderName;
+}
+
+const char* ResourceManager::loadTextFile(const char *pShaderName)
+{
+	string shader_path = textFileFullPath(pShaderName);
 
 	if (!errorIfPathNotExist(shader_path))
 		return nullptr;
-	
-	_pFilesystem->OpenFile(&pFile, shader_path.c_str(), FILE_OPEN_MODE::READ | FILE_OPEN_MODE::BINARY);
 
-	pFile->FileSize(&fileSize);
+	char *text = readTextFile(shader_path);
+	if (!text)
+		LOG_FATAL_FORMATTED("ResourceManager::loadTextFile(): can't read \"%s\"", shader_path.c_str());
+
+	return text;
+}
+
+// Files are read with std::ifstream, not IFileSystem::OpenFile(): it logs on failure
+// and these functions are called from worker threads. Caller reports nullptr
+char* ResourceManager::readTextFile(const string& fullPath) const
+{
+	std::ifstream file(fs::u8path(fullPath), std::ios::binary | std::ios::ate);
+	if (!file)
+		return nullptr;
+
+	const std::streamoff fileSize = file.tellg();
+	if (fileSize < 0 || !file.seekg(0))
+		return nullptr;
 
-	char *tmp = new char[fileSize + 1];
+	char *tmp = new char[(size_t)fileSize + 1];
 	tmp[fileSize] = '\0';
 
-	pFile->Read((uint8 *)tmp, fileSize);
-	pFile->CloseAndFree();
+	if (!file.read(tmp, fileSize))
+	{
+		delete[] tmp;
+		return nullptr;
+	}
 
 	return tmp;
 }
 
+unique_ptr<uint8[]> ResourceManager::readBinaryFile(const string& fullPath, OUT uint& size) const
+{
+	size = 0;
+
+	std::ifstream file(fs::u8path(fullPath), std::ios::binary | std::ios::ate);
+	if (!file)
+		return nullptr;
+
+	const std::streamoff fileSize = file.tellg();
+	if (fileSize < 0 || fileSize > UINT32_MAX || !file.seekg(0))
+		return nullptr;
+
+	unique_ptr<uint8[]> data = std::make_unique<uint8[]>((size_t)fileSize);
+
+	if (!file.read((char *)data.get(), fileSize))
+		return nullptr;
+
+	size = (uint)fileSize;
+
+	return data;
+}
+
 API ResourceManager::LoadModel(OUT IModel **pModel, const char *path)
 {
 	assert(is_relative(path) && "ResourceManager::LoadModel(): fileName must be relative");
@@ -660,57 +1097,45 @@ API ResourceManager::LoadModel(OUT IModel **pModel, const char *path)
 
 	vector<IMesh*> loaded_meshes = findLoadedMeshes(path, nullptr);
 
-	IModel *model = nullptr;
-
 	const string file_ext = fileExtension(path);
 
-	if (loaded_meshes.size())
+	if (loaded_meshes.empty())
 	{
-		model = new Model(loaded_meshes);
-		uint id;
-		model->GetID(&id);
-
-		#ifdef PROFILE_RESOURCES
-			DEBUG_LOG_FORMATTED("ResourceManager::LoadModel() new Model %#010x id = %i", model, id);
-		#endif
-
-		_runtimeGameobjects.emplace(model);
+		if (file_ext != "fbx")
+		{
+			LOG_FATAL_FORMATTED("ResourceManager::LoadModel unsupported format \"%s\"", file_ext.c_str());
+			return E_FAIL;
+		}
 
-		*pModel = model;
-	} else	
+		vector<MeshData> meshData;
+		MeshCacheFile cache;
 
-#ifdef USE_FBX
-	if (file_ext == "fbx")
-	{
-		loaded_meshes = _FBX_load_meshes(fullPath.c_str(), path);
-		for (IMesh *m : loaded_meshes)
+		if (cache.open(fullPath) && cache.meshes(meshData))
 		{
-			const char *meshName;
-			m->GetFile(&meshName);
-
-			_sharedMeshes.emplace(meshName, m);
+			LOG_FORMATTED("Loading file: %s (mesh cache)", fullPath.c_str());
+			loaded_meshes = createMeshes(meshData, path);
+		} else
+		{
+#ifdef USE_FBX
+			LogBuffer log;
+			meshData = _FBX_load_meshes(log, fullPath.c_str(), path);
+			log.flush();
+			if (!meshData.empty() && !writeMeshCache(fullPath, meshData))
+				LOG_WARNING_FORMATTED("ResourceManager::LoadModel(): can't write mesh cache for \"%s\"", path);
+			loaded_meshes = createMeshes(meshData, path);
+#else
+			LOG_FATAL_FORMATTED("ResourceManager::LoadModel no mesh cache for \"%s\" and engine is built without FBX SDK", path);
+			return E_FAIL;
+#endif
 		}
-		model = new Model(loaded_meshes);
-		uint id;
-		model->GetID(&id);
 
-		#ifdef PROFILE_RESOURCES
-			DEBUG_LOG_FORMATTED("ResourceManager::LoadModel() new Model %#010x id = %i", model, id);
-		#endif
+		// Meshes are uploaded, mapped cache can be closed
+		cache.close();
 
-		_runtimeGameobjects.emplace(model);
-
-		*pModel = model;
-	}
-	else
-#endif
-	{
-		LOG_FATAL_FORMATTED("ResourceManager::LoadModel unsupported format \"%s\"", file_ext.c_str());
-		return E_FAIL;
+		addSharedMeshes(loaded_meshes);
 	}
-	
-	SceneManager *sm = static_cast<SceneManager*>(getSceneManager(_pCore));
-	sm->addGameObject(static_cast<IModel*>(model));
+
+	*pModel = addModel(loaded_meshes);
 
 	return S_OK;
 }
@@ -730,6 +1155,8 @@ API ResourceManager::LoadMesh(OUT IMesh **pMesh, const char *path)
 	}
 
 	ICoreMesh *stdCoreMesh = nullptr;
+	AABB aabb{};
+	BoundingSphere sphere{};
 
 	if (!strcmp(path, "std#plane"))
 	{
@@ -760,6 +1187,8 @@ API ResourceManager::LoadMesh(OUT IMesh **pMesh, const char *path)
 		indexDesc.number = 6;
 		indexDesc.format = MESH_INDEX_FORMAT::INT16;
 
+		calculateMeshBounds(aabb, sphere, desc);
+
 		ThrowIfFailed(_pCoreRender->CreateMesh((ICoreMesh**)&stdCoreMesh, &desc, &indexDesc, VERTEX_TOPOLOGY::TRIANGLES));
 
 	} else if (!strcmp(path, "std#axes"))
@@ -773,6 +1202,8 @@ API ResourceManager::LoadMesh(OUT IMesh **pMesh, const char *path)
 		descAxes.numberOfVertex = 2;
 		descAxes.positionStride = 16;
 
+		calculateMeshBounds(aabb, sphere, descAxes);
+
 		ThrowIfFailed(_pCoreRender->CreateMesh((ICoreMesh**)&stdCoreMesh, &descAxes, &indexEmpty, VERTEX_TOPOLOGY::LINES));
 
 	} else if (!strcmp(path, "std#axes_arrows"))
@@ -819,6 +1250,8 @@ API ResourceManager::LoadMesh(OUT IMesh **pMesh, const char *path)
 		descArrows.numberOfVertex = numberOfVeretex;
 		descArrows.positionStride = 16;
 
+		calculateMeshBounds(aabb, sphere, descArrows);
+
 		ThrowIfFailed(_pCoreRender->CreateMesh((ICoreMesh**)&stdCoreMesh, &descArrows, &indexEmpty, VERTEX_TOPOLOGY::TRIANGLES));
 
 	} else if (!strcmp(path, "std#grid"))
@@ -843,6 +1276,8 @@ API ResourceManager::LoadMesh(OUT IMesh **pMesh, const char *path)
 		descGrid.numberOfVertex = 4 * linesNumber;
 		descGrid.positionStride = 16;
 
+		calculateMeshBounds(aabb, sphere, descGrid);
+
 		ThrowIfFailed(_pCoreRender->CreateMesh((ICoreMesh**)&stdCoreMesh, &descGrid, &indexEmpty, VERTEX_TOPOLOGY::LINES));
 	}
 	else if (!strcmp(path, "std#quad_lines"))
@@ -860,12 +1295,14 @@ API ResourceManager::LoadMesh(OUT IMesh **pMesh, const char *path)
 		descGrid.numberOfVertex = 8;
 		descGrid.positionStride = 16;
 
+		calculateMeshBounds(aabb, sphere, descGrid);
+
 		ThrowIfFailed(_pCoreRender->CreateMesh((ICoreMesh**)&stdCoreMesh, &descGrid, &indexEmpty, VERTEX_TOPOLOGY::LINES));
 	}
 
 	if (stdCoreMesh)
 	{
-		Mesh *m = new Mesh(stdCoreMesh, path);
+		Mesh *m = new Mesh(stdCoreMesh, path, aabb, sphere);
 
 		#ifdef PROFILE_RESOURCES
 			DEBUG_LOG_FORMATTED("ResourceManager::LoadMesh() new Mesh %#010x", m);
@@ -1267,44 +1704,22 @@ TEXTURE_FORMAT DDSToEngFormat(const DDS_PIXELFORMAT& ddpf)
 	return TEXTURE_FORMAT::UNKNOWN;
 }
 
-ICoreTexture* ResourceManager::loadDDS(const char *path, TEXTURE_CREATE_FLAGS flags)
+// Thread-safe. Returns error or nullptr
+static const char* decodeDDS(OUT TextureData& tex, unique_ptr<uint8[]> fileData, size_t fileSize)
 {
-	IFile *pFile = nullptr;
-	uint fileSize = 0;
-
-	const char *pString;
-	_pCore->GetDataDir(&pString);
-	string dataDir = string(pString);
-	string fullPath = dataDir + '\\' + path;
-
-	if (!errorIfPathNotExist(fullPath))
-		return nullptr;
-
-	_pFilesystem->OpenFile(&pFile, fullPath.c_str(), FILE_OPEN_MODE::READ | FILE_OPEN_MODE::BINARY);
-
-	pFile->FileSize(&fileSize);
-
-	unique_ptr<uint8[]> fileData = std::make_unique<uint8[]>(fileSize);
-
-	pFile->Read((uint8 *)fileData.get(), fileSize);
-	pFile->CloseAndFree();
+	if (fileSize < sizeof(uint32_t) + sizeof(DDS_HEADER))
+		return "File is too small";
 
 	// Check magic
 	uint32_t dwMagicNumber = *reinterpret_cast<const uint32_t*>(fileData.get());
 	if (dwMagicNumber != DDS_MAGIC)
-	{
-		LOG_WARNING("ResourceManager::loadDDS(): Wrong magic");
-		return nullptr;
-	}
+		return "Wrong magic";
 
 	const DDS_HEADER* header = reinterpret_cast<const DDS_HEADER*>(fileData.get() + sizeof(uint32_t));
 
 	// Check header sizes
 	if (header->size != sizeof(DDS_HEADER) || header->ddspf.size != sizeof(DDS_PIXELFORMAT))
-	{
-		LOG_WARNING("ResourceManager::loadDDS(): Wrong header sizes");
-		return nullptr;
-	}
+		return "Wrong header sizes";
 
 	// Check for DX10 extension
 	bool bDXT10Header = (header->ddspf.flags & DDS_FOURCC) && (MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC);
@@ -1321,12 +1736,9 @@ ICoreTexture* ResourceManager::loadDDS(const char *path, TEXTURE_CREATE_FLAGS fl
 		header->flags & DDS_HEADER_FLAGS_VOLUME ||
 		header->caps2 & DDS_CUBEMAP)
 	{
-		LOG_WARNING("ResourceManager::loadDDS(): type not supported");
-		return nullptr;
+		return "type not supported";
 	}
 
-	unique_ptr<uint8[]> imageDataRempped;
-
 	// format
 	TEXTURE_FORMAT format = DDSToEngFormat(header->ddspf);
 
@@ -1337,35 +1749,68 @@ ICoreTexture* ResourceManager::loadDDS(const char *path, TEXTURE_CREATE_FLAGS fl
 		size_t alphaChannelSize = imageSize / 3;
 		size_t elements = header->width * header->height;
 
-		imageDataRempped = std::move(std::make_unique<uint8[]>(imageSize + alphaChannelSize));
+		tex.remapped = std::make_unique<uint8[]>(imageSize + alphaChannelSize);
 
 		uint8* ptr_src = imageData;
-		uint8* ptr_dst = imageDataRempped.get();
+		uint8* ptr_dst = tex.remapped.get();
 
 		for (size_t i = 0u; i < elements; ++i)
 		{
-			memcpy(ptr_dst, ptr_dst, 3);
+			memcpy(ptr_dst, ptr_src, 3);
 			memset((ptr_dst + 3), 255, 1);
 
 			ptr_dst += 4;
 			ptr_src += 3;
 		}
 
-		imageData = imageDataRempped.get();
+		imageData = tex.remapped.get();
 		format = TEXTURE_FORMAT::RGBA8;
 	}
 
 	if (format == TEXTURE_FORMAT::UNKNOWN)
+		return "format not supported";
+
+	tex.width = header->width;
+	tex.height = header->height;
+	tex.format = format;
+	tex.mipmapsPresented = header->mipMapCount > 1;
+	tex.pixels = imageData;
+	tex.file = std::move(fileData);
+
+	return nullptr;
+}
+
+ICoreTexture* ResourceManager::loadDDS(const char *path, TEXTURE_CREATE_FLAGS flags)
+{
+	string fullPath = constructFullPath(path);
+
+	if (!errorIfPathNotExist(fullPath))
+		return nullptr;
+
+	uint fileSize = 0;
+	unique_ptr<uint8[]> fileData = readBinaryFile(fullPath, fileSize);
+	if (!fileData)
+	{
+		LOG_FATAL_FORMATTED("ResourceManager::loadDDS(): can't read \"%s\"", fullPath.c_str());
+		return nullptr;
+	}
+
+	TextureData data;
+	if (const char *error = decodeDDS(data, std::move(fileData), fileSize))
 	{
-		LOG_WARNING("ResourceManager::loadDDS(): format not supported");
+		LOG_WARNING_FORMATTED("ResourceManager::loadDDS(): %s", error);
 		return nullptr;
 	}
 
+	return createCoreTexture(data, flags);
+}
+
+ICoreTexture* ResourceManager::createCoreTexture(const TextureData& data, TEXTURE_CREATE_FLAGS flags)
+{
 	const TEXTURE_TYPE type = TEXTURE_TYPE::TYPE_2D;
-	bool mipmapsPresented = header->mipMapCount > 1;
 	ICoreTexture *tex = nullptr;
 
-	if (FAILED(_pCoreRender->CreateTexture(&tex, imageData, header->width, header->height, type, format, flags, mipmapsPresented)))
+	if (FAILED(_pCoreRender->CreateTexture(&tex, data.pixels, data.width, data.height, type, data.format, flags, data.mipmapsPresented)))
 	{
 		LOG_WARNING("ResourceManager::loadDDS(): failed to create texture");
 		return nullptr;
@@ -1559,6 +2004,31 @@ API ResourceManager::CreateShader(OUT IShader **pShaderOut, const char *vert, co
 	return S_OK;
 }
 
+API ResourceManager::CreateShaderFromBinary(OUT IShader **pShaderOut, const uint8 *data, uint size, const char *vert, const char *geom, const char *frag)
+{
+	ICoreShader *coreShader = nullptr;
+
+	bool created = SUCCEEDED(_pCoreRender->CreateShaderFromBinary(&coreShader, data, size)) && coreShader != nullptr;
+
+	if (!created)
+	{
+		// Not fatal. Caller compiles shader from source
+		*pShaderOut = nullptr;
+		return E_FAIL;
+	}
+
+	IShader *s = new Shader(coreShader, vert, geom, frag);
+
+	#ifdef PROFILE_RESOURCES
+		DEBUG_LOG_FORMATTED("ResourceManager::CreateShaderFromBinary() new Shader %#010x", s);
+	#endif
+
+	_runtimeShaders.emplace(s);
+	*pShaderOut = s;
+
+	return S_OK;
+}
+
 API ResourceManager::CreateRenderTarget(OUT IRenderTarget **pRenderTargetOut)
 {
 	ICoreRenderTarget *coreRenderTarget = nullptr;
@@ -1610,6 +2080,374 @@ API ResourceManager::CreateStructuredBuffer(OUT IStructuredBuffer **pBufOut, uin
 }
 
 
+///////////////////////
+// Asynchronous loading
+//////////////////////
+
+LoadHandle* ResourceManager::startLoad(std::shared_ptr<LoadJob> job, bool decodeOnWorker)
+{
+	// One reference is returned to caller, other one is released when job is finished
+	LoadHandle *handle = new LoadHandle(job->path);
+	handle->AddRef();
+	handle->AddRef();
+
+	#ifdef PROFILE_RESOURCES
+		DEBUG_LOG_FORMATTED("ResourceManager::startLoad() new LoadHandle %#010x \"%s\"", handle, job->path.c_str());
+	#endif
+
+	_runtimeLoadHandles.emplace(handle);
+	job->handle = handle;
+
+	if (decodeOnWorker)
+	{
+		LoadJob *j = job.get(); // alive until decoded is waited in update() or Free()
+		job->decoded = _pCore->threadPool()->submit([this, j]() { decodeLoadJob(*j); });
+		_loadJobs.push_back(std::move(job));
+	} else
+		_uploads.push_back(std::move(job));
+
+	return handle;
+}
+
+void ResourceManager::decodeLoadJob(LoadJob& job) const
+{
+	switch (job.type)
+	{
+		case LoadJob::TYPE::MODEL:
+			if (job.cache.open(job.fullPath) && job.cache.meshes(job.meshes))
+			{
+				job.log.add(LOG_TYPE::NORMAL, "Loading file: %s (mesh cache)", job.fullPath.c_str());
+				break;
+			}
+
+			job.cache.close();
+			job.meshes.clear();
+
+#ifdef USE_FBX
+			try
+			{
+				job.meshes = _FBX_load_meshes(job.log, job.fullPath.c_str(), job.path.c_str());
+				if (!job.meshes.empty() && !writeMeshCache(job.fullPath, job.meshes))
+					job.log.add(LOG_TYPE::WARNING, "ResourceManager::LoadModelAsync(): can't write mesh cache for \"%s\"", job.path.c_str());
+			}
+			catch (const std::exception& e)
+			{
+				job.meshes.clear();
+				job.error = e.what();
+			}
+			catch (...)
+			{
+				job.meshes.clear();
+				job.error = "FBX import failed";
+			}
+#else
+			job.error = "no mesh cache and engine is built without FBX SDK";
+#endif
+			break;
+
+		case LoadJob::TYPE::TEXTURE:
+		{
+			uint fileSize = 0;
+			unique_ptr<uint8[]> fileData = readBinaryFile(job.fullPath, fileSize);
+			if (!fileData)
+				job.error = "can't read file";
+			else if (const char *error = decodeDDS(job.texture, std::move(fileData), fileSize))
+				job.error = error;
+		}
+		break;
+
+		case LoadJob::TYPE::TEXT_FILE:
+			job.text = readTextFile(job.fullPath);
+			if (!job.text)
+				job.error = "can't read file";
+			break;
+	}
+}
+
+void ResourceManager::update()
+{
+	// Decoded jobs go to upload queue in order of completion
+	for (auto it = _loadJobs.begin(); it != _loadJobs.end();)
+	{
+		if ((*it)->decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			(*it)->decoded.get();
+			_uploads.push_back(std::move(*it));
+			it = _loadJobs.erase(it);
+		} else
+			++it;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::chrono::duration<float, std::milli> budget(RESOURCE_UPLOAD_BUDGET_MS);
+
+	while (!_uploads.empty())
+	{
+		LoadJob& job = *_uploads.front();
+
+		if (uploadStep(job))
+		{
+			job.handle->Release();
+			_uploads.pop_front();
+		}
+
+		if (std::chrono::steady_clock::now() - start >= budget)
+			break;
+	}
+}
+
+bool ResourceManager::uploadStep(LoadJob& job)
+{
+	job.log.flush();
+
+	if (!job.error.empty())
+	{
+		LOG_WARNING_FORMATTED("ResourceManager: can't load \"%s\": %s", job.path.c_str(), job.error.c_str());
+		job.handle->fail();
+		return true;
+	}
+
+	switch (job.type)
+	{
+		case LoadJob::TYPE::MODEL: return uploadModel(job);
+		case LoadJob::TYPE::TEXTURE: uploadTexture(job); return true;
+		case LoadJob::TYPE::TEXT_FILE: uploadTextFile(job); return true;
+	}
+
+	return true;
+}
+
+bool ResourceManager::uploadModel(LoadJob& job)
+{
+	if (!job.started)
+	{
+		job.started = true;
+
+		// Model could be loaded by other call while this job was on worker
+		vector<IMesh*> loaded_meshes = findLoadedMeshes(job.path.c_str(), nullptr);
+		if (!loaded_meshes.empty())
+		{
+			job.handle->ready(addModel(loaded_meshes));
+			return true;
+		}
+
+	}
+
+	if (job.nextMesh < job.meshes.size())
+	{
+		if (IMesh *mesh = createMesh(job.meshes[job.nextMesh], job.path.c_str()))
+			job.created.push_back(mesh);
+
+		if (++job.nextMesh < job.meshes.size())
+			return false;
+	}
+
+	// Meshes are uploaded, mapped cache can be closed
+	job.cache.close();
+
+	addSharedMeshes(job.created);
+	job.handle->ready(addModel(job.created));
+	job.created.clear();
+
+	return true;
+}
+
+void ResourceManager::uploadTexture(LoadJob& job)
+{
+	// Texture could be loaded by other call while this job was on worker
+	auto it = _sharedTextures.find(job.path);
+	if (it != _sharedTextures.end())
+	{
+		job.handle->ready(it->second);
+		return;
+	}
+
+	// Standard textures are created without file
+	if (!job.texture.pixels)
+	{
+		ITexture *tex = nullptr;
+		if (FAILED(LoadTexture(&tex, job.path.c_str(), job.flags)))
+			job.handle->fail();
+		else
+			job.handle->ready(tex);
+		return;
+	}
+
+	ICoreTexture *coreTex = createCoreTexture(job.texture, job.flags);
+	if (!coreTex)
+	{
+		job.handle->fail();
+		return;
+	}
+
+	ITexture *tex = new Texture(coreTex, job.path);
+
+	#ifdef PROFILE_RESOURCES
+		DEBUG_LOG_FORMATTED("ResourceManager::LoadTextureAsync() new Texture %#010x", tex);
+	#endif
+
+	_sharedTextures.emplace(job.path, tex);
+	job.handle->ready(tex);
+}
+
+void ResourceManager::uploadTextFile(LoadJob& job)
+{
+	auto it = _sharedTextFiles.find(job.path);
+	if (it != _sharedTextFiles.end())
+	{
+		job.handle->ready(it->second);
+		return;
+	}
+
+	#ifdef PROFILE_RESOURCES
+		DEBUG_LOG_FORMATTED("ResourceManager::LoadTextFileAsync() new TextFile");
+	#endif
+
+	TextFile *textFile = new TextFile(job.text, job.path);
+	job.text = nullptr;
+
+	_sharedTextFiles.emplace(job.path, textFile);
+	job.handle->ready(textFile);
+}
+
+void ResourceManager::cancelLoad(LoadJob& job)
+{
+	// Meshes of unfinished model are not registered anywhere
+	for (IMesh *mesh : job.created)
+		delete mesh;
+	job.created.clear();
+
+	job.handle->fail();
+	job.handle->Release();
+}
+
+API ResourceManager::LoadModelAsync(OUT ILoadHandle **pHandle, const char *path)
+{
+	assert(is_relative(path) && "ResourceManager::LoadModelAsync(): fileName must be relative");
+
+	auto job = std::make_shared<LoadJob>();
+	job->type = LoadJob::TYPE::MODEL;
+	job->path = path;
+	job->fullPath = constructFullPath(path);
+
+	if (!errorIfPathNotExist(job->fullPath))
+	{
+		*pHandle = nullptr;
+		return E_FAIL;
+	}
+
+	const bool loaded = !findLoadedMeshes(path, nullptr).empty();
+
+	if (!loaded)
+	{
+		const string file_ext = fileExtension(path);
+		if (file_ext != "fbx")
+		{
+			LOG_FATAL_FORMATTED("ResourceManager::LoadModelAsync unsupported format \"%s\"", file_ext.c_str());
+			*pHandle = nullptr;
+			return E_FAIL;
+		}
+	}
+
+	*pHandle = startLoad(std::move(job), !loaded);
+
+	return S_OK;
+}
+
+API ResourceManager::LoadTextureAsync(OUT ILoadHandle **pHandle, const char *path, TEXTURE_CREATE_FLAGS flags)
+{
+	if (path == NULL || strlen(path) == 0)
+	{
+		*pHandle = nullptr;
+		return E_INVALIDARG;
+	}
+
+	auto job = std::make_shared<LoadJob>();
+	job->type = LoadJob::TYPE::TEXTURE;
+	job->path = path;
+	job->flags = flags;
+
+	const bool standard = !strncmp(path, "std#", 4);
+	const bool loaded = _sharedTextures.find(path) != _sharedTextures.end();
+
+	if (!standard && !loaded)
+	{
+		job->fullPath = constructFullPath(path);
+
+		if (!errorIfPathNotExist(job->fullPath))
+		{
+			*pHandle = nullptr;
+			return E_INVALIDARG;
+		}
+
+		const string ext = fileExtension(path);
+
+		if (ext != "dds")
+		{
+			LOG_WARNING_FORMATTED("Extension %s is not supported", ext.c_str());
+			*pHandle = nullptr;
+			return E_INVALIDARG;
+		}
+	}
+
+	*pHandle = startLoad(std::move(job), !standard && !loaded);
+
+	return S_OK;
+}
+
+API ResourceManager::LoadTextFileAsync(OUT ILoadHandle **pHandle, const char *path)
+{
+	auto job = std::make_shared<LoadJob>();
+	job->type = LoadJob::TYPE::TEXT_FILE;
+	job->path = path;
+	job->fullPath = textFileFullPath(path);
+
+	const bool loaded = _sharedTextFiles.find(path) != _sharedTextFiles.end();
+
+	if (!loaded && !errorIfPathNotExist(job->fullPath))
+	{
+		*pHandle = nullptr;
+		return E_FAIL;
+	}
+
+	*pHandle = startLoad(std::move(job), !loaded);
+
+	return S_OK;
+}
+
+
+///////////////////////
+// Load Handle
+//////////////////////
+
+RUNTIME_ONLY_RESOURCE_IMPLEMENTATION(LoadHandle, _pCore, RemoveRuntimeLoadHandle)
+
+LoadHandle::~LoadHandle()
+{
+	if (_model) _model->Release();
+	if (_texture) _texture->Release();
+	if (_textFile) _textFile->Release();
+}
+
+API LoadHandle::GetModel(OUT IModel **pModel)
+{
+	*pModel = _model;
+	return _model ? S_OK : E_FAIL;
+}
+
+API LoadHandle::GetTexture(OUT ITexture **pTexture)
+{
+	*pTexture = _texture;
+	return _texture ? S_OK : E_FAIL;
+}
+
+API LoadHandle::GetTextFile(OUT ITextFile **pTextFile)
+{
+	*pTextFile = _textFile;
+	return _textFile ? S_OK : E_FAIL;
+}
+
+
 ///////////////////////
 // Text File
 //////////////////////
@@ -5,6 +5,41 @@
 #include <fbxsdk.h>
 #endif
 
+struct MeshData;
+struct TextureData;
+
+// GPU objects of asynchronous loads are created in ResourceManager::update() until this time is spent.
+// At least one object is created every frame
+constexpr float RESOURCE_UPLOAD_BUDGET_MS = 2.0f;
+
+// Log of code running on worker thread (logging is not thread-safe).
+// Messages are printed by flush() on main thread
+class LogBuffer
+{
+	vector<std::pair<LOG_TYPE, string>> _messages;
+
+public:
+	void add(LOG_TYPE type, const char *pStr) { _messages.emplace_back(type, pStr); }
+
+	template <typename... Arguments>
+	void add(LOG_TYPE type, const char *pStr, Arguments ...args)
+	{
+		char buf[1000];
+		snprintf(buf, sizeof(buf), pStr, args...);
+		_messages.emplace_back(type, buf);
+	}
+
+	template <typename... Arguments>
+	void debug(const char *pStr, Arguments ...args)
+	{
+	#ifdef _DEBUG
+		add(LOG_TYPE::NORMAL, pStr, args...);
+	#endif
+	}
+
+	void flush(); // main thread
+};
+
 class TextFile : public ITextFile
 {
 	const char *text = nullptr;
@@ -21,6 +56,33 @@ public:
 	SHARED_ONLY_RESOURCE_HEADER
 };
 
+class LoadHandle final : public ILoadHandle
+{
+	string _path;
+	LOAD_STATUS _status = LOAD_STATUS::LOADING;
+	IModel *_model = nullptr;
+	ITexture *_texture = nullptr;
+	ITextFile *_textFile = nullptr;
+
+public:
+	LoadHandle(const string& path) : _path(path) {}
+	virtual ~LoadHandle();
+
+	// Handle holds reference of loaded resource until it is released
+	void ready(IModel *model) { model->AddRef(); _model = model; _status = LOAD_STATUS::READY; }
+	void ready(ITexture *texture) { texture->AddRef(); _texture = texture; _status = LOAD_STATUS::READY; }
+	void ready(ITextFile *textFile) { textFile->AddRef(); _textFile = textFile; _status = LOAD_STATUS::READY; }
+	void fail() { _status = LOAD_STATUS::FAILED; }
+
+	API GetStatus(OUT LOAD_STATUS *status) override { *status = _status; return S_OK; }
+	API GetPath(OUT const char **path) override { *path = _path.c_str(); return S_OK; }
+	API GetModel(OUT IModel **pModel) override;
+	API GetTexture(OUT ITexture **pTexture) override;
+	API GetTextFile(OUT ITextFile **pTextFile) override;
+
+	RUNTIME_ONLY_RESOURCE_HEADER
+};
+
 class ResourceManager final : public IResourceManager, IProfilerCallback
 {
 	// Rintime resources
@@ -31,6 +93,7 @@ class ResourceManager final : public IResourceManager, IProfilerCallback
 	std::unordered_set<IShader*> _runtimeShaders;
 	std::unordered_set<IRenderTarget*> _runtimeRenderTargets;
 	std::unordered_set<IStructuredBuffer*> _runtimeStructuredBuffers;
+	std::unordered_set<ILoadHandle*> _runtimeLoadHandles;
 
 	// Shared resources
 	// Maps "file name" -> "pointer"
@@ -45,20 +108,57 @@ class ResourceManager final : public IResourceManager, IProfilerCallback
 
 	ITexture *whiteTetxure = nullptr;
 
+	// Asynchronous loads
+	// File is read and decoded on worker (_loadJobs), then GPU objects are created
+	// on main thread in update() in order of completion (_uploads)
+	struct LoadJob;
+	vector<std::shared_ptr<LoadJob>> _loadJobs;
+	std::deque<std::shared_ptr<LoadJob>> _uploads;
+
+	LoadHandle* startLoad(std::shared_ptr<LoadJob> job, bool decodeOnWorker);
+	void decodeLoadJob(LoadJob& job) const; // thread-safe
+	bool uploadStep(LoadJob& job); // true if job is finished
+	bool uploadModel(LoadJob& job);
+	void uploadTexture(LoadJob& job);
+	void uploadTextFile(LoadJob& job);
+	void cancelLoad(LoadJob& job);
+	void update();
+
 	#ifdef USE_FBX
 	const int fbxDebug = 1;
 
-	void _FBX_initialize_SDK_objects(FbxManager*& pManager, FbxScene*& pScene);
-	void _FBX_destroy_SDK_objects(FbxManager* pManager, bool pExitStatus);
-
-	vector<IMesh*> _FBX_load_meshes(const char *pFullPath, const char *pRelativePath);
-	bool _FBX_load_scene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename);
-	void _FBX_load_scene_hierarchy(vector<IMesh*>& meshes, FbxScene* pScene, const char *pFullPath, const char *pRelativePath);
-	void _FBX_load_node(vector<IMesh*>& meshes, FbxNode* pNode, int pDepth, const char *pFullPath, const char *pRelativePath);
-	void _FBX_load_mesh(vector<IMesh*>& meshes, FbxMesh *pMesh, FbxNode *pNode, const char *pFullPath, const char *pRelativePath);
-	void _FBX_load_node_transform(FbxNode* pNode, const char *str);
+	// Thread-safe. Messages go to log
+	void _FBX_initialize_SDK_objects(LogBuffer& log, FbxManager*& pManager, FbxScene*& pScene) const;
+	void _FBX_destroy_SDK_objects(LogBuffer& log, FbxManager* pManager, bool pExitStatus) const;
+
+	vector<MeshData> _FBX_load_meshes(LogBuffer& log, const char *pFullPath, const char *pRelativePath) const;
+	bool _FBX_load_scene(LogBuffer& log, FbxManager* pManager, FbxDocument* pScene, const char* pFilename) const;
+	void _FBX_load_scene_hierarchy(LogBuffer& log, vector<MeshData>& meshes, FbxScene* pScene, const char *pFullPath, const char *pRelativePath) const;
+	void _FBX_load_node(LogBuffer& log, vector<FbxNode*>& meshNodes, FbxNode* pNode, int pDepth, const char *pFullPath, const char *pRelativePath) const;
+	void _FBX_load_mesh_node(LogBuffer& log, vector<FbxNode*>& meshNodes, FbxNode *pNode) const;
+
+	// Filled on worker thread by _FBX_load_mesh(), logged after all meshes are converted
+	struct FBXMeshStats
+	{
+		uint corners;
+		uint vertices;
+		float acmrWelded;
+		float acmrOptimized;
+		uint strideBefore;
+		uint stride;
+	};
+	bool _FBX_load_mesh(OUT MeshData& mesh, OUT FBXMeshStats& stats, FbxMesh *pMesh, FbxNode *pNode) const; // thread-safe. false if mesh is empty
+	void _FBX_load_node_transform(LogBuffer& log, FbxNode* pNode, const char *str) const;
+
+	// Converter: imports models and writes mesh cache next to them (see MeshCache.h)
+	API mesh_cache_build(const char **args, uint argsNumber);
 	#endif
 
+	IMesh* createMesh(const MeshData& mesh, const char *pRelativePath);
+	vector<IMesh*> createMeshes(const vector<MeshData>& meshes, const char *pRelativePath);
+	void addSharedMeshes(const vector<IMesh*>& meshes);
+	IModel* addModel(const vector<IMesh*>& meshes);
+
 	API resources_list(const char **args, uint argsNumber);
 
 	uint getNumLines() override;
@@ -67,8 +167,12 @@ class ResourceManager final : public IResourceManager, IProfilerCallback
 	string constructFullPath(const string& file);
 	bool errorIfPathNotExist(const string& fullPath);
 	vector<IMesh*> findLoadedMeshes(const char* pRelativeModelPath, const char *pMeshID);
+	string textFileFullPath(const char *fileName);
 	const char *loadTextFile(const char *fileName);
+	char *readTextFile(const string& fullPath) const; // thread-safe
+	unique_ptr<uint8[]> readBinaryFile(const string& fullPath, OUT uint& size) const; // thread-safe
 	ICoreTexture *loadDDS(const char *pTexturePath, TEXTURE_CREATE_FLAGS flags);
+	ICoreTexture *createCoreTexture(const TextureData& data, TEXTURE_CREATE_FLAGS flags);
 	size_t sharedResources();
 	size_t runtimeResources();
 
@@ -86,8 +190,10 @@ public:
 	void RemoveRuntimeShader(IShader *s) { _runtimeShaders.erase(s); }
 	void RemoveRuntimeRenderTarget(IRenderTarget *rt) { _runtimeRenderTargets.erase(rt); }
 	void RemoveRuntimeStructuredBuffer(IStructuredBuffer *b) { _runtimeStructuredBuffers.erase(b); }
+	void RemoveRuntimeLoadHandle(ILoadHandle *h) { _runtimeLoadHandles.erase(h); }
 
 	void ReloadTextFile(ITextFile *shaderText);
+	vector<IMesh*> LoadedMeshes();
 
 	void Init();
 
@@ -96,8 +202,13 @@ public:
 	API LoadTexture(OUT ITexture **pTexture, const char *path, TEXTURE_CREATE_FLAGS flags) override;
 	API LoadTextFile(OUT ITextFile **pShader, const char *path) override;
 
+	API LoadModelAsync(OUT ILoadHandle **pHandle, const char *path) override;
+	API LoadTextureAsync(OUT ILoadHandle **pHandle, const char *path, TEXTURE_CREATE_FLAGS flags) override;
+	API LoadTextFileAsync(OUT ILoadHandle **pHandle, const char *path) override;
+
 	API CreateTexture(OUT ITexture **pTextureOut, uint width, uint height, TEXTURE_TYPE type, TEXTURE_FORMAT format, TEXTURE_CREATE_FLAGS flags) override;
 	API CreateShader(OUT IShader **pShaderOut, const char *vert, const char *geom, const char *frag) override;
+	API CreateShaderFromBinary(OUT IShader **pShaderOut, const uint8 *data, uint size, const char *vert, const char *geom, const char *frag) override;
 	API CreateRenderTarget(OUT IRenderTarget **pRenderTargetOut) override;
 	API CreateStructuredBuffer(OUT IStructuredBuffer **pBufOut, uint size, uint elementSize) override;
 	API CreateGameObject(OUT IGameObject **pGameObject) override;
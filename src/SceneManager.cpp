@@ -191,6 +191,7 @@ void SceneManager::Free()
 	for (auto it = _gameobjects.begin(); it != _gameobjects.end(); ++it)
 	{
 		IGameObject* res = *it;
+		_gameObjectDeleteEvent->Fire(res);
 		res->Release();
 	}
 	_gameobjects.clear();
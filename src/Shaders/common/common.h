@@ -3,8 +3,8 @@
 
 	// Constant buffer
 	UNIFORM_BUFFER_BEGIN(vertex_transformation_parameters)
-		UNIFORM(mat4, MVP)
-		UNIFORM(mat4, NM)
+		UNIFORM(mat4, VP)
+		UNIFORM(uint, instance_offset)
 	UNIFORM_BUFFER_END
 
 
@@ -20,6 +20,9 @@
 		#ifdef ENG_INPUT_COLOR
 			ATTRIBUTE(vec4, Color, TEXCOORD3)
 		#endif
+		#ifdef ENG_INPUT_TANGENT
+			ATTRIBUTE(vec4, Tangent, TEXCOORD4)
+		#endif
 	END_STRUCT
 
 
@@ -37,16 +40,62 @@
 		#ifdef ENG_INPUT_COLOR
 			ATTRIBUTE_VERETX_IN(3, vec4, ColorIn, TEXCOORD3)
 		#endif
+		#ifdef ENG_INPUT_TANGENT
+			ATTRIBUTE_VERETX_IN(4, vec4, TangentIn, TEXCOORD4)
+		#endif
+		INSTANCE_IN
 	END_STRUCT
 
+	// Compact vertex formats
+	// Half floats and 16 bit normalized integers come to shader as floats,
+	// only octahedral normals and tangents have to be decoded
+	vec3 octDecode(vec2 e)
+	{
+		vec3 n = vec3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+		float t = max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return normalize(n);
+	}
+
+	#ifdef ENG_INPUT_NORMAL_OCTAHEDRAL
+		#define NORMAL_IN octDecode(IN_ATTRIBUTE(NormalIn).xy)
+	#else
+		#define NORMAL_IN IN_ATTRIBUTE(NormalIn).xyz
+	#endif
+
+	// xyz - tangent, w - handedness of bitangent
+	#ifdef ENG_INPUT_TANGENT_OCTAHEDRAL
+		#define TANGENT_IN vec4(octDecode(IN_ATTRIBUTE(TangentIn).xy), IN_ATTRIBUTE(TangentIn).z)
+	#else
+		#define TANGENT_IN IN_ATTRIBUTE(TangentIn)
+	#endif
+
+	// Per-instance transformations
+	// Engine fills this buffer once per frame for all drawn meshes.
+	// Instance i of draw call uses element instance_offset + i
+	struct InstanceData {
+		mat4 M;
+		mat4 NM;
+	};
+
+	STRUCTURED_BUFFER_IN(1, instance_buffer, InstanceData)
+
 
 	// Default implementation of veretx shader
 	MAIN_VERTEX(VS_INPUT, VS_OUTPUT)
 
-		OUT_POSITION = mul(MVP, IN_ATTRIBUTE(PositionIn));
+		uint instance = instance_offset + uint(INSTANCE);
+
+		OUT_POSITION = mul(VP, mul(instance_buffer[instance].M, IN_ATTRIBUTE(PositionIn)));
 
 		#ifdef ENG_INPUT_NORMAL
-			OUT_ATTRIBUTE(Normal) = (mul(NM, vec4(IN_ATTRIBUTE(NormalIn).xyz, 0.0f))).xyz;
+			OUT_ATTRIBUTE(Normal) = (mul(instance_buffer[instance].NM, vec4(NORMAL_IN, 0.0f))).xyz;
+		#endif
+
+		#ifdef ENG_INPUT_TANGENT
+			vec4 tangent = TANGENT_IN;
+			OUT_ATTRIBUTE(Tangent) = vec4((mul(instance_buffer[instance].M, vec4(tangent.xyz, 0.0f))).xyz, tangent.w);
 		#endif
 
 		#ifdef ENG_INPUT_TEXCOORD
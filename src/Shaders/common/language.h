@@ -11,6 +11,9 @@
 // ENG_INPUT_NORMAL
 // ENG_INPUT_TEXCOORD
 // ENG_INPUT_COLOR
+// ENG_INPUT_TANGENT
+// ENG_INPUT_NORMAL_OCTAHEDRAL
+// ENG_INPUT_TANGENT_OCTAHEDRAL
 
 #ifdef ENG_OPENGL
 	#include "language_gl.h"
@@ -21,7 +21,8 @@
 //		We change this behaviour by keyword "row_major" for all uniform buffers
 //		to match C++ math lib wich keeps matrix in rom_major style.
 //		- Don't use ifdef in uniform buffer block to match C++ side struct
-#define UNIFORM_BUFFER_BEGIN(NAME) layout (row_major) uniform ubo_ ## NAME { 
+//		- std140 makes offsets independent of driver, so blocks can be mirrored by C++ structs
+#define UNIFORM_BUFFER_BEGIN(NAME) layout (std140, row_major) uniform ubo_ ## NAME { 
 #define UNIFORM_BUFFER_END };
 #define UNIFORM(TYPE, NAME) uniform TYPE NAME;
 
@@ -32,8 +33,9 @@
 #define TEXTURE(SLOT, UV) texture(_texture_ ## SLOT, UV)
 
 // Structured Buffer
+// Note: row_major for the same reason as for uniform buffers
 #define STRUCTURED_BUFFER_IN(SLOT, NAME, TYPE)\
-	layout(std430, binding=SLOT) readonly buffer ssbo_ ## NUM { TYPE NAME[]; };
+	layout(std430, row_major, binding=SLOT) readonly buffer ssbo_ ## NAME { TYPE NAME[]; };
 
 #define INSTANCE_IN
 #define INSTANCE gl_InstanceID
@@ -0,0 +1,56 @@
+#include "Pch.h"
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint threads)
+{
+	if (threads == 0)
+	{
+		// hardware_concurrency() may return 0 if it is unknown
+		const uint hc = std::thread::hardware_concurrency();
+		threads = hc > 1 ? hc - 1 : 1;
+	}
+
+	for (uint i = 0; i < threads; i++)
+		_threads.emplace_back(&ThreadPool::worker, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+
+	for (std::thread &t : _threads)
+		t.join();
+}
+
+void ThreadPool::run(std::function<void()>&& task)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_tasks.push(std::move(task));
+	}
+	_condition.notify_one();
+}
+
+void ThreadPool::worker()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this] { return _stop || !_tasks.empty(); });
+
+			// Remaining tasks are executed before exit so nobody waits forever on future
+			if (_stop && _tasks.empty())
+				return;
+
+			task = std::move(_tasks.front());
+			_tasks.pop();
+		}
+		task();
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "Common.h"
+
+//
+// Fixed number of worker threads executing tasks in FIFO order
+// Tasks must not touch graphic API or log (console window is not thread-safe)
+//
+class ThreadPool
+{
+	vector<std::thread> _threads;
+	std::queue<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stop{ false };
+
+	void worker();
+
+public:
+	ThreadPool(uint threads = 0); // 0 - hardware threads minus main thread
+	~ThreadPool();
+
+	void run(std::function<void()>&& task);
+
+	template<typename F>
+	auto submit(F&& f) -> std::future<decltype(f())>
+	{
+		typedef decltype(f()) R;
+		auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+		std::future<R> ret = task->get_future();
+		run([task]() { (*task)(); });
+		return ret;
+	}
+
+	uint threads() const { return (uint)_threads.size(); }
+};